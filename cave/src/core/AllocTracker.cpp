@@ -0,0 +1,106 @@
+#include "AllocTracker.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace Cave {
+
+namespace {
+
+thread_local AllocCounters* tCurrent = nullptr;
+
+void raisePeak(AllocCounters& counters, long long live) {
+  long long peak = counters.peakLive.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !counters.peakLive.compare_exchange_weak(peak, live,
+                                                  std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+AllocCounters* AllocTracker::current() { return tCurrent; }
+
+void AllocTracker::setCurrent(AllocCounters* counters) { tCurrent = counters; }
+
+void AllocTracker::noteAlloc(size_t bytes) {
+  for (AllocCounters* c = tCurrent; c; c = c->parent) {
+    c->count.fetch_add(1, std::memory_order_relaxed);
+    c->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    long long live =
+        c->live.fetch_add((long long)bytes, std::memory_order_relaxed) +
+        (long long)bytes;
+    raisePeak(*c, live);
+  }
+}
+
+void AllocTracker::noteFree(size_t bytes) {
+  for (AllocCounters* c = tCurrent; c; c = c->parent) {
+    c->live.fetch_sub((long long)bytes, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace Cave
+
+#ifdef CAVE_ALLOC_TRACKING_ENABLED
+
+//
+// Every block gets a header holding its size so frees can be accounted.
+// The header is max_align_t sized to keep the returned block aligned.
+//
+namespace {
+
+const size_t HEADER_SIZE = alignof(std::max_align_t) > sizeof(size_t)
+                               ? alignof(std::max_align_t)
+                               : sizeof(size_t);
+
+void* trackedAlloc(size_t size) {
+  void* block = std::malloc(size + HEADER_SIZE);
+  if (!block) {
+    return nullptr;
+  }
+  *static_cast<size_t*>(block) = size;
+  Cave::AllocTracker::noteAlloc(size);
+  return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void trackedFree(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  void* block = static_cast<char*>(ptr) - HEADER_SIZE;
+  Cave::AllocTracker::noteFree(*static_cast<size_t*>(block));
+  std::free(block);
+}
+
+void* trackedAllocOrThrow(size_t size) {
+  void* ptr = trackedAlloc(size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return trackedAllocOrThrow(size); }
+void* operator new[](size_t size) { return trackedAllocOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return trackedAlloc(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return trackedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  trackedFree(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  trackedFree(ptr);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+
+//
+// Opt-in allocation accounting (cmake -DCAVE_ALLOC_TRACKING=ON, which
+// defines CAVE_ALLOC_TRACKING_ENABLED). The library then replaces the global
+// operator new/delete with versions that prefix each block with its size
+// and charge it to the AllocCounters installed on the allocating thread.
+// Only one set of replacements may be in the program, so tracking builds the
+// library static and won't build the shared Godot and Cute adapters.
+//
+// Counters nest: an allocation is charged to the current counters and all
+// of their parents, so a stage's numbers are also included in the total.
+// "Live" is the net change since the counters were installed (allocations
+// minus frees, whoever made them) and the peak is the high-water mark of
+// that.
+//
+// When not enabled AllocScope does nothing and the counters stay at zero.
+//
+namespace Cave {
+
+struct AllocCounters {
+  std::atomic<size_t> count{0};
+  std::atomic<size_t> bytes{0};
+  std::atomic<long long> live{0};
+  std::atomic<long long> peakLive{0};
+  AllocCounters* parent = nullptr;
+};
+
+class AllocTracker {
+ public:
+  static constexpr bool isEnabled() {
+#ifdef CAVE_ALLOC_TRACKING_ENABLED
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // Counters charged on this thread (nullptr = none)
+  static AllocCounters* current();
+  static void setCurrent(AllocCounters* counters);
+
+  // Called by the operator new/delete replacements
+  static void noteAlloc(size_t bytes);
+  static void noteFree(size_t bytes);
+};
+
+//
+// Charge allocations made on this thread to counters until the end of the
+// scope. Used by StageTimer and to carry the counters onto executor workers.
+//
+class AllocScope {
+ public:
+#ifdef CAVE_ALLOC_TRACKING_ENABLED
+  explicit AllocScope(AllocCounters* counters)
+      : mPrevious(AllocTracker::current()) {
+    AllocTracker::setCurrent(counters);
+  }
+  ~AllocScope() { AllocTracker::setCurrent(mPrevious); }
+#else
+  explicit AllocScope(AllocCounters* /*counters*/) {}
+#endif
+  AllocScope(const AllocScope&) = delete;
+  AllocScope& operator=(const AllocScope&) = delete;
+
+ private:
+#ifdef CAVE_ALLOC_TRACKING_ENABLED
+  AllocCounters* mPrevious;
+#endif
+};
+
+}  // namespace Cave
+
+#endif
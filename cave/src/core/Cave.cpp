@@ -1,16 +1,27 @@
 #include "Cave.h"
 
 #include <algorithm>
-#include <set>
-
+#include <climits>
+#include <deque>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+#include <utility>
+
+#include "CaveConnectivity.h"
+#include "CaveFile.h"
 #include "CaveSmoother.h"
 #include "Debug.h"
+#include "Diagnostics.h"
 #include "DisjointSets.h"
+#include "Fingerprint.h"
 #include "PerlinNoise.h"
 #include "RandSimple.h"
 #include "RogueCave.hpp"
 #include "SimplexNoise.h"
 #include "TileTypes.h"
+#include "Trace.h"
 
 namespace Cave {
 
@@ -19,26 +30,165 @@ Cave::Cave(CaveInfo &info, const GenerationParams &params)
 
 Cave::~Cave() {}
 
-TileMap Cave::generate() {
+void Cave::setExecutor(Executor *executor, int maxWorkers) {
+  mExecutor = executor;
+  mMaxWorkers = maxWorkers;
+}
+
+Executor &Cave::getExecutor() const {
+  return mExecutor ? *mExecutor : Executor::getDefault();
+}
+
+void Cave::setWorkspace(Workspace *workspace) { mWorkspace = workspace; }
+
+void Cave::setRowSink(RowSink sink) { mRowSink = std::move(sink); }
+
+void Cave::setWallDistance(WallDistance *field) { mWallDistance = field; }
+
+void Cave::setPathGraph(PathGraph *graph) { mPathGraph = graph; }
+
+void Cave::setRoomGraph(RoomGraph *graph) { mRoomGraph = graph; }
+
+void Cave::setDistanceMap(DistanceMap *distances) {
+  mDistanceMap = distances;
+}
+
+Workspace &Cave::getWorkspace() {
+  return mWorkspace ? *mWorkspace : mOwnWorkspace;
+}
+
+TileMap Cave::generate(GenerationStats *stats) {
+  TileMap tileMap;
+  generateInto(tileMap, stats);
+  return tileMap;
+}
+
+void Cave::generateInto(TileMap &tileMap, GenerationStats *stats) {
+  mStats = GenerationStats();
+  mStats.mRecordFingerprints = stats && stats->mRecordFingerprints;
+  mGenerateStart = std::chrono::steady_clock::now();
   //
   // The TileMap is bordered with 1 tile wall. To make the loops easier? the X,Y
   // of the non-border corner is 0,0 and getMapPos translates it to 1,1.
   // Therefore -1,-1 is the top left corner of the border wall of TileMap.
   //
-  TileMap tileMap(mInfo.mCaveHeight + 2,
-                  std::vector<int>(mInfo.mCaveWidth + 2));
+  // NOTE: initialise sets every tile, so the old contents don't matter
+  //
+  tileMap.resize(mInfo.mCaveHeight + 2);
+  for (auto &row : tileMap) {
+    row.resize(mInfo.mCaveWidth + 2);
+  }
+  const int joined = (int)mParams.mGenerations.size() + 1;
+  {
+    StageTimer timer(mStats.mTotal);
+    CAVE_TRACE_SCOPE("generate");
+    const int start = resumeFromCheckpoint(tileMap);
+    if (start < 0) {
+      initialise(tileMap);
+      noteFingerprint("initialise", tileMap);
+      saveCheckpoint(0, tileMap);
+    }
+    if (start < joined) {
+      runCellularAutomata(tileMap, std::max(start, 0));
+      noteFingerprint("runCellularAutomata", tileMap);
+      fixUp(tileMap);
+      noteFingerprint("fixUp", tileMap);
+      findRooms(tileMap);
+      joinRooms(tileMap);
+      noteFingerprint("joinRooms", tileMap);
+      saveCheckpoint(joined, tileMap);
+    }
+    smooth(tileMap);
+    noteFingerprint("smooth", tileMap);
+    if (mWallDistance) {
+      StageTimer timer(mStats.mWallDistance);
+      mWallDistance->build(tileMap, &getExecutor(), mMaxWorkers);
+    }
+    if (mPathGraph) {
+      StageTimer timer(mStats.mPathGraph);
+      mPathGraph->build(tileMap, &getExecutor(), mMaxWorkers);
+    }
+    if (mDistanceMap) {
+      StageTimer timer(mStats.mDistanceMap);
+      mDistanceMap->build(tileMap, {mInfo.mStartCellX, mInfo.mStartCellY});
+    }
+  }
+  if (stats) {
+    *stats = mStats;
+  }
+}
 
-  initialise(tileMap);
-  runCellularAutomata(tileMap);
-  fixUp(tileMap);
-  auto floorMaps = findRooms(tileMap);
-  joinRooms(tileMap, floorMaps);
-  smooth(tileMap);
+void Cave::noteFingerprint(const char *stage, const TileMap &tileMap) {
+  if (mStats.mRecordFingerprints) {
+    mStats.mFingerprints.push_back({stage, fingerprint(tileMap)});
+  }
+}
 
-  return tileMap;
+int Cave::resumeFromCheckpoint(TileMap &tileMap) {
+  Workspace &ws = getWorkspace();
+  if (!ws.mKeepCheckpoints) {
+    return -1;
+  }
+  const int joined = (int)mParams.mGenerations.size() + 1;
+  const int last = std::min((int)ws.mCheckpoints.size() - 1,
+                            mRoomGraph ? joined - 1 : joined);
+  for (int stage = last; stage >= 0; --stage) {
+    const Workspace::Checkpoint &checkpoint = ws.mCheckpoints[stage];
+    if (checkpoint.mTileMap.size() != tileMap.size() ||
+        checkpoint.mKey != hashStageInputs(mInfo, mParams, stage)) {
+      continue;
+    }
+    // Can't give fingerprints for stages that weren't recorded
+    const bool record = mStats.mRecordFingerprints;
+    if (record && !checkpoint.mStats.mRecordFingerprints) {
+      continue;
+    }
+    for (size_t y = 0; y < tileMap.size(); ++y) {
+      tileMap[y].assign(checkpoint.mTileMap[y].begin(),
+                        checkpoint.mTileMap[y].end());
+    }
+    // Keep the counts but not the times of the stages skipped
+    mStats = checkpoint.mStats;
+    mStats.mRecordFingerprints = record;
+    mStats.mTotal = StageStats();
+    mStats.mInitialise = StageStats();
+    mStats.mCellularAutomata = StageStats();
+    if (stage == joined) {
+      mStats.mFixUp = StageStats();
+      mStats.mFindRooms = StageStats();
+      mStats.mDetectBorderWalls = StageStats();
+      mStats.mFindMST = StageStats();
+      mStats.mCarveTunnels = StageStats();
+    }
+    mStats.mCheckpoint = stage;
+    CAVE_LOG_DEBUG("Resuming from checkpoint " << stage << " of " << joined);
+    return stage;
+  }
+  return -1;
+}
+
+void Cave::saveCheckpoint(int stage, const TileMap &tileMap) {
+  Workspace &ws = getWorkspace();
+  if (!ws.mKeepCheckpoints) {
+    return;
+  }
+  // Any past the end are from a run with more GenerationSteps
+  if (stage == (int)mParams.mGenerations.size() + 1 ||
+      ws.mCheckpoints.size() <= (size_t)stage) {
+    ws.mCheckpoints.resize(stage + 1);
+  }
+  Workspace::Checkpoint &checkpoint = ws.mCheckpoints[stage];
+  checkpoint.mKey = hashStageInputs(mInfo, mParams, stage);
+  checkpoint.mTileMap.resize(tileMap.size());
+  for (size_t y = 0; y < tileMap.size(); ++y) {
+    checkpoint.mTileMap[y].assign(tileMap[y].begin(), tileMap[y].end());
+  }
+  checkpoint.mStats = mStats;
 }
 
 void Cave::initialise(TileMap &tileMap) {
+  StageTimer timer(mStats.mInitialise);
+  CAVE_TRACE_SCOPE("initialise");
   RNG::RandSimple simple(mParams.seed);
 
   //
@@ -55,6 +205,12 @@ void Cave::initialise(TileMap &tileMap) {
     setCell(tileMap, mInfo.mCaveWidth, cy - 1, WALL);
   }
 
+  // Multiresolution makes its own noise at the coarse size
+  if (mParams.mCoarseLevels > 0) {
+    mStats.noteScratch(gridBytes(tileMap));
+    return;
+  }
+
   //
   // Fill with random or perlin
   //
@@ -73,10 +229,22 @@ void Cave::initialise(TileMap &tileMap) {
       setCell(tileMap, cx, cy, (n1 < 0) ? WALL : FLOOR);
     }
   }
+  mStats.noteScratch(gridBytes(tileMap));
 }
 
-void Cave::runCellularAutomata(TileMap &tileMap) {
-  if (!mParams.mGenerations.empty()) {
+void Cave::runCellularAutomata(TileMap &tileMap, int firstStep) {
+  StageTimer timer(mStats.mCellularAutomata);
+  CAVE_TRACE_SCOPE("runCellularAutomata");
+  if (mParams.mCoarseLevels > 0) {
+    runMultiresCellularAutomata(tileMap, 0);
+    return;
+  }
+  const int numSteps = (int)mParams.mGenerations.size();
+  // Checkpoints need each GenerationStep run on its own
+  const bool byStep = getWorkspace().mKeepCheckpoints;
+  for (int step = firstStep; step < numSteps;) {
+    const int endStep = byStep ? step + 1 : numSteps;
+    StageTimer libs(mStats.mLibs);
     // initialise the RogueCave grid from the TileMap
     PCG::RogueCave cave(mInfo.mCaveWidth, mInfo.mCaveHeight);
     std::vector<std::vector<int>> &gridIn = cave.getGrid();
@@ -85,91 +253,219 @@ void Cave::runCellularAutomata(TileMap &tileMap) {
         gridIn[cy][cx] = Cave::isWall(tileMap, cx, cy)
                              ? PCG::RogueCave::TILE_WALL
                              : PCG::RogueCave::TILE_FLOOR;
-        LOG_DEBUG_CONT(
-            ((gridIn[cy][cx] == PCG::RogueCave::TILE_FLOOR) ? ' ' : '#'));
       }
-      LOG_DEBUG(" ");
     }
+    CAVE_LOG_TRACE("-----GRID IN-----\n" << mapToString(tileMap));
 
     // run the cellular automata
-    for (const auto &gen : mParams.mGenerations) {
+    for (; step < endStep; ++step) {
+      const GenerationStep &gen = mParams.mGenerations[step];
       Util::IntRange b3(gen.b3_min, gen.b3_max);
       Util::IntRange b5(gen.b5_min, gen.b5_max);
       Util::IntRange s3(gen.s3_min, gen.s3_max);
       Util::IntRange s5(gen.s5_min, gen.s5_max);
       cave.addGeneration(b3, b5, s3, s5, gen.reps);
     }
-    std::vector<std::vector<int>> &gridOut = cave.generate();
+    std::vector<std::vector<int>> *generated = nullptr;
+    {
+      CAVE_TRACE_SCOPE("RogueCave::generate");
+      generated = &cave.generate();
+    }
+    std::vector<std::vector<int>> &gridOut = *generated;
 
     // Copy the RogueCave grid back to the TileMap
-    LOG_DEBUG("-----GRID OUT-----");
     for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
       for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
         auto tile =
             (gridOut[cy][cx] == PCG::RogueCave::TILE_WALL) ? WALL : FLOOR;
         setCell(tileMap, cx, cy, tile);
-        LOG_DEBUG_CONT(
-            ((gridOut[cy][cx] == PCG::RogueCave::TILE_FLOOR) ? ' ' : '#'));
       }
-      LOG_DEBUG(" ");
     }
+    CAVE_LOG_TRACE("-----GRID OUT-----\n" << mapToString(tileMap));
+    // NOTE: Doesn't include RogueCave's own working buffers
+    mStats.noteScratch(gridBytes(tileMap) + gridBytes(gridOut));
+    if (byStep) {
+      saveCheckpoint(step, tileMap);
+    }
+  }
+}
+
+//
+// Multiresolution levels stop before a side gets smaller than this
+//
+constexpr int MULTIRES_MIN_SIZE = 8;
+
+//
+// The default refinement: a wall if 5 or more of the 3x3 are walls. The
+// presets' own rules don't suit a doubled map, e.g. most kill walls with 9
+// walls round them, which hollows out every 2x2 block.
+//
+static const std::vector<GenerationStep> MULTIRES_REFINE = {
+    {5, 9, -1, -1, 5, 9, -1, -1, 1}};
+
+// Size of a side at a level (rounding up, so each level is half the one
+// below it rounded up)
+static int levelSize(int size, int level) {
+  return (size + (1 << level) - 1) >> level;
+}
+
+static void addGenerations(PCG::RogueCave &cave,
+                           const std::vector<GenerationStep> &steps) {
+  for (const auto &gen : steps) {
+    cave.addGeneration(Util::IntRange(gen.b3_min, gen.b3_max),
+                       Util::IntRange(gen.b5_min, gen.b5_max),
+                       Util::IntRange(gen.s3_min, gen.s3_max),
+                       Util::IntRange(gen.s5_min, gen.s5_max), gen.reps);
   }
 }
 
+void Cave::runMultiresCellularAutomata(TileMap &tileMap, int stopLevel) {
+  StageTimer libs(mStats.mLibs);
+  CAVE_TRACE_SCOPE("runMultiresCellularAutomata");
+  int coarse = std::max(mParams.mCoarseLevels, stopLevel);
+  while (coarse > 0 &&
+         std::min(levelSize(mInfo.mCaveWidth, coarse),
+                  levelSize(mInfo.mCaveHeight, coarse)) < MULTIRES_MIN_SIZE) {
+    --coarse;
+  }
+  stopLevel = std::min(stopLevel, coarse);
+
+  //
+  // Noise at the coarse size, sampled at the middle of the cells each
+  // coarse cell covers
+  //
+  int width = levelSize(mInfo.mCaveWidth, coarse);
+  int height = levelSize(mInfo.mCaveHeight, coarse);
+  std::vector<std::vector<int>> grid;
+  {
+    RNG::RandSimple simple(mParams.seed);
+    const double W = mInfo.mCaveWidth - 1 + mParams.mAmp;
+    const double H = mInfo.mCaveHeight - 1 + mParams.mAmp;
+    const double scale = 1 << coarse;
+    double (*pf)(double, double, int) =
+        mParams.mPerlin ? &Algo::getSNoise2 : &Algo::getNoise2;
+    PCG::RogueCave cave(width, height);
+    std::vector<std::vector<int>> &gridIn = cave.getGrid();
+    for (int cy = 0; cy < height; ++cy) {
+      for (int cx = 0; cx < width; ++cx) {
+        double x = (cx * scale + (scale - 1) / 2) / W * mParams.mFreq;
+        double y = (cy * scale + (scale - 1) / 2) / H * mParams.mFreq;
+
+        double n1 = mParams.mPerlin ? (*pf)(x, y, mParams.mOctaves)
+                                    : simple.getFloat() - mParams.mWallChance;
+        gridIn[cy][cx] = (n1 < 0) ? PCG::RogueCave::TILE_WALL
+                                  : PCG::RogueCave::TILE_FLOOR;
+      }
+    }
+    addGenerations(cave, mParams.mCoarseGenerations.empty()
+                             ? mParams.mGenerations
+                             : mParams.mCoarseGenerations);
+    CAVE_TRACE_SCOPE("RogueCave::generate");
+    grid.swap(cave.generate());
+  }
+  CAVE_LOG_DEBUG("Multires: " << width << "x" << height << " at level "
+                              << coarse);
+
+  const std::vector<GenerationStep> &refine =
+      mParams.mRefineGenerations.empty() ? MULTIRES_REFINE
+                                         : mParams.mRefineGenerations;
+  for (int level = coarse - 1; level >= stopLevel; --level) {
+    width = levelSize(mInfo.mCaveWidth, level);
+    height = levelSize(mInfo.mCaveHeight, level);
+    PCG::RogueCave cave(width, height);
+    std::vector<std::vector<int>> &gridIn = cave.getGrid();
+    for (int cy = 0; cy < height; ++cy) {
+      for (int cx = 0; cx < width; ++cx) {
+        gridIn[cy][cx] = grid[cy / 2][cx / 2];
+      }
+    }
+    addGenerations(cave, refine);
+    CAVE_TRACE_SCOPE("RogueCave::generate");
+    grid.swap(cave.generate());
+  }
+
+  for (int cy = 0; cy < height; ++cy) {
+    for (int cx = 0; cx < width; ++cx) {
+      setCell(tileMap, cx, cy,
+              (grid[cy][cx] == PCG::RogueCave::TILE_WALL) ? WALL : FLOOR);
+    }
+  }
+  // NOTE: Doesn't include RogueCave's own working buffers
+  mStats.noteScratch(gridBytes(tileMap) + gridBytes(grid));
+}
+
+TileMap Cave::generatePreview(int level) {
+  mStats = GenerationStats();
+  StageTimer timer(mStats.mTotal);
+  CAVE_TRACE_SCOPE("generatePreview");
+  level = std::max(level, 0);
+  while (level > 0 && std::min(levelSize(mInfo.mCaveWidth, level),
+                               levelSize(mInfo.mCaveHeight, level)) <
+                          MULTIRES_MIN_SIZE) {
+    --level;
+  }
+  TileMap tileMap(levelSize(mInfo.mCaveHeight, level) + 2,
+                  std::vector<int>(levelSize(mInfo.mCaveWidth, level) + 2,
+                                   WALL));
+  runMultiresCellularAutomata(tileMap, level);
+  return tileMap;
+}
+
 void Cave::fixUp(TileMap &tileMap) {
-  std::vector<Vector2i> walls;
-  std::vector<Vector2i> floors;
+  StageTimer timer(mStats.mFixUp);
+  CAVE_TRACE_SCOPE("fixUp");
+  Workspace &ws = getWorkspace();
+  std::vector<Vector2i> &walls = ws.mWalls;
+  std::vector<Vector2i> &floors = ws.mFloors;
+  walls.clear();
+  floors.clear();
+  //
+  // The checks only read the map so the rows are scanned in parallel.
+  // Each band collects into its own lists (indexed by the band's first row)
+  // which are then appended in row order, same as a serial scan.
+  //
+  std::vector<Workspace::CellLists> &bands = ws.mFixUpBands;
+  if (bands.size() < (size_t)mInfo.mCaveHeight) {
+    bands.resize(mInfo.mCaveHeight);
+  }
   for (int lp = 0; lp < 10; ++lp) {
+    CAVE_TRACE_SCOPE("fixUp pass");
+    mStats.mFixUpIterations = lp + 1;
+    parallelForRows(
+        getExecutor(), mInfo.mCaveHeight, mMaxWorkers,
+        [&](int rowBegin, int rowEnd) {
+          CAVE_TRACE_SCOPE("fixUp band");
+          Workspace::CellLists &band = bands[rowBegin];
+          for (int cy = rowBegin; cy < rowEnd; ++cy) {
+            for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
+              const TileName fixed = getFixUpTile(tileMap, cx, cy);
+              if (fixed == FLOOR) {
+                band.floors.push_back({cx, cy});
+              } else if (fixed == WALL) {
+                band.walls.push_back({cx, cy});
+              }
+            }
+          }
+        });
     for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
-      for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
-        int DIAG = 0;
-        int NSEW = 0;
-
-        if (Cave::isWall(tileMap, cx - 1, cy - 1))
-          DIAG += 1;
-        if (Cave::isWall(tileMap, cx, cy - 1))
-          NSEW += 1;
-        if (Cave::isWall(tileMap, cx + 1, cy - 1))
-          DIAG += 2;
-        if (Cave::isWall(tileMap, cx + 1, cy))
-          NSEW += 2;
-        if (Cave::isWall(tileMap, cx - 1, cy))
-          NSEW += 8;
-        if (Cave::isWall(tileMap, cx - 1, cy + 1))
-          DIAG += 8;
-        if (Cave::isWall(tileMap, cx, cy + 1))
-          NSEW += 4;
-        if (Cave::isWall(tileMap, cx + 1, cy + 1))
-          DIAG += 4;
-
-        LOG_DEBUG(cx << "," << cy << " D:" << DIAG << " N:" << NSEW
-                     << " W:" << Cave::isWall(tileMap, cx, cy));
-
-        if (Cave::isWall(tileMap, cx, cy)) {
-          if (((DIAG & 0b0001) != 0) && ((NSEW & 0b1001) == 0))
-            floors.push_back({cx, cy});
-          if (((DIAG & 0b0010) != 0) && ((NSEW & 0b0011) == 0))
-            floors.push_back({cx, cy});
-          if (((DIAG & 0b0100) != 0) && ((NSEW & 0b0110) == 0))
-            floors.push_back({cx, cy});
-          if (((DIAG & 0b1000) != 0) && ((NSEW & 0b1100) == 0))
-            floors.push_back({cx, cy});
-        } else if ((DIAG == 0b1111) && (NSEW == 0b1111)) {
-          walls.push_back({cx, cy});
-          LOG_DEBUG("ADDWALL: " << cx << "," << cy << " D:" << DIAG
-                                << " N:" << NSEW);
-        }
-      }
+      walls.insert(walls.end(), bands[cy].walls.begin(), bands[cy].walls.end());
+      floors.insert(floors.end(), bands[cy].floors.begin(),
+                    bands[cy].floors.end());
+      bands[cy].walls.clear();
+      bands[cy].floors.clear();
     }
-    LOG_DEBUG("WALLS: " << walls.size() << " FLOORS: " << floors.size());
+    CAVE_LOG_DEBUG("WALLS: " << walls.size() << " FLOORS: " << floors.size());
+    mStats.noteScratch(gridBytes(tileMap) +
+                       (walls.capacity() + floors.capacity()) *
+                           sizeof(Vector2i));
     if (walls.empty() && floors.empty())
       return;
     for (Vector2i corner : walls) {
-      LOG_DEBUG("WALL: " << corner.x << "," << corner.y);
+      CAVE_LOG_TRACE("WALL: " << corner.x << "," << corner.y);
       setCell(tileMap, corner.x, corner.y, WALL);
     }
     for (Vector2i corner : floors) {
-      LOG_DEBUG("FLOOR: " << corner.x << "," << corner.y);
+      CAVE_LOG_TRACE("FLOOR: " << corner.x << "," << corner.y);
       setCell(tileMap, corner.x, corner.y, FLOOR);
     }
     walls.clear();
@@ -177,171 +473,228 @@ void Cave::fixUp(TileMap &tileMap) {
   }
 }
 
-std::pair<Vector2iIntMap, IntVectorOfVector2iMap>
-Cave::findRooms(TileMap &tileMap) {
-  Algo::DisjointSets<Vector2i> floors;
+TileName Cave::getFixUpTile(const TileMap &tileMap, int cx, int cy) {
+  int DIAG = 0;
+  int NSEW = 0;
+
+  if (Cave::isWall(tileMap, cx - 1, cy - 1))
+    DIAG += 1;
+  if (Cave::isWall(tileMap, cx, cy - 1))
+    NSEW += 1;
+  if (Cave::isWall(tileMap, cx + 1, cy - 1))
+    DIAG += 2;
+  if (Cave::isWall(tileMap, cx + 1, cy))
+    NSEW += 2;
+  if (Cave::isWall(tileMap, cx - 1, cy))
+    NSEW += 8;
+  if (Cave::isWall(tileMap, cx - 1, cy + 1))
+    DIAG += 8;
+  if (Cave::isWall(tileMap, cx, cy + 1))
+    NSEW += 4;
+  if (Cave::isWall(tileMap, cx + 1, cy + 1))
+    DIAG += 4;
+
+  CAVE_LOG_TRACE(cx << "," << cy << " D:" << DIAG << " N:" << NSEW
+                    << " W:" << Cave::isWall(tileMap, cx, cy));
+
+  if (Cave::isWall(tileMap, cx, cy)) {
+    // A wall only touching another wall diagonally
+    if ((((DIAG & 0b0001) != 0) && ((NSEW & 0b1001) == 0)) ||
+        (((DIAG & 0b0010) != 0) && ((NSEW & 0b0011) == 0)) ||
+        (((DIAG & 0b0100) != 0) && ((NSEW & 0b0110) == 0)) ||
+        (((DIAG & 0b1000) != 0) && ((NSEW & 0b1100) == 0)))
+      return FLOOR;
+  } else if ((DIAG == 0b1111) && (NSEW == 0b1111)) {
+    CAVE_LOG_TRACE("ADDWALL: " << cx << "," << cy << " D:" << DIAG
+                               << " N:" << NSEW);
+    return WALL;
+  }
+  return IGNORE;
+}
+
+void Cave::findRooms(TileMap &tileMap) {
+  StageTimer timer(mStats.mFindRooms);
+  CAVE_TRACE_SCOPE("findRooms");
+  Workspace &ws = getWorkspace();
   static const std::vector<Vector2i> directions = {
       {0, 1}, {1, 0}, {0, -1}, {-1, 0}};
-  LOG_DEBUG("----FIND ROOMS----");
+  CAVE_LOG_DEBUG("----FIND ROOMS----");
+  const int width = mInfo.mCaveWidth;
+  std::vector<int> &cellRoom = ws.mCellRoom;
+  cellRoom.assign((size_t)width * mInfo.mCaveHeight, -1);
 
-  for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
-    for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
-      if (isFloor(tileMap, cx, cy)) {
-        floors.addElement({cx, cy});
-        LOG_DEBUG("FLOOR: " << cx << "," << cy);
+  //
+  // Label each floor cell with its set's ID. Nothing else is done while
+  // the DisjointSets is around so mLibs has only its allocations.
+  //
+  {
+    StageTimer libs(mStats.mLibs);
+    Algo::DisjointSets<Vector2i> floors;
+    for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
+      for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
+        if (isFloor(tileMap, cx, cy)) {
+          floors.addElement({cx, cy});
+          CAVE_LOG_TRACE("FLOOR: " << cx << "," << cy);
+        }
       }
     }
-  }
 
-  for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
-    for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
-      if (isFloor(tileMap, cx, cy)) {
-        for (const Vector2i &dir : directions) {
-          int nx = cx + dir.x;
-          int ny = cy + dir.y;
-          if ((nx >= 0 && nx < mInfo.mCaveWidth) &&
-              (ny >= 0 && ny < mInfo.mCaveHeight)) {
-            if (isFloor(tileMap, nx, ny)) {
-              int i1 = floors.findSet({cx, cy});
-              int i2 = floors.findSet({nx, ny});
-              LOG_DEBUG("JOIN: " << cx << "," << cy << " nxy:" << nx << ","
-                                 << ny << " " << i1 << "->" << i2);
-              floors.joinSets(i1, i2);
+    for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
+      for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
+        if (isFloor(tileMap, cx, cy)) {
+          for (const Vector2i &dir : directions) {
+            int nx = cx + dir.x;
+            int ny = cy + dir.y;
+            if ((nx >= 0 && nx < mInfo.mCaveWidth) &&
+                (ny >= 0 && ny < mInfo.mCaveHeight)) {
+              if (isFloor(tileMap, nx, ny)) {
+                int i1 = floors.findSet({cx, cy});
+                int i2 = floors.findSet({nx, ny});
+                CAVE_LOG_TRACE("JOIN: " << cx << "," << cy << " nxy:" << nx
+                                        << "," << ny << " " << i1 << "->"
+                                        << i2);
+                floors.joinSets(i1, i2);
+              }
             }
           }
         }
       }
     }
-  }
 
-  Vector2iIntMap grid_to_set;
-  IntVectorOfVector2iMap set_to_cells;
+    for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
+      for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
+        if (isFloor(tileMap, cx, cy)) {
+          cellRoom[cy * width + cx] = floors.findSet({cx, cy});
+          CAVE_LOG_TRACE("xy: " << cx << "," << cy << " <=> "
+                                << cellRoom[cy * width + cx]);
+        }
+      }
+    }
+  }
 
+  //
+  // Number the rooms in ID order and group their cells. The grouping is a
+  // counting sort so each room's cells stay in the order scanned (column by
+  // column).
+  //
+  std::vector<int> &roomIds = ws.mRoomIds;
+  std::vector<int> &roomStart = ws.mRoomStart;
+  roomIds.clear();
+  for (int room : cellRoom) {
+    if (room >= 0) {
+      roomIds.push_back(room);
+    }
+  }
+  const size_t numFloors = roomIds.size();
+  std::sort(roomIds.begin(), roomIds.end());
+  roomIds.erase(std::unique(roomIds.begin(), roomIds.end()), roomIds.end());
+
+  roomStart.assign(roomIds.size() + 1, 0);
+  for (int &room : cellRoom) {
+    if (room >= 0) {
+      room = (int)(std::lower_bound(roomIds.begin(), roomIds.end(), room) -
+                   roomIds.begin());
+      ++roomStart[room + 1];
+    }
+  }
+  for (size_t i = 1; i < roomStart.size(); ++i) {
+    roomStart[i] += roomStart[i - 1];
+  }
+  // Use the starts as insert positions, which leaves each at the next
+  // room's start, then shift them back
+  ws.mRoomCells.resize(numFloors);
   for (int cx = 0; cx < mInfo.mCaveWidth; ++cx) {
     for (int cy = 0; cy < mInfo.mCaveHeight; ++cy) {
-      if (isFloor(tileMap, cx, cy)) {
-        Vector2i current = {cx, cy};
-        int rootId = floors.findSet(current);
-        grid_to_set[current] = rootId;
-        set_to_cells[rootId].push_back(current);
-        LOG_DEBUG("xy: " << cx << "," << cy << " <=> " << rootId);
+      int room = cellRoom[cy * width + cx];
+      if (room >= 0) {
+        ws.mRoomCells[roomStart[room]++] = {cx, cy};
       }
     }
   }
+  for (size_t i = roomStart.size() - 1; i > 0; --i) {
+    roomStart[i] = roomStart[i - 1];
+  }
+  roomStart[0] = 0;
 
-  return std::pair(grid_to_set, set_to_cells);
+  mStats.mRooms = ws.numRooms();
+  // NOTE: Doesn't include the DisjointSets
+  mStats.noteScratch(gridBytes(tileMap) + ws.bytes());
 }
 
-void Cave::joinRooms(
-    TileMap &tileMap,
-    std::pair<Vector2iIntMap, IntVectorOfVector2iMap> floorMaps) {
-  std::vector<Cave::BorderWall> borderWalls =
-      detectBorderWalls(tileMap, floorMaps);
-  IntVectorOfVector2iMap roomToFloorsMap = floorMaps.second;
+void Cave::joinRooms(TileMap &tileMap) {
+  CAVE_TRACE_SCOPE("joinRooms");
+  Workspace &ws = getWorkspace();
+  detectBorderWalls(tileMap);
 
-  LOG_DEBUG("----JOIN ROOMS----");
-  for (int y = 0; y < tileMap.size(); ++y) {
-    for (int x = 0; x < tileMap[0].size(); ++x) {
-      LOG_DEBUG_CONT(((tileMap[y][x] == FLOOR) ? ' ' : '#'));
-    }
-    LOG_DEBUG("");
-  }
+  CAVE_LOG_TRACE("----JOIN ROOMS----\n" << mapToString(tileMap));
 
-  std::vector<int> roomIds;
-  for (auto p : roomToFloorsMap) {
-    roomIds.push_back(p.first);
+  findMST_Kruskal(ws.mBorderWalls, ws.mRoomIds, ws.mMST);
+  if (mRoomGraph) {
+    buildRoomGraph();
   }
-  std::vector<Cave::BorderWall> mst = findMST_Kruskal(borderWalls, roomIds);
-  for (auto &node : mst) {
+  StageTimer timer(mStats.mCarveTunnels);
+  CAVE_TRACE_SCOPE("carveTunnels");
+  for (auto &node : ws.mMST) {
     int wx = node.floor1.x + node.dir.x;
     int wy = node.floor1.y + node.dir.y;
-    LOG_DEBUG_CONT("TUNNEL: " << wx << "," << wy << " dir: " << node.dir.x
-                              << "," << node.dir.y
-                              << " thick: " << node.thickness);
+    CAVE_LOG_TRACE("TUNNEL: " << wx << "," << wy << " dir: " << node.dir.x
+                                   << "," << node.dir.y
+                                   << " thick: " << node.thickness);
     for (int i = 0; i < node.thickness; ++i) {
       setCell(tileMap, wx, wy, SOLID);
-      LOG_DEBUG_CONT("  " << wx << "," << wy);
       wx += node.dir.x;
       wy += node.dir.y;
     }
-    LOG_DEBUG("");
-  }
-  LOG_DEBUG("----JOIN ROOMS END----");
-  for (int y = 0; y < tileMap.size(); ++y) {
-    for (int x = 0; x < tileMap[0].size(); ++x) {
-      if (tileMap[y][x] == SOLID) {
-        LOG_DEBUG_CONT('X');
-        tileMap[y][x] = FLOOR;
-      } else if (tileMap[y][x] == FLOOR) {
-        LOG_DEBUG_CONT(' ');
-      } else {
-        LOG_DEBUG_CONT('#');
+  }
+  // The tunnels are left as SOLID until here so they show up as 'X'
+  CAVE_LOG_TRACE("----JOIN ROOMS END----\n" << mapToString(tileMap));
+  for (auto &row : tileMap) {
+    for (auto &cell : row) {
+      if (cell == SOLID) {
+        cell = FLOOR;
       }
     }
-    LOG_DEBUG("");
-  }
-}
-
-std::vector<Cave::BorderWall> Cave::detectBorderWalls(
-    TileMap &tileMap,
-    std::pair<Vector2iIntMap, IntVectorOfVector2iMap> floorMaps) {
-  std::vector<BorderWall> borderWalls;
-  Vector2iIntMap floorToRoomMap = floorMaps.first;
-  IntVectorOfVector2iMap roomsMap = floorMaps.second;
-
-  LOG_DEBUG("----DETECT BORDER WALLS----");
-  LOG_DEBUG("ROOMS: " << roomsMap.size());
-  for (const auto &[roomID, tiles] : roomsMap) {
-    LOG_DEBUG_CONT("Tiles: " << tiles.size());
-    for (const auto &tile : tiles) {
-      LOG_DEBUG_CONT(" " << tile.x << "," << tile.y);
-    }
-    LOG_DEBUG(" ID: " << roomID);
-  }
-
-  // EVERYTHING BEFORE HERE IS THE SAME
-  // (the roomsMap is a map and is different order, but same content)
-  // Hmmmmmm, maybe try sorting
-  // But delete everything between DETECT and JOIN then sort and compare (ignore
-  // space)
-  //   WORK: 10003=> CHECK: xy:-1,10 thick:4 floor:0
-  //   FAIL: 10003=> CHECK: xy:-2,10 thick:5 floor:0
-  // also this appears
-  //   WORK: 1013==> ADJROOM: xy:16, 1 tile : 12, 1 r: 38 r2: 276
-  //   WORK: 1013=> BWALL: xy:16,1 tile: 12,1 r1: 38 r2: 276 thick: 3 wallDir:
-  //   1,0
-  // then fail gets
-  //   FAIL: 1015==> ADJROOM: xy:12,1 tile: 16,1 r: 276 r2: 38
-  //   FAIL: 1015=> BWALL: xy:12,1 tile: 16,1 r1: 38 r2: 276 thick: 3 wallDir:
-  //   -1,0 FAIL: 1015=> CHECK: xy:12,1 thick:3 floor:1
+  }
+}
+
+void Cave::detectBorderWalls(TileMap &tileMap) {
+  StageTimer timer(mStats.mDetectBorderWalls);
+  CAVE_TRACE_SCOPE("detectBorderWalls");
+  Workspace &ws = getWorkspace();
+  std::vector<BorderWall> &borderWalls = ws.mBorderWalls;
+  borderWalls.clear();
+
+  CAVE_LOG_DEBUG("----DETECT BORDER WALLS----");
+  CAVE_LOG_DEBUG("ROOMS: " << ws.numRooms());
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_TRACE
+  for (int room = 0; room < ws.numRooms(); ++room) {
+    CAVE_LOG_TRACE("Tiles: " << ws.mRoomStart[room + 1] - ws.mRoomStart[room]
+                             << " ID: " << ws.mRoomIds[room]);
+  }
+#endif
+
+  //
+  // Iterate over rooms in a deterministic order (sorted by roomID).
+  // A wall is only recorded from the lower ID room of the two it separates,
+  // i.e. rooms already checked are ignored on the far side.
   //
-  std::vector<int> checkedRooms;
-  // FIX: Iterate over rooms in a deterministic order (sorted by roomID)
-  // The original iteration over `roomsMap` (unordered_map) caused
-  // non-deterministic wall detection order.
-  std::vector<int> sortedRoomIds;
-  sortedRoomIds.reserve(roomsMap.size());
-  for (const auto &pair : roomsMap) {
-    sortedRoomIds.push_back(pair.first);
-  }
-  std::sort(sortedRoomIds.begin(), sortedRoomIds.end());
-
-  for (int roomID : sortedRoomIds) {
-    const auto &tiles = roomsMap[roomID];
-    checkedRooms.push_back(roomID);
-    for (const auto &tile : tiles) {
+  const int width = mInfo.mCaveWidth;
+  for (int room = 0; room < ws.numRooms(); ++room) {
+    const int roomID = ws.mRoomIds[room];
+    for (int t = ws.mRoomStart[room]; t < ws.mRoomStart[room + 1]; ++t) {
+      const Vector2i &tile = ws.mRoomCells[t];
       for (const auto &dir :
            {Vector2i{-1, 0}, Vector2i{1, 0}, Vector2i{0, -1}, Vector2i{0, 1}}) {
         int cx = tile.x + dir.x;
         int cy = tile.y + dir.y;
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_TRACE
         unsigned long id = cy * 1000 + cx;
-        LOG_DEBUG(id << " CHECK: xy:" << cx << "," << cy << " wall:"
-                     << isWall(tileMap, cx, cy) << "(tile:" << tile.x << ","
-                     << tile.y << " dir:" << dir.x << "," << dir.y << ")");
+#endif
+        CAVE_LOG_TRACE(id << " CHECK: xy:" << cx << "," << cy << " wall:"
+                          << isWall(tileMap, cx, cy) << "(tile:" << tile.x
+                          << "," << tile.y << " dir:" << dir.x << ","
+                          << dir.y << ")");
         if (isWall(tileMap, cx, cy)) {
-          std::set<int> adjacentRooms;
-          adjacentRooms.insert(roomID);
-
           int thickness = 0;
           while (isWall(tileMap, cx, cy)) {
             cx += dir.x;
@@ -349,30 +702,28 @@ std::vector<Cave::BorderWall> Cave::detectBorderWalls(
             thickness++;
           }
 
-          LOG_DEBUG(id << "=> CHECK: xy:" << cx << "," << cy << " thick:"
-                       << thickness << " floor:" << isFloor(tileMap, cx, cy));
+          CAVE_LOG_TRACE(id << "=> CHECK: xy:" << cx << "," << cy
+                            << " thick:" << thickness
+                            << " floor:" << isFloor(tileMap, cx, cy));
+          int otherRoom = -1;
           if (isFloor(tileMap, cx, cy)) {
-            auto it = floorToRoomMap.find({cx, cy});
-            if (it != floorToRoomMap.end()) {
-              int otherRoomID = it->second;
-              if (std::find(checkedRooms.begin(), checkedRooms.end(),
-                            otherRoomID) == checkedRooms.end()) {
-                LOG_DEBUG(id << "==> ADJROOM: xy:" << cx << "," << cy
-                             << " tile: " << tile.x << "," << tile.y
-                             << " r: " << roomID << " r2: " << otherRoomID);
-                adjacentRooms.insert(otherRoomID);
-              }
+            otherRoom = ws.mCellRoom[cy * width + cx];
+            if (otherRoom > room) {
+              CAVE_LOG_TRACE(id << "==> ADJROOM: xy:" << cx << "," << cy
+                                << " tile: " << tile.x << "," << tile.y
+                                << " r: " << roomID
+                                << " r2: " << ws.mRoomIds[otherRoom]);
             }
           }
 
-          if (adjacentRooms.size() == 2) {
-            auto it = adjacentRooms.begin();
-            int room1 = *it++;
-            int room2 = *it;
-            LOG_DEBUG(id << "=> BWALL: xy:" << cx << "," << cy << " tile: "
-                         << tile.x << "," << tile.y << " r1: " << room1
-                         << " r2: " << room2 << " thick: " << thickness
-                         << " wallDir: " << dir.x << "," << dir.y);
+          if (otherRoom > room) {
+            int room1 = roomID;
+            int room2 = ws.mRoomIds[otherRoom];
+            CAVE_LOG_TRACE(id << "=> BWALL: xy:" << cx << "," << cy
+                              << " tile: " << tile.x << "," << tile.y
+                              << " r1: " << room1 << " r2: " << room2
+                              << " thick: " << thickness << " wallDir: "
+                              << dir.x << "," << dir.y);
             borderWalls.push_back(
                 {tile, {cx, cy}, dir, room1, room2, thickness});
           }
@@ -380,20 +731,18 @@ std::vector<Cave::BorderWall> Cave::detectBorderWalls(
       }
     }
   }
-  return borderWalls;
+  mStats.mBorderWalls = (int)borderWalls.size();
+  mStats.noteScratch(gridBytes(tileMap) + ws.bytes());
 }
 
-std::vector<Cave::BorderWall>
-Cave::findMST_Kruskal(std::vector<Cave::BorderWall> &borderWalls,
-                      std::vector<int> roomIds) {
-  std::vector<BorderWall> mst;
-  Algo::DisjointSets<int> dsu;
+void Cave::findMST_Kruskal(std::vector<BorderWall> &borderWalls,
+                           const std::vector<int> &roomIds,
+                           std::vector<BorderWall> &mst) {
+  StageTimer timer(mStats.mFindMST);
+  CAVE_TRACE_SCOPE("findMST_Kruskal");
+  mst.clear();
   const int numRooms = roomIds.size();
 
-  for (int i : roomIds) {
-    dsu.addElement(i);
-  }
-
   // FIX: Use a fully deterministic comparator.
   // Previous comparator only used thickness, which is not unique.
   std::sort(borderWalls.begin(), borderWalls.end(),
@@ -412,72 +761,899 @@ Cave::findMST_Kruskal(std::vector<Cave::BorderWall> &borderWalls,
                 return a.floor1.x < b.floor1.x;
               return a.floor1.y < b.floor1.y;
             });
-  LOG_INFO("=== findMST: " << borderWalls.size() << " rooms: " << numRooms);
+  CAVE_LOG_DEBUG("=== findMST: " << borderWalls.size()
+                                  << " rooms: " << numRooms);
 
+  StageTimer libs(mStats.mLibs);
+  Algo::DisjointSets<int> dsu;
+  for (int i : roomIds) {
+    dsu.addElement(i);
+  }
   for (const BorderWall &wall : borderWalls) {
     int setU = dsu.findSet(wall.room1);
     int setV = dsu.findSet(wall.room2);
     if (setU != setV) {
       mst.push_back(wall);
       dsu.joinSets(setU, setV);
-      LOG_DEBUG(" JOIN " << setU << " " << setV);
+      CAVE_LOG_TRACE(" JOIN " << setU << " " << setV);
     }
     if (mst.size() == numRooms - 1)
       break;
   }
 
-  LOG_INFO("DONE MST: " << mst.size());
+  CAVE_LOG_DEBUG("DONE MST: " << mst.size());
+  mStats.mMSTEdges = (int)mst.size();
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_TRACE
   for (auto &node : mst) {
-    LOG_DEBUG("BORDER: r1 = " << node.room1 << " r2 = " << node.room2
-                              << " thick = " << node.thickness
-                              << " wall=" << node.dir.x << "," << node.dir.y);
+    CAVE_LOG_TRACE("BORDER: r1 = " << node.room1 << " r2 = " << node.room2
+                                   << " thick = " << node.thickness << " wall="
+                                   << node.dir.x << "," << node.dir.y);
   }
-  return mst;
+#endif
+}
+
+void Cave::buildRoomGraph() {
+  StageTimer timer(mStats.mRoomGraph);
+  CAVE_TRACE_SCOPE("buildRoomGraph");
+  const Workspace &ws = getWorkspace();
+  std::vector<RoomGraph::Room> rooms(ws.numRooms());
+  parallelForRows(
+      getExecutor(), ws.numRooms(), mMaxWorkers,
+      [&](int roomBegin, int roomEnd) {
+        for (int room = roomBegin; room < roomEnd; ++room) {
+          const int first = ws.mRoomStart[room];
+          const int last = ws.mRoomStart[room + 1];
+          int x0 = ws.mRoomCells[first].x, x1 = x0;
+          int y0 = ws.mRoomCells[first].y, y1 = y0;
+          double sumX = 0, sumY = 0;
+          for (int t = first; t < last; ++t) {
+            const Vector2i &cell = ws.mRoomCells[t];
+            x0 = std::min(x0, cell.x);
+            x1 = std::max(x1, cell.x);
+            y0 = std::min(y0, cell.y);
+            y1 = std::max(y1, cell.y);
+            sumX += cell.x;
+            sumY += cell.y;
+          }
+          RoomGraph::Room &out = rooms[room];
+          out.mArea = last - first;
+          out.mBounds = {x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+          out.mCentreX = (float)(sumX / out.mArea);
+          out.mCentreY = (float)(sumY / out.mArea);
+        }
+      });
+  // The MST has the rooms' DisjointSets IDs
+  auto roomIndex = [&](int id) {
+    return (int)(std::lower_bound(ws.mRoomIds.begin(), ws.mRoomIds.end(), id) -
+                 ws.mRoomIds.begin());
+  };
+  std::vector<RoomGraph::Tunnel> tunnels;
+  tunnels.reserve(ws.mMST.size());
+  for (const BorderWall &wall : ws.mMST) {
+    RoomGraph::Tunnel tunnel;
+    tunnel.mRoom1 = roomIndex(wall.room1);
+    tunnel.mRoom2 = roomIndex(wall.room2);
+    tunnel.mFrom = wall.floor1;
+    tunnel.mTo = wall.floor2;
+    tunnel.mDir = wall.dir;
+    tunnel.mLength = wall.thickness;
+    tunnels.push_back(tunnel);
+  }
+  mRoomGraph->build(std::move(rooms), std::move(tunnels), &getExecutor(),
+                    mMaxWorkers);
 }
 
 void Cave::smooth(TileMap &tileMap) {
+  CAVE_TRACE_SCOPE("smooth");
   CaveSmoother smoother(tileMap, mInfo);
+  smoother.setExecutor(&getExecutor(), mMaxWorkers);
+  smoother.setWorkspace(&getWorkspace());
+  CAVE_LOG_TRACE("-----BEFORE SMOOTHING-----\n" << mapToString(tileMap, true));
+  if (mRowSink) {
+    smoother.smoothRows(
+        [&](int cy, const int *tiles) {
+          if (cy == 0) {
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - mGenerateStart;
+            mStats.mFirstRowMillis = elapsed.count();
+          }
+          mRowSink(cy, tiles);
+        },
+        &mStats);
+  } else {
+    smoother.smooth(&mStats);
+  }
+  CAVE_LOG_TRACE("-----AFTER SMOOTHING-----\n" << mapToString(tileMap, true));
+}
+
+//
+// editCells works on a window around the edit. fixUp can spread a cell per
+// pass, a smoothing pattern changes cells up to 3 away from the cells it
+// reads, and the window's edges (which the smoother sees as the edge of the
+// map) are kept a few patterns away from anything that's written back.
+//
+constexpr int EDIT_FIXUP_PASSES = 10;
+constexpr int EDIT_SMOOTH_REACH = 3;
+constexpr int EDIT_SMOOTH_MARGIN = 4;
+
+static Rect2i growRect(const Rect2i &rect, int by) {
+  return {rect.x - by, rect.y - by, rect.w + 2 * by, rect.h + 2 * by};
+}
+
+static Rect2i clipRect(const Rect2i &rect, int width, int height) {
+  const int x0 = std::max(rect.x, 0);
+  const int y0 = std::max(rect.y, 0);
+  const int x1 = std::min(rect.x + rect.w, width);
+  const int y1 = std::min(rect.y + rect.h, height);
+  return {x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+}
+
+static Rect2i unionRect(const Rect2i &a, const Rect2i &b) {
+  const int x0 = std::min(a.x, b.x);
+  const int y0 = std::min(a.y, b.y);
+  const int x1 = std::max(a.x + a.w, b.x + b.w);
+  const int y1 = std::max(a.y + a.h, b.y + b.h);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
 
-  for (const auto &row : tileMap) {
-    for (const auto &cell : row) {
-      std::cout << (Cave::isEmpty(cell) ? ' ' : '#');
+void Cave::readEditRaw(const TileMap &tileMap, const Rect2i &raw) {
+  TileMap &rawMap = mEditWorkspace.mEditRaw;
+  rawMap.resize(raw.h + 2);
+  for (int j = 0; j < raw.h + 2; ++j) {
+    const std::vector<int> &row = tileMap[raw.y + j];
+    rawMap[j].resize(raw.w + 2);
+    for (int i = 0; i < raw.w + 2; ++i) {
+      rawMap[j][i] = CaveSmoother::getUnsmoothedTile(row[raw.x + i]);
     }
-    std::cout << std::endl;
   }
-  std::cout << std::endl;
-  int y = 0;
-  std::cout << std::endl;
-  for (const auto &row : tileMap) {
-    std::cout << std::setw(2) << y << "  ";
-    for (const auto &cell : row) {
-      std::cout << (Cave::isEmpty(cell) ? ' ' : '#');
+}
+
+//
+// Smooth a window around everything that changed and copy back the part the
+// changes can reach
+//
+void Cave::smoothEditRaw(TileMap &tileMap, const Rect2i &raw,
+                         const Rect2i &touched,
+                         std::vector<Vector2i> &changed) {
+  Workspace &ws = mEditWorkspace;
+  const TileMap &rawMap = ws.mEditRaw;
+  const Rect2i window =
+      clipRect(growRect(touched, EDIT_SMOOTH_REACH + EDIT_SMOOTH_MARGIN),
+               mInfo.mCaveWidth, mInfo.mCaveHeight);
+  const Rect2i update = clipRect(growRect(touched, EDIT_SMOOTH_REACH),
+                                 mInfo.mCaveWidth, mInfo.mCaveHeight);
+  TileMap &windowMap = ws.mEditWindow;
+  windowMap.resize(window.h + 2);
+  for (int j = 0; j < window.h + 2; ++j) {
+    const std::vector<int> &row = rawMap[window.y - raw.y + j];
+    windowMap[j].assign(row.begin() + (window.x - raw.x),
+                        row.begin() + (window.x - raw.x) + window.w + 2);
+  }
+  CaveInfo windowInfo = mInfo;
+  windowInfo.mCaveWidth = window.w;
+  windowInfo.mCaveHeight = window.h;
+  CaveSmoother smoother(windowMap, windowInfo);
+  smoother.setExecutor(&getExecutor(), mMaxWorkers);
+  smoother.setWorkspace(&ws);
+  smoother.smooth();
+
+  for (int cy = update.y; cy < update.y + update.h; ++cy) {
+    for (int cx = update.x; cx < update.x + update.w; ++cx) {
+      const int newTile = getTile(windowMap, cx - window.x, cy - window.y);
+      if (getTile(tileMap, cx, cy) != newTile) {
+        setCell(tileMap, cx, cy, newTile);
+        changed.push_back({cx, cy});
+      }
     }
-    ++y;
-    std::cout << std::endl;
   }
+}
 
-  std::cout << std::endl;
-  std::cout << std::endl;
-  smoother.smooth();
-  std::cout << std::endl;
-  std::cout << std::endl;
+std::vector<Vector2i> Cave::editCells(TileMap &tileMap, const Rect2i &region,
+                                      int tile) {
+  CAVE_TRACE_SCOPE("editCells");
+  std::vector<Vector2i> changed;
+  const Rect2i edit = clipRect(region, mInfo.mCaveWidth, mInfo.mCaveHeight);
+  if (edit.empty()) {
+    return changed;
+  }
+  Workspace &ws = mEditWorkspace;
 
-  for (int x = 0; x < tileMap[0].size(); ++x) {
-    std::cout << (x % 10);
+  //
+  // The unsmoothed cells around the edit as a small map with a border, so
+  // the usual getTile/setCell work on it with coords relative to raw.x,y
+  //
+  const int rawMargin =
+      EDIT_FIXUP_PASSES + EDIT_SMOOTH_REACH + EDIT_SMOOTH_MARGIN;
+  const Rect2i raw = clipRect(growRect(edit, rawMargin), mInfo.mCaveWidth,
+                              mInfo.mCaveHeight);
+  readEditRaw(tileMap, raw);
+  TileMap &rawMap = ws.mEditRaw;
+  const int rawTile = CaveSmoother::getUnsmoothedTile(tile);
+  for (int cy = edit.y; cy < edit.y + edit.h; ++cy) {
+    for (int cx = edit.x; cx < edit.x + edit.w; ++cx) {
+      setCell(rawMap, cx - raw.x, cy - raw.y, rawTile);
+    }
+  }
+
+  //
+  // fixUp, only looking at cells next to the last pass's changes. The edited
+  // cells themselves are left as asked.
+  //
+  std::vector<Vector2i> &walls = ws.mWalls;
+  std::vector<Vector2i> &floors = ws.mFloors;
+  Rect2i dirty = edit;
+  Rect2i touched = edit;
+  for (int lp = 0; lp < EDIT_FIXUP_PASSES; ++lp) {
+    walls.clear();
+    floors.clear();
+    const Rect2i scan = clipRect(growRect(dirty, 1), mInfo.mCaveWidth,
+                                 mInfo.mCaveHeight);
+    for (int cy = scan.y; cy < scan.y + scan.h; ++cy) {
+      for (int cx = scan.x; cx < scan.x + scan.w; ++cx) {
+        if (cx >= edit.x && cx < edit.x + edit.w && cy >= edit.y &&
+            cy < edit.y + edit.h) {
+          continue;
+        }
+        const TileName fixed = getFixUpTile(rawMap, cx - raw.x, cy - raw.y);
+        if (fixed == FLOOR) {
+          floors.push_back({cx, cy});
+        } else if (fixed == WALL) {
+          walls.push_back({cx, cy});
+        }
+      }
+    }
+    if (walls.empty() && floors.empty()) {
+      break;
+    }
+    Rect2i passChanged = {walls.empty() ? floors[0].x : walls[0].x,
+                          walls.empty() ? floors[0].y : walls[0].y, 1, 1};
+    for (Vector2i cell : walls) {
+      setCell(rawMap, cell.x - raw.x, cell.y - raw.y, WALL);
+      passChanged = unionRect(passChanged, {cell.x, cell.y, 1, 1});
+    }
+    for (Vector2i cell : floors) {
+      setCell(rawMap, cell.x - raw.x, cell.y - raw.y, FLOOR);
+      passChanged = unionRect(passChanged, {cell.x, cell.y, 1, 1});
+    }
+    dirty = passChanged;
+    touched = unionRect(touched, passChanged);
+  }
+
+  smoothEditRaw(tileMap, raw, touched, changed);
+  CAVE_LOG_DEBUG("editCells " << edit.x << "," << edit.y << " " << edit.w
+                              << "x" << edit.h << ": " << changed.size()
+                              << " changed, fixUp reached " << touched.w
+                              << "x" << touched.h);
+  return changed;
+}
+
+//
+// rerollRegion generates inside the region only. RogueCave counts walls up
+// to 2 cells away, so the automata run on the region plus that much, one
+// rep at a time, putting the cells round the region back after each.
+//
+constexpr int REROLL_CA_REACH = 2;
+
+std::vector<Vector2i> Cave::rerollRegion(TileMap &tileMap,
+                                         const Rect2i &region,
+                                         const GenerationParams &params) {
+  CAVE_TRACE_SCOPE("rerollRegion");
+  std::vector<Vector2i> changed;
+  const Rect2i reroll = clipRect(region, mInfo.mCaveWidth, mInfo.mCaveHeight);
+  if (reroll.empty()) {
+    return changed;
+  }
+  Workspace &ws = mEditWorkspace;
+  const Rect2i raw =
+      clipRect(growRect(reroll, EDIT_SMOOTH_REACH + EDIT_SMOOTH_MARGIN),
+               mInfo.mCaveWidth, mInfo.mCaveHeight);
+  readEditRaw(tileMap, raw);
+  TileMap &rawMap = ws.mEditRaw;
+
+  //
+  // Fill the region as initialise fills the map, but drawing the random
+  // fill for the region's cells only. The Perlin noise is sampled where it
+  // would be for the whole map, moved along by the change of seed.
+  //
+  RNG::RandSimple simple(params.seed);
+  const double W = mInfo.mCaveWidth - 1 + params.mAmp;
+  const double H = mInfo.mCaveHeight - 1 + params.mAmp;
+  const double shift = (double)params.seed - mParams.seed;
+  double (*pf)(double, double, int) =
+      params.mPerlin ? &Algo::getSNoise2 : &Algo::getNoise2;
+  for (int cy = reroll.y; cy < reroll.y + reroll.h; ++cy) {
+    for (int cx = reroll.x; cx < reroll.x + reroll.w; ++cx) {
+      double x = cx / W * params.mFreq + shift;
+      double y = cy / H * params.mFreq + shift;
+
+      double n1 = params.mPerlin ? (*pf)(x, y, params.mOctaves)
+                                 : simple.getFloat() - params.mWallChance;
+      setCell(rawMap, cx - raw.x, cy - raw.y, (n1 < 0) ? WALL : FLOOR);
+    }
+  }
+
+  const Rect2i ca = clipRect(growRect(reroll, REROLL_CA_REACH),
+                             mInfo.mCaveWidth, mInfo.mCaveHeight);
+  for (const auto &gen : params.mGenerations) {
+    for (int rep = 0; rep < gen.reps; ++rep) {
+      PCG::RogueCave cave(ca.w, ca.h);
+      std::vector<std::vector<int>> &gridIn = cave.getGrid();
+      for (int cy = ca.y; cy < ca.y + ca.h; ++cy) {
+        for (int cx = ca.x; cx < ca.x + ca.w; ++cx) {
+          gridIn[cy - ca.y][cx - ca.x] =
+              isWall(rawMap, cx - raw.x, cy - raw.y)
+                  ? PCG::RogueCave::TILE_WALL
+                  : PCG::RogueCave::TILE_FLOOR;
+        }
+      }
+      cave.addGeneration(Util::IntRange(gen.b3_min, gen.b3_max),
+                         Util::IntRange(gen.b5_min, gen.b5_max),
+                         Util::IntRange(gen.s3_min, gen.s3_max),
+                         Util::IntRange(gen.s5_min, gen.s5_max), 1);
+      const std::vector<std::vector<int>> &gridOut = cave.generate();
+      for (int cy = reroll.y; cy < reroll.y + reroll.h; ++cy) {
+        for (int cx = reroll.x; cx < reroll.x + reroll.w; ++cx) {
+          auto tile = (gridOut[cy - ca.y][cx - ca.x] ==
+                       PCG::RogueCave::TILE_WALL)
+                          ? WALL
+                          : FLOOR;
+          setCell(rawMap, cx - raw.x, cy - raw.y, tile);
+        }
+      }
+    }
+  }
+
+  //
+  // fixUp, changing only the region's cells. Again after joining in case
+  // the tunnels left a wall only touching another diagonally.
+  //
+  fixUpEditRaw(raw, reroll);
+  joinRerolledRooms(raw, reroll);
+  fixUpEditRaw(raw, reroll);
+  smoothEditRaw(tileMap, raw, reroll, changed);
+  CAVE_LOG_DEBUG("rerollRegion " << reroll.x << "," << reroll.y << " "
+                                 << reroll.w << "x" << reroll.h << ": "
+                                 << changed.size() << " changed");
+  return changed;
+}
+
+void Cave::fixUpEditRaw(const Rect2i &raw, const Rect2i &region) {
+  Workspace &ws = mEditWorkspace;
+  TileMap &rawMap = ws.mEditRaw;
+  std::vector<Vector2i> &walls = ws.mWalls;
+  std::vector<Vector2i> &floors = ws.mFloors;
+  for (int lp = 0; lp < EDIT_FIXUP_PASSES; ++lp) {
+    walls.clear();
+    floors.clear();
+    for (int cy = region.y; cy < region.y + region.h; ++cy) {
+      for (int cx = region.x; cx < region.x + region.w; ++cx) {
+        const TileName fixed = getFixUpTile(rawMap, cx - raw.x, cy - raw.y);
+        if (fixed == FLOOR) {
+          floors.push_back({cx, cy});
+        } else if (fixed == WALL) {
+          walls.push_back({cx, cy});
+        }
+      }
+    }
+    if (walls.empty() && floors.empty()) {
+      return;
+    }
+    for (Vector2i cell : walls) {
+      setCell(rawMap, cell.x - raw.x, cell.y - raw.y, WALL);
+    }
+    for (Vector2i cell : floors) {
+      setCell(rawMap, cell.x - raw.x, cell.y - raw.y, FLOOR);
+    }
+  }
+}
+
+//
+// The rooms to join are the ones in the region or touching it from outside
+// (those were reachable from each other before, through the old region or
+// otherwise). Tunnels are found as detectBorderWalls does, except they
+// must stay inside the region, then the MST is taken as for the whole map.
+//
+// Straight tunnels can't always reach, so any floor outside still apart is
+// then joined by digging the fewest walls between them, and rooms in the
+// region joined to nothing outside are filled in. With no floor round the
+// region at all its own rooms are joined that way instead.
+//
+// With outsideJoined the floor outside is known to be connected already
+// (further away than raw), so it's all one room and only needs a tunnel to
+// each room in the region.
+//
+void Cave::joinRerolledRooms(const Rect2i &raw, const Rect2i &region,
+                             bool outsideJoined) {
+  Workspace &ws = mEditWorkspace;
+  TileMap &rawMap = ws.mEditRaw;
+  auto inRegion = [&](int cx, int cy) {
+    return cx >= region.x && cx < region.x + region.w && cy >= region.y &&
+           cy < region.y + region.h;
+  };
+  static const Vector2i directions[] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+  const Rect2i around =
+      clipRect(growRect(region, 1), mInfo.mCaveWidth, mInfo.mCaveHeight);
+
+  {
+    const CaveConnectivity rooms(rawMap);
+    // Freshly built, so the IDs run from 0
+    std::vector<int> roomOf(rooms.numRegions());
+    std::iota(roomOf.begin(), roomOf.end(), 0);
+    if (outsideJoined) {
+      int outsideRoom = -1;
+      for (int cy = around.y; cy < around.y + around.h; ++cy) {
+        for (int cx = around.x; cx < around.x + around.w; ++cx) {
+          const int room = rooms.getRegion(cx - raw.x, cy - raw.y);
+          if (room >= 0 && !inRegion(cx, cy)) {
+            outsideRoom = outsideRoom < 0 ? room : outsideRoom;
+            roomOf[room] = outsideRoom;
+          }
+        }
+      }
+    }
+    auto roomAt = [&](int cx, int cy) {
+      const int room = rooms.getRegion(cx - raw.x, cy - raw.y);
+      return room < 0 ? room : roomOf[room];
+    };
+    std::vector<int> roomIds;
+    std::vector<BorderWall> &borderWalls = ws.mBorderWalls;
+    borderWalls.clear();
+    for (int cy = around.y; cy < around.y + around.h; ++cy) {
+      for (int cx = around.x; cx < around.x + around.w; ++cx) {
+        const int room = roomAt(cx, cy);
+        if (room < 0) {
+          continue;
+        }
+        roomIds.push_back(room);
+        for (const Vector2i &dir : directions) {
+          int wx = cx + dir.x;
+          int wy = cy + dir.y;
+          int thickness = 0;
+          while (inRegion(wx, wy) && isWall(rawMap, wx - raw.x, wy - raw.y)) {
+            wx += dir.x;
+            wy += dir.y;
+            thickness++;
+          }
+          // Each wall is recorded from the lower numbered room
+          const int otherRoom = roomAt(wx, wy);
+          if (thickness > 0 && otherRoom > room) {
+            borderWalls.push_back(
+                {{cx, cy}, {wx, wy}, dir, room, otherRoom, thickness});
+          }
+        }
+      }
+    }
+    std::sort(roomIds.begin(), roomIds.end());
+    roomIds.erase(std::unique(roomIds.begin(), roomIds.end()), roomIds.end());
+    findMST_Kruskal(borderWalls, roomIds, ws.mMST);
+    for (const auto &node : ws.mMST) {
+      int wx = node.floor1.x + node.dir.x;
+      int wy = node.floor1.y + node.dir.y;
+      for (int i = 0; i < node.thickness; ++i) {
+        setCell(rawMap, wx - raw.x, wy - raw.y, FLOOR);
+        wx += node.dir.x;
+        wy += node.dir.y;
+      }
+    }
+  }
+
+  //
+  // Join the pieces of floor round the region one at a time: a 0-1 BFS
+  // (walls cost 1) from the first piece through the region to any other
+  // piece, then dig the walls on the way
+  //
+  const size_t aroundCells = (size_t)around.w * around.h;
+  std::vector<int> cost;
+  std::vector<int> from;
+  std::deque<int> queue;
+  CaveConnectivity rooms;
+  std::vector<int> outside;
+  while (true) {
+    rooms.build(rawMap);
+    auto roomAt = [&](int cx, int cy) {
+      return rooms.getRegion(cx - raw.x, cy - raw.y);
+    };
+    outside.clear();
+    for (int cy = around.y; cy < around.y + around.h; ++cy) {
+      for (int cx = around.x; cx < around.x + around.w; ++cx) {
+        if (!inRegion(cx, cy) && roomAt(cx, cy) >= 0) {
+          outside.push_back(roomAt(cx, cy));
+        }
+      }
+    }
+    // No floor round the region: its own rooms are the pieces to join
+    const bool regionOnly = outside.empty();
+    if (regionOnly) {
+      for (int cy = region.y; cy < region.y + region.h; ++cy) {
+        for (int cx = region.x; cx < region.x + region.w; ++cx) {
+          if (roomAt(cx, cy) >= 0) {
+            outside.push_back(roomAt(cx, cy));
+          }
+        }
+      }
+    }
+    std::sort(outside.begin(), outside.end());
+    outside.erase(std::unique(outside.begin(), outside.end()), outside.end());
+    if (outside.size() <= 1 || (outsideJoined && !regionOnly)) {
+      break;
+    }
+
+    cost.assign(aroundCells, INT_MAX);
+    from.assign(aroundCells, -1);
+    queue.clear();
+    for (int cy = around.y; cy < around.y + around.h; ++cy) {
+      for (int cx = around.x; cx < around.x + around.w; ++cx) {
+        if (roomAt(cx, cy) == outside[0]) {
+          const int i = (cy - around.y) * around.w + (cx - around.x);
+          cost[i] = 0;
+          queue.push_back(i);
+        }
+      }
+    }
+    int found = -1;
+    while (!queue.empty() && found < 0) {
+      const int i = queue.front();
+      queue.pop_front();
+      const int cx = around.x + i % around.w;
+      const int cy = around.y + i / around.w;
+      const int room = roomAt(cx, cy);
+      if (room >= 0 && room != outside[0] &&
+          std::binary_search(outside.begin(), outside.end(), room)) {
+        found = i;
+        break;
+      }
+      for (const Vector2i &dir : directions) {
+        const int nx = cx + dir.x;
+        const int ny = cy + dir.y;
+        if (nx < around.x || ny < around.y || nx >= around.x + around.w ||
+            ny >= around.y + around.h) {
+          continue;
+        }
+        const bool wall = isWall(rawMap, nx - raw.x, ny - raw.y);
+        if (wall && !inRegion(nx, ny)) {
+          continue;  // Only the region can be dug
+        }
+        const int n = (ny - around.y) * around.w + (nx - around.x);
+        const int nCost = cost[i] + (wall ? 1 : 0);
+        if (nCost < cost[n]) {
+          cost[n] = nCost;
+          from[n] = i;
+          if (wall) {
+            queue.push_back(n);
+          } else {
+            queue.push_front(n);
+          }
+        }
+      }
+    }
+    if (found < 0) {
+      break;  // Can't happen: the region is a rectangle next to each piece
+    }
+    for (int i = found; i >= 0; i = from[i]) {
+      setCell(rawMap, around.x + i % around.w - raw.x,
+              around.y + i / around.w - raw.y, FLOOR);
+    }
+    CAVE_LOG_DEBUG("rerollRegion: dug " << cost[found] << " to join the "
+                                        << (regionOnly ? "rooms in it"
+                                                       : "floor round it"));
+  }
+
+  // Whatever's left in the region on its own
+  for (int cy = region.y; cy < region.y + region.h; ++cy) {
+    for (int cx = region.x; cx < region.x + region.w; ++cx) {
+      const int room = rooms.getRegion(cx - raw.x, cy - raw.y);
+      if (room >= 0 && !outside.empty() &&
+          !std::binary_search(outside.begin(), outside.end(), room)) {
+        setCell(rawMap, cx - raw.x, cy - raw.y, WALL);
+      }
+    }
+  }
+}
+
+//
+// generateToFile works down the map in bands of whole rows, keeping only
+// the rows the stages still need:
+//
+// - The noise is made a row at a time in the same order as initialise, and
+//   each rep of the cellular automata runs on just the rows the next rep
+//   needs (two behind the rep before, since RogueCave reads two cells
+//   away), so the cells come out the same as for the whole map.
+// - fixUp runs on the band and the EDIT_FIXUP_PASSES rows below it (as far
+//   as its passes can reach) with the rows above held as they are.
+// - The band's rooms are joined as rerollRegion joins them, to each other
+//   and to the floor above. Everything above is joined already so that
+//   counts as one room. Rooms that can't be joined to it are filled in, and
+//   with no floor above (the first band, say) they're joined to each other.
+// - For that to hold for the next band, the floor must reach the band's
+//   last row: if it doesn't a shaft is dug down to it.
+// - A band is smoothed once the band below is joined, in a window reaching
+//   EDIT_SMOOTH_REACH + EDIT_SMOOTH_MARGIN rows past it either side, and
+//   written to the file.
+//
+constexpr int FILE_MIN_BAND_ROWS = 16;
+// Roughly what a band's cells cost in all: the reps' rows and RogueCave's
+// grid, the band being joined (and its labels and tunnels) and smoothed
+// (and the smoother's grids), and the rows kept for the next band
+constexpr size_t FILE_BYTES_PER_BAND_CELL = 96;
+
+namespace {
+
+// Rows [first, end()) of a map, each with its border cells
+struct RowWindow {
+  int first = 0;
+  std::deque<std::vector<int>> rows;
+
+  int end() const { return first + (int)rows.size(); }
+  size_t bytes() const {
+    size_t total = rows.size() * sizeof(std::vector<int>);
+    for (const auto &row : rows) {
+      total += row.capacity() * sizeof(int);
+    }
+    return total;
+  }
+  const std::vector<int> &row(int cy) const { return rows[cy - first]; }
+  void dropBefore(int cy) {
+    while (first < cy && !rows.empty()) {
+      rows.pop_front();
+      ++first;
+    }
+  }
+};
+
+}  // namespace
+
+//
+// Dig straight down from the lowest floor in the band (or the row above it)
+// to the band's last row, unless it has floor already. Returns whether it
+// dug.
+//
+bool Cave::keepFloorToBottom(const Rect2i &raw, const Rect2i &band) {
+  TileMap &rawMap = mEditWorkspace.mEditRaw;
+  const int last = band.y + band.h - 1;
+  for (int cy = last; cy >= raw.y; --cy) {
+    for (int cx = band.x; cx < band.x + band.w; ++cx) {
+      if (isEmpty(rawMap, cx - raw.x, cy - raw.y)) {
+        if (cy == last) {
+          return false;
+        }
+        for (int dy = cy + 1; dy <= last; ++dy) {
+          setCell(rawMap, cx - raw.x, dy - raw.y, FLOOR);
+        }
+        CAVE_LOG_DEBUG("generateToFile: dug " << last - cy
+                                              << " rows down at " << cx);
+        return true;
+      }
+    }
+  }
+  return false;  // No floor yet
+}
+
+bool Cave::generateToFile(const std::string &path, size_t memoryBudget,
+                          GenerationStats *stats) {
+  mStats = GenerationStats();
+  bool written;
+  {
+    StageTimer timer(mStats.mTotal);
+    CAVE_TRACE_SCOPE("generateToFile");
+    written = writeBands(path, memoryBudget);
+  }
+  if (stats) {
+    *stats = mStats;
+  }
+  return written;
+}
+
+bool Cave::writeBands(const std::string &path, size_t memoryBudget) {
+  const int width = mInfo.mCaveWidth;
+  const int height = mInfo.mCaveHeight;
+  if (mParams.mCoarseLevels > 0) {
+    CAVE_LOG_WARN("generateToFile: mCoarseLevels isn't supported, "
+                  "generating at full size");
+  }
+  const size_t bandRowBytes = ((size_t)width + 2) * FILE_BYTES_PER_BAND_CELL;
+  const size_t budgetRows = memoryBudget / bandRowBytes;
+  if (budgetRows < (size_t)FILE_MIN_BAND_ROWS && budgetRows < (size_t)height) {
+    CAVE_LOG_WARN("generateToFile: " << memoryBudget << " bytes is too "
+                                     << "little for a " << width
+                                     << " wide map, using "
+                                     << FILE_MIN_BAND_ROWS << " row bands");
   }
-  std::cout << std::endl;
+  const int bandRows = (int)std::max<size_t>(
+      FILE_MIN_BAND_ROWS, std::min(budgetRows, (size_t)height));
+  const int smoothReach = EDIT_SMOOTH_REACH + EDIT_SMOOTH_MARGIN;
 
-  y = 0;
-  std::cout << std::endl;
-  for (const auto &row : tileMap) {
-    std::cout << std::setw(2) << y << "  ";
-    for (const auto &cell : row) {
-      std::cout << (Cave::isEmpty(cell) ? ' ' : '#');
+  CaveFileWriter writer;
+  if (!writer.open(path, mInfo, mParams)) {
+    return false;
+  }
+  const std::vector<int> wallRow(width + 2, WALL);
+
+  //
+  // The noise is levels[0] and each rep of each GenerationStep the next
+  //
+  std::vector<std::vector<GenerationStep>> reps;
+  for (GenerationStep gen : mParams.mGenerations) {
+    const int numReps = gen.reps;
+    gen.reps = 1;
+    for (int rep = 0; rep < numReps; ++rep) {
+      reps.push_back({gen});
     }
-    ++y;
-    std::cout << std::endl;
   }
-  std::cout << std::endl;
+  std::vector<RowWindow> levels(reps.size() + 1);
+  RowWindow joined;  // Joined, not smoothed yet
+  // Everything kept between bands, and the edit workspace's grids
+  auto keptBytes = [&]() {
+    size_t total = joined.bytes() + mEditWorkspace.bytes();
+    for (const RowWindow &level : levels) {
+      total += level.bytes();
+    }
+    return total;
+  };
+  RNG::RandSimple simple(mParams.seed);
+  const double W = width - 1 + mParams.mAmp;
+  const double H = height - 1 + mParams.mAmp;
+  double (*pf)(double, double, int) =
+      mParams.mPerlin ? &Algo::getSNoise2 : &Algo::getNoise2;
+
+  // Run the cellular automata until the last rep has the rows above end
+  auto runCellularAutomataTo = [&](int end) {
+    const int numReps = (int)reps.size();
+    RowWindow &noise = levels[0];
+    for (int cy = noise.end(); cy < std::min(height, end + 2 * numReps);
+         ++cy) {
+      std::vector<int> row = wallRow;
+      for (int cx = 0; cx < width; ++cx) {
+        double x = cx / W * mParams.mFreq;
+        double y = cy / H * mParams.mFreq;
+
+        double n1 = mParams.mPerlin ? (*pf)(x, y, mParams.mOctaves)
+                                    : simple.getFloat() - mParams.mWallChance;
+        row[cx + 1] = (n1 < 0) ? WALL : FLOOR;
+      }
+      noise.rows.push_back(std::move(row));
+    }
+    for (int level = 1; level <= numReps; ++level) {
+      RowWindow &in = levels[level - 1];
+      RowWindow &out = levels[level];
+      const int begin = out.end();
+      const int levelEnd = std::min(height, end + 2 * (numReps - level));
+      if (begin >= levelEnd) {
+        continue;
+      }
+      const int gridBegin = std::max(0, begin - REROLL_CA_REACH);
+      const int gridEnd = std::min(height, levelEnd + REROLL_CA_REACH);
+      PCG::RogueCave cave(width, gridEnd - gridBegin);
+      std::vector<std::vector<int>> &gridIn = cave.getGrid();
+      for (int cy = gridBegin; cy < gridEnd; ++cy) {
+        const std::vector<int> &row = in.row(cy);
+        for (int cx = 0; cx < width; ++cx) {
+          gridIn[cy - gridBegin][cx] = row[cx + 1] == WALL
+                                           ? PCG::RogueCave::TILE_WALL
+                                           : PCG::RogueCave::TILE_FLOOR;
+        }
+      }
+      addGenerations(cave, reps[level - 1]);
+      const std::vector<std::vector<int>> &gridOut = cave.generate();
+      // NOTE: Doesn't include RogueCave's own working buffers
+      mStats.noteScratch(keptBytes() + gridBytes(gridIn) + gridBytes(gridOut));
+      for (int cy = begin; cy < levelEnd; ++cy) {
+        std::vector<int> row = wallRow;
+        for (int cx = 0; cx < width; ++cx) {
+          row[cx + 1] =
+              (gridOut[cy - gridBegin][cx] == PCG::RogueCave::TILE_WALL)
+                  ? WALL
+                  : FLOOR;
+        }
+        out.rows.push_back(std::move(row));
+      }
+      in.dropBefore(levelEnd - REROLL_CA_REACH);
+    }
+  };
+
+  RowWindow &caRows = levels.back();
+  auto smoothAndWrite = [&](int begin, int end) {
+    const int windowBegin = std::max(0, begin - smoothReach);
+    const int windowEnd = std::min(height, end + smoothReach);
+    TileMap &windowMap = mEditWorkspace.mEditWindow;
+    windowMap.resize(windowEnd - windowBegin + 2);
+    windowMap.front() =
+        windowBegin > 0 ? joined.row(windowBegin - 1) : wallRow;
+    for (int cy = windowBegin; cy < windowEnd; ++cy) {
+      windowMap[cy - windowBegin + 1] = joined.row(cy);
+    }
+    windowMap.back() =
+        windowEnd < joined.end() ? joined.row(windowEnd) : wallRow;
+    CaveInfo windowInfo = mInfo;
+    windowInfo.mCaveHeight = windowEnd - windowBegin;
+    CaveSmoother smoother(windowMap, windowInfo);
+    smoother.setExecutor(&getExecutor(), mMaxWorkers);
+    smoother.setWorkspace(&mEditWorkspace);
+    smoother.smooth();
+    mStats.noteScratch(keptBytes());
+    for (int cy = begin; cy < end; ++cy) {
+      const std::vector<int> &row = windowMap[cy - windowBegin + 1];
+      writer.addRow(row);
+      if (mRowSink) {
+        mRowSink(cy, &row[1]);
+      }
+    }
+  };
+
+  writer.addRow(wallRow);
+  TileMap &rawMap = mEditWorkspace.mEditRaw;
+  for (int y0 = 0; y0 < height; y0 += bandRows) {
+    const int y1 = std::min(height, y0 + bandRows);
+    const int fixUpEnd = std::min(height, y1 + EDIT_FIXUP_PASSES);
+    runCellularAutomataTo(fixUpEnd);
+
+    // The band and the rows below it for fixUp, under the last joined row
+    const int rawBegin = std::max(0, y0 - 1);
+    Rect2i raw = {0, rawBegin, width, fixUpEnd - rawBegin};
+    rawMap.resize(raw.h + 2);
+    rawMap.front() = rawBegin > 0 ? joined.row(rawBegin - 1) : wallRow;
+    for (int cy = rawBegin; cy < fixUpEnd; ++cy) {
+      rawMap[cy - rawBegin + 1] = cy < y0 ? joined.row(cy) : caRows.row(cy);
+    }
+    rawMap.back() = wallRow;
+    fixUpEditRaw(raw, {0, y0, width, fixUpEnd - y0});
+
+    // Join with the rows below taken as wall, as they aren't joined yet
+    const Rect2i band = {0, y0, width, y1 - y0};
+    raw.h = y1 - rawBegin;
+    rawMap.resize(raw.h + 2);
+    rawMap.back() = wallRow;
+    joinRerolledRooms(raw, band, true);
+    // The rooms' labels were about the size of the band again
+    mStats.noteScratch(keptBytes() + gridBytes(rawMap));
+    fixUpEditRaw(raw, band);
+    if (y1 < height && keepFloorToBottom(raw, band)) {
+      fixUpEditRaw(raw, band);
+    }
+    for (int cy = y0; cy < y1; ++cy) {
+      joined.rows.push_back(rawMap[cy - rawBegin + 1]);
+    }
+    caRows.dropBefore(y1);
+
+    // The band above has the rows below it it needs now
+    if (y0 > 0) {
+      smoothAndWrite(y0 - bandRows, y0);
+      joined.dropBefore(y0 - smoothReach - 1);
+    }
+    CAVE_LOG_DEBUG("generateToFile: joined rows " << y0 << " to " << y1);
+  }
+  if (height > 0) {
+    smoothAndWrite((height - 1) / bandRows * bandRows, height);
+  }
+  writer.addRow(wallRow);
+  return writer.finish();
+}
+
+void Cave::dumpMap(std::ostream &out, const TileMap &tileMap, bool rulers) {
+  if (tileMap.empty()) {
+    return;
+  }
+  if (rulers) {
+    out << "    ";
+    for (size_t x = 0; x < tileMap[0].size(); ++x) {
+      out << (x % 10);
+    }
+    out << '\n';
+  }
+  for (size_t y = 0; y < tileMap.size(); ++y) {
+    if (rulers) {
+      out << std::setw(3) << y << ' ';
+    }
+    for (int cell : tileMap[y]) {
+      out << ((cell == SOLID) ? 'X' : (Cave::isEmpty(cell) ? ' ' : '#'));
+    }
+    out << '\n';
+  }
+}
+
+std::string Cave::mapToString(const TileMap &tileMap, bool rulers) {
+  std::ostringstream out;
+  dumpMap(out, tileMap, rulers);
+  return out.str();
 }
 
 TileName Cave::getTile(const TileMap &tileMap, int cx, int cy) {
@@ -1,13 +1,23 @@
 #ifndef CAVE_H
 #define CAVE_H
 
+#include <chrono>
 #include <cstddef>
+#include <iosfwd>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "CaveInfo.h"
+#include "DistanceMap.h"
+#include "Executor.h"
 #include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "PathGraph.h"
+#include "RoomGraph.h"
 #include "TileTypes.h"
+#include "WallDistance.h"
+#include "Workspace.h"
 
 namespace Cave {
 
@@ -30,12 +40,125 @@ using IntVectorOfVector2iMap = std::unordered_map<int, std::vector<Vector2i>>;
 class Cave {
   CaveInfo mInfo;
   GenerationParams mParams;
+  Executor* mExecutor = nullptr;
+  int mMaxWorkers = 0;
+  GenerationStats mStats;
+  Workspace* mWorkspace = nullptr;
+  Workspace mOwnWorkspace;
+  // Kept apart so edits don't resize the generation buffers
+  Workspace mEditWorkspace;
+  RowSink mRowSink;
+  WallDistance* mWallDistance = nullptr;
+  PathGraph* mPathGraph = nullptr;
+  RoomGraph* mRoomGraph = nullptr;
+  DistanceMap* mDistanceMap = nullptr;
+  std::chrono::steady_clock::time_point mGenerateStart;
 
  public:
   Cave(CaveInfo& info, const GenerationParams& params);
   ~Cave();
 
-  TileMap generate();
+  // Run the parallel stages on the given executor (nullptr = the default)
+  // using at most maxWorkers threads (0 = no cap)
+  void setExecutor(Executor* executor, int maxWorkers = 0);
+
+  // Keep the scratch buffers in the given workspace (nullptr = the cave's
+  // own) so they can be reused by the next Cave. See Workspace.h.
+  void setWorkspace(Workspace* workspace);
+
+  // If stats is given it's filled with the time/counts for each stage
+  TileMap generate(GenerationStats* stats = nullptr);
+
+  // Same as generate() but into the caller's map, which is resized to fit
+  // (height + 2 rows of width + 2). Regenerating at the same size into the
+  // same map doesn't allocate it again.
+  void generateInto(TileMap& tileMap, GenerationStats* stats = nullptr);
+
+  //
+  // Give generate()'s rows to the sink (empty = none) as they're finished,
+  // from the top down, before generate() returns. The last stage smooths a
+  // row at a time so each row goes out a few rows behind it: e.g. a
+  // renderer can upload the first rows while the rest are being smoothed.
+  // The map is the same either way.
+  //
+  void setRowSink(RowSink sink);
+
+  // Also build the distance to the walls of generate()'s map into the given
+  // field (nullptr = don't), with the field's metric. See WallDistance.h.
+  void setWallDistance(WallDistance* field);
+
+  // Also build a path finding graph of generate()'s map into the given
+  // graph (nullptr = don't). See PathGraph.h.
+  void setPathGraph(PathGraph* graph);
+
+  // Also keep generate()'s rooms and the tunnels joining them in the given
+  // graph (nullptr = don't). See RoomGraph.h. Generation then doesn't
+  // resume from the checkpoint after joinRooms, which would skip them.
+  void setRoomGraph(RoomGraph* graph);
+
+  // Also measure the distance to every cell of generate()'s map from
+  // CaveInfo's start cell into the given map (nullptr = don't). Its exit is
+  // the farthest cell from the start. See DistanceMap.h.
+  void setDistanceMap(DistanceMap* distances);
+
+  //
+  // Quick look at the cave's layout: the noise and the CA only, on the map
+  // halved in size level times (as far as it can be), then refined up to
+  // that size as multiresolution generation would (see GenerationParams).
+  // Rooms aren't joined or smoothed, so it's all WALL/FLOOR.
+  //
+  TileMap generatePreview(int level);
+
+  //
+  // Generate straight into a cave file (see CaveFile.h) for maps too big to
+  // hold in memory. The map is generated down the page in bands of rows as
+  // tall as fit in memoryBudget bytes (at least 16 rows), and only the
+  // bands being worked on are kept, so memory use depends on the width and
+  // the budget, not the height. The row sink, if set, gets each row as it's
+  // written. Returns false if the file couldn't be written. stats, if
+  // given, gets the total time and mPeakScratchBytes.
+  //
+  // The noise and cellular automata are the same as generate()'s, but each
+  // band is fixed up and joined to the rows above it without seeing further
+  // down (as rerollRegion does), so the rooms and tunnels differ a little.
+  // mCoarseLevels isn't supported.
+  //
+  bool generateToFile(const std::string& path, size_t memoryBudget,
+                      GenerationStats* stats = nullptr);
+
+  //
+  // Dig (FLOOR) or fill (WALL) the cells of region (cave coords) in a map
+  // this cave generated, then redo fixUp and the smoothing around them so
+  // the neighbouring slopes and corners fit. Only a window a few cells
+  // bigger than the region is looked at, so the cost doesn't depend on the
+  // size of the map. Returns the cells whose tile changed, row by row.
+  //
+  // The map isn't generated again: the surrounding cells are read back as
+  // walls/floors from their smoothed tiles (see
+  // CaveSmoother::getUnsmoothedTile).
+  //
+  std::vector<Vector2i> editCells(TileMap& tileMap, const Rect2i& region,
+                                  int tile);
+
+  //
+  // Generate region (cave coords) of a map this cave generated again with
+  // other params, e.g. another seed, leaving the rest of the map as it is.
+  // The cells round the region are held as they are through the cellular
+  // automata and fixUp, and the region's rooms are joined to each other and
+  // to the floor next to the region with tunnels dug inside it, so
+  // everything reachable before still is. Only a window a few cells bigger
+  // than the region is looked at. Returns the cells whose tile changed, row
+  // by row.
+  //
+  // The region's noise isn't what generate() would make for those cells,
+  // even with the same seed: the random fill is drawn from the params' seed
+  // over the region's cells only, and the Perlin fill (which generate()
+  // doesn't seed) is sampled where generate() samples it, moved along by
+  // the change of seed. The same map, region and params always give the
+  // same cells.
+  //
+  std::vector<Vector2i> rerollRegion(TileMap& tileMap, const Rect2i& region,
+                                     const GenerationParams& params);
 
   // Return true if the cell is empty (not a wall). This is needed
   // for when corners have been rounded e.g. DEND_W is still "floor"
@@ -49,29 +172,57 @@ class Cave {
   static Vector2i getAtlasCoords(int tile);
   static int getAtlasIndex(int tile);
 
+  // ASCII picture of a map for debugging: '#' wall, ' ' floor, 'X' tunnel
+  // being carved. rulers adds column digits and row numbers.
+  // Generation never prints anything itself (see Diagnostics.h).
+  static void dumpMap(std::ostream& out, const TileMap& tileMap,
+                      bool rulers = false);
+  static std::string mapToString(const TileMap& tileMap, bool rulers = false);
+
  private:
   void initialise(TileMap& tileMap);
-  void runCellularAutomata(TileMap& tileMap);
+  // Starting at GenerationStep firstStep
+  void runCellularAutomata(TileMap& tileMap, int firstStep);
+  // Multiresolution noise and CA, finishing at the given level (0 = full
+  // size) and writing that level's cells to tileMap
+  void runMultiresCellularAutomata(TileMap& tileMap, int stopLevel);
   void fixUp(TileMap& tileMap);
-  std::pair<Vector2iIntMap, IntVectorOfVector2iMap> findRooms(TileMap& tileMap);
-  void joinRooms(TileMap& tileMap,
-                 std::pair<Vector2iIntMap, IntVectorOfVector2iMap> floorMaps);
+  void findRooms(TileMap& tileMap);
+  void joinRooms(TileMap& tileMap);
   void smooth(TileMap& tileMap);
-
-  struct BorderWall {
-    Vector2i floor1;
-    Vector2i floor2;
-    Vector2i dir;
-    int room1;
-    int room2;
-    int thickness;
-  };
-  std::vector<BorderWall> detectBorderWalls(
-      TileMap& tileMap,
-      std::pair<Vector2iIntMap, IntVectorOfVector2iMap> floorMaps);
-  std::vector<BorderWall>
-  findMST_Kruskal(std::vector<Cave::BorderWall>& borderWalls,
-                  std::vector<int> roomIds);
+  Executor& getExecutor() const;
+  Workspace& getWorkspace();
+  void noteFingerprint(const char* stage, const TileMap& tileMap);
+  // See Workspace::mCheckpoints. resumeFromCheckpoint returns the stage
+  // restored, -1 for none.
+  int resumeFromCheckpoint(TileMap& tileMap);
+  void saveCheckpoint(int stage, const TileMap& tileMap);
+  // What fixUp changes the cell to (WALL/FLOOR), IGNORE for no change
+  static TileName getFixUpTile(const TileMap& tileMap, int cx, int cy);
+  // editCells/rerollRegion: read the cells of raw back into the edit
+  // workspace's mEditRaw unsmoothed, and smooth them into the map around
+  // touched
+  void readEditRaw(const TileMap& tileMap, const Rect2i& raw);
+  void smoothEditRaw(TileMap& tileMap, const Rect2i& raw,
+                     const Rect2i& touched, std::vector<Vector2i>& changed);
+  // rerollRegion: fixUp changing only the region's cells of mEditRaw, then
+  // join the region's rooms
+  void fixUpEditRaw(const Rect2i& raw, const Rect2i& region);
+  void joinRerolledRooms(const Rect2i& raw, const Rect2i& region,
+                         bool outsideJoined = false);
+  // generateToFile without the stats
+  bool writeBands(const std::string& path, size_t memoryBudget);
+  // generateToFile: keep the band's floor reaching its last row
+  bool keepFloorToBottom(const Rect2i& raw, const Rect2i& band);
+
+  using BorderWall = Workspace::BorderWall;
+  // Fill the workspace's mBorderWalls
+  void detectBorderWalls(TileMap& tileMap);
+  void findMST_Kruskal(std::vector<BorderWall>& borderWalls,
+                       const std::vector<int>& roomIds,
+                       std::vector<BorderWall>& mst);
+  // Fill mRoomGraph from the workspace's rooms and mMST
+  void buildRoomGraph();
 
  public:
   // NOTE: Return IGNORE if out of bounds
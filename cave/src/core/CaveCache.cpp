@@ -0,0 +1,239 @@
+#include "CaveCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Cave.h"
+#include "CaveCodec.h"
+#include "Diagnostics.h"
+#include "Fingerprint.h"
+
+namespace fs = std::filesystem;
+
+namespace Cave {
+
+namespace {
+
+//
+// File: "CAVC" inputHash(8) checksum(8) then the CaveCodec bytes.
+// Both numbers little endian.
+//
+const char MAGIC[4] = {'C', 'A', 'V', 'C'};
+const size_t HEADER_BYTES = sizeof(MAGIC) + 8 + 8;
+const char* EXTENSION = ".cavc";
+
+void putU64(std::vector<uint8_t>& out, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    out.push_back((uint8_t)(value >> (8 * i)));
+  }
+}
+
+uint64_t getU64(const uint8_t* in) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= (uint64_t)in[i] << (8 * i);
+  }
+  return value;
+}
+
+unsigned long processId() {
+#ifdef _WIN32
+  return (unsigned long)_getpid();
+#else
+  return (unsigned long)getpid();
+#endif
+}
+
+// Unique within the machine so concurrent writers, in this process or
+// another sharing the directory, don't collide
+std::string tempSuffix() {
+  static std::atomic<unsigned> counter{0};
+  char buf[80];
+  std::snprintf(buf, sizeof(buf), ".%lx.%zx.%u.tmp", processId(),
+                std::hash<std::thread::id>()(std::this_thread::get_id()),
+                counter++);
+  return buf;
+}
+
+}  // namespace
+
+CaveCache::CaveCache(const std::string& directory, uint64_t maxBytes)
+    : mDirectory(directory), mMaxBytes(maxBytes) {
+  std::error_code error;
+  fs::create_directories(mDirectory, error);
+  for (const auto& entry : fs::directory_iterator(mDirectory, error)) {
+    if (entry.path().extension() == EXTENSION) {
+      mBytes += entry.file_size(error);
+    }
+  }
+}
+
+void CaveCache::setExecutor(Executor* executor, int maxWorkers) {
+  mExecutor = executor;
+  mMaxWorkers = maxWorkers;
+}
+
+void CaveCache::setWorkspace(Workspace* workspace) { mWorkspace = workspace; }
+
+std::string CaveCache::getPath(const CaveInfo& info,
+                               const GenerationParams& params) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx",
+                (unsigned long long)hashInputs(info, params));
+  return (fs::path(mDirectory) / (std::string(name) + EXTENSION)).string();
+}
+
+bool CaveCache::generateInto(const CaveInfo& info,
+                             const GenerationParams& params,
+                             TileMap& tileMap) {
+  if (load(info, params, tileMap)) {
+    ++mStats.mHits;
+    return true;
+  }
+  ++mStats.mMisses;
+  CaveInfo caveInfo = info;
+  Cave cave(caveInfo, params);
+  cave.setExecutor(mExecutor, mMaxWorkers);
+  cave.setWorkspace(mWorkspace);
+  cave.generateInto(tileMap);
+  store(info, params, tileMap);
+  return false;
+}
+
+bool CaveCache::load(const CaveInfo& info, const GenerationParams& params,
+                     TileMap& tileMap) {
+  const std::string path = getPath(info, params);
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+  in.close();
+
+  const uint64_t inputHash = hashInputs(info, params);
+  const char* problem = nullptr;
+  if (bytes.size() < HEADER_BYTES ||
+      std::memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) != 0) {
+    problem = "not a cache file";
+  } else if (getU64(bytes.data() + 4) != inputHash) {
+    problem = "wrong inputs";
+  } else if (getU64(bytes.data() + 12) !=
+             hashBytes(bytes.data() + HEADER_BYTES,
+                       bytes.size() - HEADER_BYTES)) {
+    problem = "bad checksum";
+  } else if (!decodeCave(bytes.data() + HEADER_BYTES,
+                         bytes.size() - HEADER_BYTES, tileMap) ||
+             tileMap.size() != (size_t)info.mCaveHeight + 2 ||
+             tileMap[0].size() != (size_t)info.mCaveWidth + 2) {
+    problem = "can't decode";
+  }
+  if (problem) {
+    CAVE_LOG_WARN("CaveCache: " << path << ": " << problem
+                                << ", regenerating");
+    ++mStats.mCorrupt;
+    std::error_code error;
+    fs::remove(path, error);
+    mBytes -= std::min<uint64_t>(mBytes, bytes.size());
+    return false;
+  }
+
+  // Mark as recently used
+  std::error_code error;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+bool CaveCache::store(const CaveInfo& info, const GenerationParams& params,
+                      const TileMap& tileMap) {
+  const std::vector<uint8_t> encoded = encodeCave(tileMap);
+  std::vector<uint8_t> bytes(MAGIC, MAGIC + sizeof(MAGIC));
+  putU64(bytes, hashInputs(info, params));
+  putU64(bytes, hashBytes(encoded.data(), encoded.size()));
+  bytes.insert(bytes.end(), encoded.begin(), encoded.end());
+
+  const std::string path = getPath(info, params);
+  const std::string tmpPath = path + tempSuffix();
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    if (!out) {
+      CAVE_LOG_WARN("CaveCache: can't write " << tmpPath);
+      std::error_code error;
+      out.close();
+      fs::remove(tmpPath, error);
+      return false;
+    }
+  }
+  // Replacing an entry (e.g. a damaged one, or another process stored it
+  // first) only adds the difference
+  std::error_code error;
+  uint64_t oldBytes = fs::file_size(path, error);
+  if (error) {
+    oldBytes = 0;  // Not there
+  }
+  fs::rename(tmpPath, path, error);
+  if (error) {
+    fs::remove(tmpPath, error);
+    return false;
+  }
+  mBytes -= std::min(mBytes, oldBytes);
+  mBytes += bytes.size();
+  if (mBytes > mMaxBytes) {
+    trim();
+  }
+  return true;
+}
+
+void CaveCache::trim() {
+  struct Entry {
+    fs::path path;
+    fs::file_time_type time;
+    uint64_t bytes;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code error;
+  for (const auto& entry : fs::directory_iterator(mDirectory, error)) {
+    if (entry.path().extension() != EXTENSION) {
+      continue;
+    }
+    std::error_code entryError;
+    Entry e{entry.path(), entry.last_write_time(entryError),
+            entry.file_size(entryError)};
+    if (!entryError) {
+      total += e.bytes;
+      entries.push_back(e);
+    }
+  }
+  // Oldest first, down to 3/4 of the limit so we don't trim on every store
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.time < b.time; });
+  const uint64_t target = mMaxBytes / 4 * 3;
+  for (const auto& entry : entries) {
+    if (total <= target) {
+      break;
+    }
+    if (fs::remove(entry.path, error)) {
+      total -= entry.bytes;
+      ++mStats.mEvicted;
+    }
+  }
+  mBytes = total;
+}
+
+}  // namespace Cave
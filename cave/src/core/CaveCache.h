@@ -0,0 +1,72 @@
+#ifndef CAVE_CACHE_H
+#define CAVE_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "CaveInfo.h"
+#include "Executor.h"
+#include "GenerationParams.h"
+#include "TileTypes.h"
+#include "Workspace.h"
+
+namespace Cave {
+
+//
+// Directory of generated caves keyed by hashInputs(info, params), so
+// generating a cave that's been generated before is a file read.
+//
+// Files are the CaveCodec encoding plus a checksum. A file that can't be
+// read, fails its checksum or doesn't match the inputs is deleted and the
+// cave regenerated. When the directory grows past maxBytes the least
+// recently used files (by modification time, which a hit updates) are
+// removed.
+//
+// Several processes can share a directory: files are written under a
+// temporary name and renamed into place. Each CaveCache only tracks the
+// size of what it has seen, so the limit is approximate when shared.
+//
+class CaveCache {
+ public:
+  CaveCache(const std::string& directory, uint64_t maxBytes);
+
+  // Used when a cave has to be generated
+  void setExecutor(Executor* executor, int maxWorkers = 0);
+  void setWorkspace(Workspace* workspace);
+
+  // Returns true if the cave came from the cache
+  bool generateInto(const CaveInfo& info, const GenerationParams& params,
+                    TileMap& tileMap);
+
+  // The pieces of generateInto
+  bool load(const CaveInfo& info, const GenerationParams& params,
+            TileMap& tileMap);
+  bool store(const CaveInfo& info, const GenerationParams& params,
+             const TileMap& tileMap);
+
+  std::string getPath(const CaveInfo& info,
+                      const GenerationParams& params) const;
+
+  struct Stats {
+    int mHits = 0;
+    int mMisses = 0;
+    int mCorrupt = 0;  // Files found bad (and deleted)
+    int mEvicted = 0;
+  };
+  const Stats& getStats() const { return mStats; }
+
+ private:
+  void trim();
+
+  std::string mDirectory;
+  uint64_t mMaxBytes;
+  uint64_t mBytes = 0;  // Approximate size of the directory
+  Executor* mExecutor = nullptr;
+  int mMaxWorkers = 0;
+  Workspace* mWorkspace = nullptr;
+  Stats mStats;
+};
+
+}  // namespace Cave
+
+#endif
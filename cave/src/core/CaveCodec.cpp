@@ -0,0 +1,345 @@
+#include "CaveCodec.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "Cave.h"
+
+namespace Cave {
+
+namespace {
+
+const char MAGIC[4] = {'C', 'A', 'V', 'Z'};
+const int VERSION = 1;
+const int FOOTER_BYTES = 8;
+
+enum MaskMode { MASK_BITS = 0, MASK_RUNS = 1 };
+
+bool isMaskSet(int tile) { return !Cave::isEmpty(tile); }
+
+void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+class BufferReader {
+ public:
+  BufferReader(const uint8_t* begin, const uint8_t* end)
+      : mPos(begin), mEnd(end) {}
+  int byte() { return (mPos < mEnd) ? *mPos++ : -1; }
+  const uint8_t* position() const { return mPos; }
+
+ private:
+  const uint8_t* mPos;
+  const uint8_t* mEnd;
+};
+
+class StreamReader {
+ public:
+  explicit StreamReader(std::istream& in) : mIn(in) {}
+  int byte() {
+    int c = mIn.get();
+    return (c == std::char_traits<char>::eof()) ? -1 : c;
+  }
+
+ private:
+  std::istream& mIn;
+};
+
+template <typename Reader>
+bool readVarint(Reader& in, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int b = in.byte();
+    if (b < 0) {
+      return false;
+    }
+    value |= (uint64_t)(b & 0x7F) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Dimensions are sanity checked so corrupt data can't ask for a huge map
+const uint64_t MAX_DIMENSION = 1 << 20;
+
+template <typename Reader>
+bool readHeader(Reader& in, int& width, int& height, int& chunkRows) {
+  for (char c : MAGIC) {
+    if (in.byte() != (uint8_t)c) {
+      return false;
+    }
+  }
+  if (in.byte() != VERSION) {
+    return false;
+  }
+  uint64_t w, h, rows;
+  if (!readVarint(in, w) || !readVarint(in, h) || !readVarint(in, rows) ||
+      w == 0 || h == 0 || rows == 0 || w > MAX_DIMENSION ||
+      h > MAX_DIMENSION || rows > MAX_DIMENSION) {
+    return false;
+  }
+  width = (int)w;
+  height = (int)h;
+  chunkRows = (int)rows;
+  return true;
+}
+
+void encodeRow(const int* tiles, int width, std::vector<uint8_t>& out,
+               std::vector<uint8_t>& runs) {
+  //
+  // Mask as run lengths, alternating clear/set starting with clear
+  //
+  runs.clear();
+  bool bit = false;
+  int runStart = 0;
+  for (int x = 0; x < width; ++x) {
+    if (isMaskSet(tiles[x]) != bit) {
+      writeVarint(runs, x - runStart);
+      runStart = x;
+      bit = !bit;
+    }
+  }
+  writeVarint(runs, width - runStart);
+
+  const size_t maskBytes = ((size_t)width + 7) / 8;
+  if (runs.size() < maskBytes) {
+    out.push_back(MASK_RUNS);
+    out.insert(out.end(), runs.begin(), runs.end());
+  } else {
+    out.push_back(MASK_BITS);
+    for (size_t b = 0; b < maskBytes; ++b) {
+      uint8_t byte = 0;
+      for (int i = 0; i < 8; ++i) {
+        size_t x = b * 8 + i;
+        if (x < (size_t)width && isMaskSet(tiles[x])) {
+          byte |= (uint8_t)(1 << i);
+        }
+      }
+      out.push_back(byte);
+    }
+  }
+
+  //
+  // Tiles that aren't what the mask implies
+  //
+  int count = 0;
+  for (int x = 0; x < width; ++x) {
+    int base = isMaskSet(tiles[x]) ? WALL : FLOOR;
+    count += (tiles[x] != base);
+  }
+  writeVarint(out, count);
+  int lastX = -1;
+  for (int x = 0; x < width; ++x) {
+    int base = isMaskSet(tiles[x]) ? WALL : FLOOR;
+    if (tiles[x] != base) {
+      writeVarint(out, x - lastX - 1);
+      writeVarint(out, (uint32_t)tiles[x]);
+      lastX = x;
+    }
+  }
+}
+
+template <typename Reader>
+bool decodeRow(Reader& in, int width, int* tiles) {
+  int mode = in.byte();
+  if (mode == MASK_BITS) {
+    const int maskBytes = (width + 7) / 8;
+    for (int b = 0; b < maskBytes; ++b) {
+      int byte = in.byte();
+      if (byte < 0) {
+        return false;
+      }
+      const int end = std::min(width, b * 8 + 8);
+      for (int x = b * 8; x < end; ++x) {
+        tiles[x] = (byte & (1 << (x & 7))) ? WALL : FLOOR;
+      }
+    }
+  } else if (mode == MASK_RUNS) {
+    int x = 0;
+    bool bit = false;
+    while (x < width) {
+      uint64_t run;
+      if (!readVarint(in, run) || run > (uint64_t)(width - x)) {
+        return false;
+      }
+      std::fill(tiles + x, tiles + x + run, bit ? WALL : FLOOR);
+      x += (int)run;
+      bit = !bit;
+    }
+  } else {
+    return false;
+  }
+
+  uint64_t count;
+  if (!readVarint(in, count) || count > (uint64_t)width) {
+    return false;
+  }
+  int64_t x = -1;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t gap, tile;
+    if (!readVarint(in, gap) || !readVarint(in, tile) ||
+        gap >= (uint64_t)width || tile > IGNORE) {
+      return false;
+    }
+    x += (int64_t)gap + 1;
+    if (x >= width) {
+      return false;
+    }
+    tiles[x] = (int)tile;
+  }
+  return true;
+}
+
+}  // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+
+CaveStreamEncoder::CaveStreamEncoder(std::ostream& out, int width, int height,
+                                     int chunkRows)
+    : mOut(out),
+      mWidth(width),
+      mHeight(height),
+      mChunkRows(std::max(1, chunkRows)) {
+  mBuffer.assign(MAGIC, MAGIC + sizeof(MAGIC));
+  mBuffer.push_back(VERSION);
+  writeVarint(mBuffer, mWidth);
+  writeVarint(mBuffer, mHeight);
+  writeVarint(mBuffer, mChunkRows);
+  mOut.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+  mBytes = mBuffer.size();
+  mFirstRow = mBytes;
+}
+
+void CaveStreamEncoder::addRow(const int* tiles) {
+  if (mRows % mChunkRows == 0) {
+    mChunkOffsets.push_back(mBytes - mFirstRow);
+  }
+  mBuffer.clear();
+  encodeRow(tiles, mWidth, mBuffer, mScratch);
+  mOut.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+  mBytes += mBuffer.size();
+  ++mRows;
+}
+
+bool CaveStreamEncoder::finish() {
+  const uint64_t indexOffset = mBytes;
+  mBuffer.clear();
+  writeVarint(mBuffer, mChunkOffsets.size());
+  for (uint64_t offset : mChunkOffsets) {
+    writeVarint(mBuffer, offset);
+  }
+  for (int i = 0; i < FOOTER_BYTES; ++i) {
+    mBuffer.push_back((uint8_t)(indexOffset >> (8 * i)));
+  }
+  mOut.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+  mBytes += mBuffer.size();
+  return mOut.good() && (mRows == mHeight);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CaveStreamDecoder::CaveStreamDecoder(std::istream& in) : mIn(in) {
+  StreamReader reader(mIn);
+  mValid = readHeader(reader, mWidth, mHeight, mChunkRows);
+}
+
+bool CaveStreamDecoder::readRow(int* tiles) {
+  if (!mValid || mRow >= mHeight) {
+    return false;
+  }
+  StreamReader reader(mIn);
+  if (!decodeRow(reader, mWidth, tiles)) {
+    mValid = false;
+    return false;
+  }
+  ++mRow;
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+std::vector<uint8_t> encodeCave(const TileMap& tileMap, int chunkRows) {
+  std::ostringstream out(std::ios::binary);
+  const int width = tileMap.empty() ? 0 : (int)tileMap[0].size();
+  CaveStreamEncoder encoder(out, width, (int)tileMap.size(), chunkRows);
+  for (const auto& row : tileMap) {
+    encoder.addRow(row.data());
+  }
+  encoder.finish();
+  const std::string bytes = out.str();
+  return std::vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+bool decodeCave(const uint8_t* data, size_t size, TileMap& tileMap) {
+  BufferReader in(data, data + size);
+  int width, height, chunkRows;
+  // Every row takes at least 2 bytes
+  if (!readHeader(in, width, height, chunkRows) ||
+      (uint64_t)height * 2 > size) {
+    return false;
+  }
+  tileMap.resize(height);
+  for (auto& row : tileMap) {
+    row.resize(width);
+    if (!decodeRow(in, width, row.data())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool decodeCaveRegion(const uint8_t* data, size_t size, int x, int y, int w,
+                      int h, TileMap& tileMap) {
+  BufferReader in(data, data + size);
+  int width, height, chunkRows;
+  if (size < FOOTER_BYTES || !readHeader(in, width, height, chunkRows) ||
+      x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > width ||
+      y + h > height) {
+    return false;
+  }
+  const uint8_t* firstRow = in.position();
+
+  // Find the chunk containing row y from the index
+  uint64_t indexOffset = 0;
+  for (int i = 0; i < FOOTER_BYTES; ++i) {
+    indexOffset |= (uint64_t)data[size - FOOTER_BYTES + i] << (8 * i);
+  }
+  if (indexOffset > size - FOOTER_BYTES) {
+    return false;
+  }
+  BufferReader index(data + indexOffset, data + size - FOOTER_BYTES);
+  const int chunk = y / chunkRows;
+  uint64_t numChunks, chunkOffset = 0;
+  if (!readVarint(index, numChunks) || (uint64_t)chunk >= numChunks) {
+    return false;
+  }
+  for (int c = 0; c <= chunk; ++c) {
+    if (!readVarint(index, chunkOffset)) {
+      return false;
+    }
+  }
+  if (chunkOffset > (uint64_t)(data + size - firstRow)) {
+    return false;
+  }
+
+  BufferReader rows(firstRow + chunkOffset, data + size);
+  std::vector<int> row(width);
+  tileMap.resize(h);
+  for (int ry = chunk * chunkRows; ry < y + h; ++ry) {
+    if (!decodeRow(rows, width, row.data())) {
+      return false;
+    }
+    if (ry >= y) {
+      tileMap[ry - y].assign(row.begin() + x, row.begin() + x + w);
+    }
+  }
+  return true;
+}
+
+}  // namespace Cave
@@ -0,0 +1,92 @@
+#ifndef CAVE_CODEC_H
+#define CAVE_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// Compact encoding of a TileMap for sending or storing lots of caves.
+//
+// Each row is coded on its own as
+// - a wall mask (1 bit per tile, set for WALL and the other non-empty
+//   tiles) stored either as raw bits or as run lengths, whichever is shorter
+// - the "exception" tiles that are neither WALL nor FLOOR (the smoothed
+//   slopes, corners etc.) as (gap, tile) varint pairs
+// so a row of a typical cave takes a few bytes.
+//
+// Layout:
+//   "CAVZ" version(1)  varint width, height, chunkRows
+//   rows
+//   varint numChunks, varint offset of each chunk's first row (from the
+//     first row), for decoding a region without the rows before it
+//   8 byte little endian offset of the chunk index (from the start)
+//
+// Width/height are the TileMap's (i.e. including the border).
+//
+class CaveStreamEncoder {
+ public:
+  CaveStreamEncoder(std::ostream& out, int width, int height,
+                    int chunkRows = 64);
+
+  // Rows must be added in order, each width tiles
+  void addRow(const int* tiles);
+  // Write the chunk index. Returns false if the stream failed or the wrong
+  // number of rows were added.
+  bool finish();
+
+ private:
+  std::ostream& mOut;
+  int mWidth;
+  int mHeight;
+  int mChunkRows;
+  int mRows = 0;
+  uint64_t mBytes = 0;  // Written so far
+  uint64_t mFirstRow = 0;
+  std::vector<uint64_t> mChunkOffsets;
+  std::vector<uint8_t> mBuffer;
+  std::vector<uint8_t> mScratch;
+};
+
+class CaveStreamDecoder {
+ public:
+  explicit CaveStreamDecoder(std::istream& in);
+
+  // False if the header wasn't valid
+  bool isValid() const { return mValid; }
+  int getWidth() const { return mWidth; }
+  int getHeight() const { return mHeight; }
+
+  // Decode the next row into width tiles. Returns false at the end or if
+  // the data is corrupt.
+  bool readRow(int* tiles);
+
+ private:
+  std::istream& mIn;
+  bool mValid = false;
+  int mWidth = 0;
+  int mHeight = 0;
+  int mChunkRows = 0;
+  int mRow = 0;
+};
+
+// Whole map helpers
+std::vector<uint8_t> encodeCave(const TileMap& tileMap, int chunkRows = 64);
+bool decodeCave(const uint8_t* data, size_t size, TileMap& tileMap);
+
+//
+// Decode just the w x h region at x,y (TileMap coords) into tileMap (resized
+// to h rows of w). Only the chunks covering the region are read.
+//
+bool decodeCaveRegion(const uint8_t* data, size_t size, int x, int y, int w,
+                      int h, TileMap& tileMap);
+
+}  // namespace Cave
+
+#endif
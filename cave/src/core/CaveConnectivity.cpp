@@ -0,0 +1,295 @@
+#include "CaveConnectivity.h"
+
+#include <algorithm>
+
+#include "Cave.h"
+#include "Diagnostics.h"
+
+namespace Cave {
+
+namespace {
+
+const Vector2i DIRS[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+}  // namespace
+
+void CaveConnectivity::build(const TileMap& tileMap) {
+  // The map has a one cell border all round
+  mHeight = std::max(0, (int)tileMap.size() - 2);
+  mWidth = mHeight > 0 ? std::max(0, (int)tileMap[0].size() - 2) : 0;
+  mLabels.assign((size_t)mWidth * mHeight, -1);
+  mRegionSizes.clear();
+  mFreeRegions.clear();
+  mNumRegions = 0;
+  mVisitStamp.assign(mLabels.size(), 0);
+  mVisitSearch.assign(mLabels.size(), 0);
+  mVisitEpoch = 0;
+
+  for (int cy = 0; cy < mHeight; ++cy) {
+    for (int cx = 0; cx < mWidth; ++cx) {
+      if (Cave::isEmpty(tileMap, cx, cy)) {
+        mLabels[index(cx, cy)] = -2;  // Floor, not labelled yet
+      }
+    }
+  }
+  for (int cy = 0; cy < mHeight; ++cy) {
+    for (int cx = 0; cx < mWidth; ++cx) {
+      if (mLabels[index(cx, cy)] == -2) {
+        const int region = newRegion();
+        mRegionSizes[region] = relabel(cx, cy, -2, region);
+      }
+    }
+  }
+  CAVE_LOG_DEBUG("CaveConnectivity: " << mNumRegions << " regions");
+}
+
+int CaveConnectivity::newRegion() {
+  ++mNumRegions;
+  if (!mFreeRegions.empty()) {
+    const int region = mFreeRegions.back();
+    mFreeRegions.pop_back();
+    return region;
+  }
+  mRegionSizes.push_back(0);
+  return (int)mRegionSizes.size() - 1;
+}
+
+void CaveConnectivity::freeRegion(int region) {
+  --mNumRegions;
+  mRegionSizes[region] = 0;
+  mFreeRegions.push_back(region);
+}
+
+int CaveConnectivity::relabel(int cx, int cy, int from, int to) {
+  mQueue.clear();
+  mQueue.push_back({cx, cy});
+  mLabels[index(cx, cy)] = to;
+  for (size_t next = 0; next < mQueue.size(); ++next) {
+    const Vector2i cell = mQueue[next];
+    for (const Vector2i& dir : DIRS) {
+      const int nx = cell.x + dir.x;
+      const int ny = cell.y + dir.y;
+      if (getRegion(nx, ny) == from) {
+        mLabels[index(nx, ny)] = to;
+        mQueue.push_back({nx, ny});
+      }
+    }
+  }
+  return (int)mQueue.size();
+}
+
+bool CaveConnectivity::addFloor(int cx, int cy) {
+  if (cx < 0 || cy < 0 || cx >= mWidth || cy >= mHeight || isFloor(cx, cy)) {
+    return false;
+  }
+
+  // The different regions round the cell, and a cell in each
+  int regions[4];
+  Vector2i starts[4];
+  int numRegions = 0;
+  int largest = -1;
+  for (const Vector2i& dir : DIRS) {
+    const int region = getRegion(cx + dir.x, cy + dir.y);
+    if (region < 0 ||
+        std::find(regions, regions + numRegions, region) !=
+            regions + numRegions) {
+      continue;
+    }
+    if (largest < 0 || mRegionSizes[region] > mRegionSizes[largest]) {
+      largest = region;
+    }
+    regions[numRegions] = region;
+    starts[numRegions++] = {cx + dir.x, cy + dir.y};
+  }
+
+  if (numRegions == 0) {
+    const int region = newRegion();
+    mLabels[index(cx, cy)] = region;
+    mRegionSizes[region] = 1;
+    return false;
+  }
+
+  // Everything joins the largest
+  for (int i = 0; i < numRegions; ++i) {
+    if (regions[i] != largest) {
+      mRegionSizes[largest] +=
+          relabel(starts[i].x, starts[i].y, regions[i], largest);
+      freeRegion(regions[i]);
+    }
+  }
+  mLabels[index(cx, cy)] = largest;
+  ++mRegionSizes[largest];
+  return numRegions > 1;
+}
+
+bool CaveConnectivity::addWall(int cx, int cy) {
+  if (!isFloor(cx, cy)) {
+    return false;
+  }
+  const int region = mLabels[index(cx, cy)];
+  mLabels[index(cx, cy)] = -1;
+  if (--mRegionSizes[region] == 0) {
+    freeRegion(region);
+    return false;
+  }
+
+  if (++mVisitEpoch == 0) {
+    std::fill(mVisitStamp.begin(), mVisitStamp.end(), 0);
+    mVisitEpoch = 1;
+  }
+
+  // A search from each neighbour. Searches that meet join the same group.
+  int numSearches = 0;
+  for (const Vector2i& dir : DIRS) {
+    const int nx = cx + dir.x;
+    const int ny = cy + dir.y;
+    if (getRegion(nx, ny) != region) {
+      continue;
+    }
+    Search& search = mSearches[numSearches];
+    search.cells.clear();
+    search.cells.push_back({nx, ny});
+    search.next = 0;
+    search.group = numSearches;
+    mVisitStamp[index(nx, ny)] = mVisitEpoch;
+    mVisitSearch[index(nx, ny)] = (uint8_t)numSearches;
+    ++numSearches;
+  }
+  if (numSearches < 2) {
+    return false;
+  }
+
+  // Take one step of a search in the group that hasn't run out, false if
+  // they all have
+  auto step = [&](int group) {
+    for (int s = 0; s < numSearches; ++s) {
+      Search& search = mSearches[s];
+      if (search.group != group || search.next == search.cells.size()) {
+        continue;
+      }
+      const Vector2i cell = search.cells[search.next++];
+      for (const Vector2i& dir : DIRS) {
+        const int nx = cell.x + dir.x;
+        const int ny = cell.y + dir.y;
+        if (getRegion(nx, ny) != region) {
+          continue;
+        }
+        const size_t i = index(nx, ny);
+        if (mVisitStamp[i] != mVisitEpoch) {
+          mVisitStamp[i] = mVisitEpoch;
+          mVisitSearch[i] = (uint8_t)s;
+          search.cells.push_back({nx, ny});
+          continue;
+        }
+        const int other = mSearches[mVisitSearch[i]].group;
+        if (other != group) {
+          for (int t = 0; t < numSearches; ++t) {
+            if (mSearches[t].group == other) {
+              mSearches[t].group = group;
+            }
+          }
+        }
+      }
+      return true;
+    }
+    return false;
+  };
+
+  auto isGroup = [&](int group) {
+    for (int s = 0; s < numSearches; ++s) {
+      if (mSearches[s].group == group) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  auto groupSize = [&](int group) {
+    size_t size = 0;
+    for (int s = 0; s < numSearches; ++s) {
+      if (mSearches[s].group == group) {
+        size += mSearches[s].cells.size();
+      }
+    }
+    return size;
+  };
+
+  // Search until every group but one has run out. Those are cut off.
+  bool exhausted[4] = {};
+  int keep = -1;
+  while (true) {
+    int numGroups = 0;
+    int numOpen = 0;
+    int open = -1;
+    for (int g = 0; g < numSearches; ++g) {
+      if (!isGroup(g)) {
+        continue;
+      }
+      ++numGroups;
+      if (!exhausted[g]) {
+        ++numOpen;
+        open = g;
+      }
+    }
+    if (numGroups == 1) {
+      return false;
+    }
+    if (numOpen <= 1) {
+      keep = open;
+      break;
+    }
+    for (int g = 0; g < numSearches; ++g) {
+      if (!exhausted[g] && !step(g)) {
+        exhausted[g] = true;
+      }
+    }
+  }
+
+  // If they all ran out, keep the largest piece's labels
+  if (keep < 0) {
+    for (int g = 0; g < numSearches; ++g) {
+      if (isGroup(g) && (keep < 0 || groupSize(g) > groupSize(keep))) {
+        keep = g;
+      }
+    }
+  }
+
+  for (int g = 0; g < numSearches; ++g) {
+    if (!isGroup(g) || g == keep) {
+      continue;
+    }
+    const int piece = newRegion();
+    for (int s = 0; s < numSearches; ++s) {
+      if (mSearches[s].group != g) {
+        continue;
+      }
+      for (const Vector2i& cell : mSearches[s].cells) {
+        mLabels[index(cell.x, cell.y)] = piece;
+      }
+      mRegionSizes[piece] += (int)mSearches[s].cells.size();
+      mRegionSizes[region] -= (int)mSearches[s].cells.size();
+    }
+  }
+  CAVE_LOG_TRACE("CaveConnectivity: region " << region << " cut at " << cx
+                                             << "," << cy);
+  return true;
+}
+
+bool CaveConnectivity::update(const TileMap& tileMap,
+                              const std::vector<Vector2i>& cells) {
+  // Dig first so fills are less likely to look like cuts on the way
+  bool cut = false;
+  for (const Vector2i& cell : cells) {
+    if (Cave::isEmpty(tileMap, cell.x, cell.y)) {
+      addFloor(cell.x, cell.y);
+    }
+  }
+  for (const Vector2i& cell : cells) {
+    if (!Cave::isEmpty(tileMap, cell.x, cell.y)) {
+      cut |= addWall(cell.x, cell.y);
+    }
+  }
+  return cut;
+}
+
+}  // namespace Cave
@@ -0,0 +1,97 @@
+#ifndef CAVE_CONNECTIVITY_H
+#define CAVE_CONNECTIVITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CaveInfo.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// Which floor cells of a map are connected (through their 4 neighbours),
+// kept up to date as cells are dug or filled so reachability checks don't
+// need the whole map searched again.
+//
+// Floor is anything Cave::isEmpty. Every floor cell has a region ID and
+// cells are connected if and only if their IDs are the same, so
+// sameRegion is a lookup. IDs of regions that disappear are reused.
+//
+// Digging a cell joins the regions around it by relabelling all but the
+// largest, so it costs the size of the smaller regions. Filling a cell
+// searches out from its neighbours at the same time, one step each in
+// turn, until all but one search has run out (the region was cut and those
+// are the new pieces) or they've all met (it wasn't). That costs about the
+// size of the smaller pieces, or the distance round the filled cell.
+//
+class CaveConnectivity {
+ public:
+  CaveConnectivity() = default;
+  explicit CaveConnectivity(const TileMap& tileMap) { build(tileMap); }
+
+  void build(const TileMap& tileMap);
+
+  // Cave coords
+  int getWidth() const { return mWidth; }
+  int getHeight() const { return mHeight; }
+  bool isFloor(int cx, int cy) const { return getRegion(cx, cy) >= 0; }
+  // -1 for walls and cells outside the map
+  int getRegion(int cx, int cy) const {
+    return (cx >= 0 && cy >= 0 && cx < mWidth && cy < mHeight)
+               ? mLabels[(size_t)cy * mWidth + cx]
+               : -1;
+  }
+  bool sameRegion(Vector2i a, Vector2i b) const {
+    const int region = getRegion(a.x, a.y);
+    return region >= 0 && region == getRegion(b.x, b.y);
+  }
+  // getRegion of every cell, row major (e.g. room labels for saveCaveFile)
+  const std::vector<int>& getLabels() const { return mLabels; }
+  int getRegionSize(int region) const { return mRegionSizes[region]; }
+  int numRegions() const { return mNumRegions; }
+
+  // Make the cell floor. Returns true if it joined regions together.
+  bool addFloor(int cx, int cy);
+  // Make the cell wall. Returns true if that cut its region in two (or
+  // more).
+  bool addWall(int cx, int cy);
+
+  //
+  // Bring the given cells up to date with the map, e.g. the cells
+  // Cave::editCells reports as changed. Returns true if a region was cut.
+  //
+  bool update(const TileMap& tileMap, const std::vector<Vector2i>& cells);
+
+ private:
+  size_t index(int cx, int cy) const { return (size_t)cy * mWidth + cx; }
+  int newRegion();
+  void freeRegion(int region);
+  // Set every cell connected to the start cell with label from to to.
+  // Returns how many.
+  int relabel(int cx, int cy, int from, int to);
+
+  int mWidth = 0;
+  int mHeight = 0;
+  std::vector<int> mLabels;
+  std::vector<int> mRegionSizes;  // 0 for unused IDs
+  std::vector<int> mFreeRegions;
+  int mNumRegions = 0;
+
+  // Scratch for the searches
+  std::vector<Vector2i> mQueue;
+  struct Search {
+    std::vector<Vector2i> cells;  // Visited, in order (the queue is the tail)
+    size_t next = 0;
+    int group = 0;
+  };
+  Search mSearches[4];
+  std::vector<uint32_t> mVisitStamp;  // mVisitEpoch when visited this time
+  std::vector<uint8_t> mVisitSearch;  // By which search
+  uint32_t mVisitEpoch = 0;
+};
+
+}  // namespace Cave
+
+#endif
@@ -0,0 +1,221 @@
+#include "CaveDelta.h"
+
+#include <algorithm>
+
+#include "Cave.h"
+
+namespace Cave {
+
+namespace {
+
+const int VERSION = 1;
+
+// Row then column
+bool cellLess(const CaveDelta::Change& a, const CaveDelta::Change& b) {
+  return (a.y != b.y) ? (a.y < b.y) : (a.x < b.x);
+}
+
+void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+bool readVarint(const uint8_t*& pos, const uint8_t* end, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+    const uint8_t b = *pos++;
+    value |= (uint64_t)(b & 0x7F) << shift;
+    if ((b & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Coordinates are sanity checked so corrupt data can't ask for huge values
+const uint64_t MAX_COORD = 1 << 24;
+
+}  // namespace
+
+void CaveDelta::set(int x, int y, int tile) {
+  const Change change{x, y, tile};
+  auto it = std::lower_bound(mChanges.begin(), mChanges.end(), change,
+                             cellLess);
+  if (it != mChanges.end() && it->x == x && it->y == y) {
+    it->tile = tile;
+  } else {
+    mChanges.insert(it, change);
+  }
+}
+
+void CaveDelta::record(const TileMap& tileMap,
+                       const std::vector<Vector2i>& cells) {
+  for (const Vector2i& cell : cells) {
+    set(cell.x, cell.y, Cave::getTile(tileMap, cell.x, cell.y));
+  }
+}
+
+void CaveDelta::diff(const TileMap& before, const TileMap& after) {
+  const int height = std::min((int)before.size(), (int)after.size()) - 2;
+  for (int y = 0; y < height; ++y) {
+    const auto& oldRow = before[y + 1];
+    const auto& newRow = after[y + 1];
+    const int width = std::min((int)oldRow.size(), (int)newRow.size()) - 2;
+    for (int x = 0; x < width; ++x) {
+      if (oldRow[x + 1] != newRow[x + 1]) {
+        set(x, y, newRow[x + 1]);
+      }
+    }
+  }
+}
+
+bool CaveDelta::apply(TileMap& tileMap) const {
+  bool allApplied = true;
+  for (const Change& change : mChanges) {
+    // Inside the border
+    const Vector2i pos = Cave::getMapPos(change.x, change.y);
+    if (pos.x < 1 || pos.y < 1 || pos.y >= (int)tileMap.size() - 1 ||
+        pos.x >= (int)tileMap[pos.y].size() - 1) {
+      allApplied = false;
+      continue;
+    }
+    tileMap[pos.y][pos.x] = change.tile;
+  }
+  return allApplied;
+}
+
+bool CaveDelta::merge(const CaveDelta& later) {
+  if (later.mBaseHash != mBaseHash) {
+    return false;
+  }
+  // Both sorted, so a merge where equal cells take the later tile
+  std::vector<Change> merged;
+  merged.reserve(mChanges.size() + later.mChanges.size());
+  auto a = mChanges.begin();
+  auto b = later.mChanges.begin();
+  while (a != mChanges.end() || b != later.mChanges.end()) {
+    if (b == later.mChanges.end() ||
+        (a != mChanges.end() && cellLess(*a, *b))) {
+      merged.push_back(*a++);
+    } else {
+      if (a != mChanges.end() && !cellLess(*b, *a)) {
+        ++a;  // Same cell
+      }
+      merged.push_back(*b++);
+    }
+  }
+  mChanges.swap(merged);
+  mGeneration = std::max(mGeneration, later.mGeneration);
+  return true;
+}
+
+std::vector<uint8_t> CaveDelta::encode() const {
+  std::vector<uint8_t> out;
+  encode(out);
+  return out;
+}
+
+void CaveDelta::encode(std::vector<uint8_t>& out) const {
+  out.push_back(VERSION);
+  for (int i = 0; i < 8; ++i) {
+    out.push_back((uint8_t)(mBaseHash >> (8 * i)));
+  }
+  writeVarint(out, mGeneration);
+
+  // Count the runs first so a receiver knows how many to expect
+  size_t numRuns = 0;
+  for (size_t i = 0; i < mChanges.size(); ++i) {
+    numRuns += (i == 0 || mChanges[i].y != mChanges[i - 1].y ||
+                mChanges[i].x != mChanges[i - 1].x + 1);
+  }
+  writeVarint(out, numRuns);
+
+  int lastY = 0, lastEnd = 0;
+  size_t i = 0;
+  while (i < mChanges.size()) {
+    size_t end = i + 1;
+    while (end < mChanges.size() && mChanges[end].y == mChanges[i].y &&
+           mChanges[end].x == mChanges[end - 1].x + 1) {
+      ++end;
+    }
+    const Change& first = mChanges[i];
+    writeVarint(out, (uint64_t)(first.y - lastY));
+    writeVarint(out, (uint64_t)(first.x - ((first.y == lastY) ? lastEnd : 0)));
+    writeVarint(out, end - i - 1);
+    for (size_t c = i; c < end; ++c) {
+      writeVarint(out, (uint32_t)mChanges[c].tile);
+    }
+    lastY = first.y;
+    lastEnd = mChanges[end - 1].x + 1;
+    i = end;
+  }
+}
+
+bool CaveDelta::decode(const uint8_t* data, size_t size) {
+  mChanges.clear();
+  const uint8_t* pos = data;
+  const uint8_t* end = data + size;
+  if (size < 9 || *pos++ != VERSION) {
+    return false;
+  }
+  uint64_t baseHash = 0;
+  for (int i = 0; i < 8; ++i) {
+    baseHash |= (uint64_t)*pos++ << (8 * i);
+  }
+  uint64_t generation, numRuns;
+  if (!readVarint(pos, end, generation) || !readVarint(pos, end, numRuns) ||
+      generation > UINT32_MAX || numRuns > size) {
+    return false;
+  }
+
+  uint64_t y = 0, x = 0;
+  for (uint64_t run = 0; run < numRuns; ++run) {
+    uint64_t dy, dx, length;
+    if (!readVarint(pos, end, dy) || !readVarint(pos, end, dx) ||
+        !readVarint(pos, end, length)) {
+      mChanges.clear();
+      return false;
+    }
+    // Checked before adding so they can't wrap round
+    if (dy >= MAX_COORD || dx >= MAX_COORD || length >= MAX_COORD) {
+      mChanges.clear();
+      return false;
+    }
+    // Runs must be in order and not touch, as encode() writes them
+    if (dy > 0) {
+      x = 0;
+    } else if (run > 0 && dx == 0) {
+      mChanges.clear();
+      return false;
+    }
+    y += dy;
+    x += dx;
+    ++length;
+    if (y >= MAX_COORD || x + length > MAX_COORD ||
+        length > (uint64_t)(end - pos)) {
+      mChanges.clear();
+      return false;
+    }
+    for (uint64_t i = 0; i < length; ++i) {
+      uint64_t tile;
+      if (!readVarint(pos, end, tile) || tile > IGNORE) {
+        mChanges.clear();
+        return false;
+      }
+      mChanges.push_back({(int)(x + i), (int)y, (int)tile});
+    }
+    x += length;
+  }
+  if (pos != end) {
+    mChanges.clear();
+    return false;
+  }
+  mBaseHash = baseHash;
+  mGeneration = (uint32_t)generation;
+  return true;
+}
+
+}  // namespace Cave
@@ -0,0 +1,86 @@
+#ifndef CAVE_DELTA_H
+#define CAVE_DELTA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CaveInfo.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// Changes made to a generated cave, for keeping copies of it in sync
+// without resending the map.
+//
+// A delta belongs to a base cave, identified by hashInputs(info, params),
+// and carries a generation counter the sender bumps for each edit so
+// receivers can order deltas and drop stale ones. It holds the new tile for
+// every changed cell, which should include the neighbours that were
+// re-smoothed, so applying a delta needs no smoothing on the receiver.
+//
+// Cells are in cave coords (as Cave::setCell, so the border can't be
+// changed) and kept sorted by row then column. A later change to the same
+// cell replaces the earlier one.
+//
+// Encoded (little endian, no magic so it's cheap to send often):
+//   version(1)  baseHash(8)  varint generation  varint numRuns
+//   per run of cells next to each other in a row:
+//     varint rows since the previous run
+//     varint x (from the end of the previous run when on the same row)
+//     varint length - 1, then length varint tiles
+// so the size of a delta is proportional to the edit, not the map.
+//
+class CaveDelta {
+ public:
+  struct Change {
+    int x;
+    int y;
+    int tile;
+  };
+
+  CaveDelta() = default;
+  CaveDelta(uint64_t baseHash, uint32_t generation)
+      : mBaseHash(baseHash), mGeneration(generation) {}
+
+  uint64_t getBaseHash() const { return mBaseHash; }
+  uint32_t getGeneration() const { return mGeneration; }
+  void setGeneration(uint32_t generation) { mGeneration = generation; }
+
+  bool empty() const { return mChanges.empty(); }
+  size_t size() const { return mChanges.size(); }
+  const std::vector<Change>& getChanges() const { return mChanges; }
+  void clear() { mChanges.clear(); }
+
+  void set(int x, int y, int tile);
+  // Record the current tile of each cell, e.g. the cells an edit changed
+  void record(const TileMap& tileMap, const std::vector<Vector2i>& cells);
+  // Record every cell that differs (maps the same size)
+  void diff(const TileMap& before, const TileMap& after);
+
+  // Set the tiles in tileMap. Cells outside the map are skipped and make it
+  // return false.
+  bool apply(TileMap& tileMap) const;
+
+  //
+  // Fold in a delta made after this one (later changes win, the generation
+  // becomes the larger of the two). Returns false, leaving this delta
+  // unchanged, if the bases differ.
+  //
+  bool merge(const CaveDelta& later);
+
+  std::vector<uint8_t> encode() const;
+  void encode(std::vector<uint8_t>& out) const;
+  // Returns false (and leaves the delta empty) if data isn't a valid delta
+  bool decode(const uint8_t* data, size_t size);
+
+ private:
+  uint64_t mBaseHash = 0;
+  uint32_t mGeneration = 0;
+  std::vector<Change> mChanges;
+};
+
+}  // namespace Cave
+
+#endif
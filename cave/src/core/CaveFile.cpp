@@ -0,0 +1,379 @@
+#include "CaveFile.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Diagnostics.h"
+#include "Fingerprint.h"
+
+namespace Cave {
+
+namespace {
+
+const char MAGIC[8] = {'C', 'A', 'V', 'E', 'F', 'I', 'L', 'E'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+static_assert(sizeof(CaveFileHeader) == 128, "CaveFileHeader layout changed");
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+//
+// Map the whole file read-only. The file/mapping handles aren't needed once
+// the view exists.
+//
+const unsigned char* mapFile(const std::string& path, size_t& size) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping) {
+    return nullptr;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view) {
+    return nullptr;
+  }
+  size = (size_t)fileSize.QuadPart;
+  return static_cast<const unsigned char*>(view);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return nullptr;
+  }
+  void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    return nullptr;
+  }
+  size = (size_t)st.st_size;
+  return static_cast<const unsigned char*>(view);
+#endif
+}
+
+void unmapFile(const unsigned char* data, size_t size) {
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap(const_cast<unsigned char*>(data), size);
+#endif
+}
+
+// Everything in the header but the layout and the checksum
+void fillHeader(CaveFileHeader& header, const CaveInfo& info,
+                const GenerationParams& params) {
+  std::memcpy(header.mMagic, MAGIC, sizeof(MAGIC));
+  header.mVersion = CaveFileHeader::VERSION;
+  header.mHeaderBytes = sizeof(CaveFileHeader);
+  header.mByteOrder = BYTE_ORDER_MARK;
+  header.mCaveWidth = info.mCaveWidth;
+  header.mCaveHeight = info.mCaveHeight;
+  header.mBorderWidth = info.mBorderWidth;
+  header.mBorderHeight = info.mBorderHeight;
+  header.mCellWidth = info.mCellWidth;
+  header.mCellHeight = info.mCellHeight;
+  header.mStartCellX = info.mStartCellX;
+  header.mStartCellY = info.mStartCellY;
+  header.mLayer = info.mLayer;
+  header.mOptions =
+      (info.mSmoothing ? CaveFileHeader::OPTION_SMOOTHING : 0) |
+      (info.mSmoothCorners ? CaveFileHeader::OPTION_SMOOTH_CORNERS : 0) |
+      (info.mSmoothPoints ? CaveFileHeader::OPTION_SMOOTH_POINTS : 0) |
+      (info.mRemoveDiagonals ? CaveFileHeader::OPTION_REMOVE_DIAGONALS : 0);
+  header.mInputHash = hashInputs(info, params);
+}
+
+// Move the finished temporary file into place
+bool replaceFile(const std::string& tmpPath, const std::string& path,
+                 const char* who) {
+  std::error_code error;
+  std::filesystem::rename(tmpPath, path, error);
+  if (error) {
+    CAVE_LOG_WARN(who << ": can't rename to " << path << ": "
+                      << error.message());
+    std::filesystem::remove(tmpPath, error);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool saveCaveFile(const std::string& path, const TileMap& tileMap,
+                  const CaveInfo& info, const GenerationParams& params,
+                  const std::vector<int>* roomLabels) {
+  const size_t width = (size_t)info.mCaveWidth + 2;
+  const size_t height = (size_t)info.mCaveHeight + 2;
+  if (tileMap.size() != height || tileMap[0].size() != width) {
+    CAVE_LOG_WARN("saveCaveFile: map is "
+                  << (tileMap.empty() ? 0 : tileMap[0].size()) << "x"
+                  << tileMap.size() << " expected " << width << "x"
+                  << height);
+    return false;
+  }
+  const size_t numCells = (size_t)info.mCaveWidth * info.mCaveHeight;
+  if (roomLabels && roomLabels->size() != numCells) {
+    CAVE_LOG_WARN("saveCaveFile: wrong number of room labels");
+    return false;
+  }
+
+  // Everything after the header, built in memory for the checksum
+  CaveFileHeader header = {};
+  header.mTilesOffset = sizeof(CaveFileHeader);
+  header.mTilesBytes = width * height;
+  if (roomLabels) {
+    header.mRoomsOffset = alignUp(header.mTilesOffset + header.mTilesBytes, 8);
+    header.mRoomsBytes = numCells * sizeof(int32_t);
+  }
+  const uint64_t endOffset = roomLabels
+                                 ? header.mRoomsOffset + header.mRoomsBytes
+                                 : header.mTilesOffset + header.mTilesBytes;
+  std::vector<unsigned char> body(endOffset - sizeof(CaveFileHeader), 0);
+  unsigned char* tiles = body.data();
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      tiles[y * width + x] = (unsigned char)tileMap[y][x];
+    }
+  }
+  if (roomLabels) {
+    unsigned char* rooms =
+        body.data() + (header.mRoomsOffset - sizeof(CaveFileHeader));
+    for (size_t i = 0; i < numCells; ++i) {
+      int32_t label = (*roomLabels)[i];
+      std::memcpy(rooms + i * sizeof(label), &label, sizeof(label));
+    }
+  }
+
+  fillHeader(header, info, params);
+  header.mFlags = roomLabels ? CaveFileHeader::FLAG_ROOM_LABELS : 0;
+  header.mChecksum = hashBytes(body.data(), body.size());
+
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(body.data()), body.size());
+    if (!out) {
+      CAVE_LOG_WARN("saveCaveFile: can't write " << tmpPath);
+      return false;
+    }
+  }
+  return replaceFile(tmpPath, path, "saveCaveFile");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CaveFileWriter::~CaveFileWriter() {
+  if (mOut.is_open()) {
+    mOut.close();
+    std::error_code error;
+    std::filesystem::remove(mPath + ".tmp", error);
+  }
+}
+
+bool CaveFileWriter::open(const std::string& path, const CaveInfo& info,
+                          const GenerationParams& params) {
+  mPath = path;
+  mHeader = {};
+  fillHeader(mHeader, info, params);
+  mHeader.mTilesOffset = sizeof(CaveFileHeader);
+  mHeader.mTilesBytes =
+      ((uint64_t)info.mCaveWidth + 2) * ((uint64_t)info.mCaveHeight + 2);
+  mHasher = BytesHasher();
+  mRows = 0;
+  mOut.open(path + ".tmp", std::ios::binary | std::ios::trunc);
+  // The header is written again at the end with the checksum
+  mOut.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+  if (!mOut) {
+    CAVE_LOG_WARN("CaveFileWriter: can't write " << path << ".tmp");
+    mOut.close();
+    return false;
+  }
+  return true;
+}
+
+void CaveFileWriter::addRow(const std::vector<int>& row) {
+  mRow.resize(row.size());
+  for (size_t x = 0; x < row.size(); ++x) {
+    mRow[x] = (unsigned char)row[x];
+  }
+  mHasher.add(mRow.data(), mRow.size());
+  mOut.write(reinterpret_cast<const char*>(mRow.data()), mRow.size());
+  ++mRows;
+}
+
+bool CaveFileWriter::finish() {
+  if (!mOut.is_open()) {
+    return false;
+  }
+  const bool complete = mRows == mHeader.mCaveHeight + 2;
+  if (complete) {
+    mHeader.mChecksum = mHasher.finish();
+    mOut.seekp(0);
+    mOut.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+  }
+  const bool written = complete && (bool)mOut;
+  mOut.close();
+  if (!written) {
+    CAVE_LOG_WARN("CaveFileWriter: "
+                  << (complete ? "can't write " : "wrong number of rows for ")
+                  << mPath);
+    std::error_code error;
+    std::filesystem::remove(mPath + ".tmp", error);
+    return false;
+  }
+  return replaceFile(mPath + ".tmp", mPath, "CaveFileWriter");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CaveFile::~CaveFile() { close(); }
+
+CaveFile::CaveFile(CaveFile&& other) noexcept { *this = std::move(other); }
+
+CaveFile& CaveFile::operator=(CaveFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    std::swap(mData, other.mData);
+    std::swap(mSize, other.mSize);
+    std::swap(mHeader, other.mHeader);
+    std::swap(mTiles, other.mTiles);
+    std::swap(mRooms, other.mRooms);
+  }
+  return *this;
+}
+
+bool CaveFile::open(const std::string& path) {
+  close();
+  size_t size = 0;
+  const unsigned char* data = mapFile(path, size);
+  if (!data) {
+    return false;
+  }
+
+  const CaveFileHeader* header =
+      reinterpret_cast<const CaveFileHeader*>(data);
+  auto fits = [&](uint64_t offset, uint64_t bytes) {
+    return offset <= size && bytes <= size - offset;
+  };
+  const char* problem = nullptr;
+  if (size < sizeof(CaveFileHeader) ||
+      std::memcmp(header->mMagic, MAGIC, sizeof(MAGIC)) != 0) {
+    problem = "not a cave file";
+  } else if (header->mByteOrder != BYTE_ORDER_MARK) {
+    problem = "written with a different byte order";
+  } else if (header->mVersion != CaveFileHeader::VERSION ||
+             header->mHeaderBytes != sizeof(CaveFileHeader)) {
+    problem = "unsupported version";
+  } else if (header->mCaveWidth <= 0 || header->mCaveHeight <= 0 ||
+             header->mTilesBytes != ((uint64_t)header->mCaveWidth + 2) *
+                                        ((uint64_t)header->mCaveHeight + 2) ||
+             !fits(header->mTilesOffset, header->mTilesBytes)) {
+    problem = "bad tile grid";
+  } else if ((header->mFlags & CaveFileHeader::FLAG_ROOM_LABELS) &&
+             (header->mRoomsBytes != (uint64_t)header->mCaveWidth *
+                                         header->mCaveHeight *
+                                         sizeof(int32_t) ||
+              header->mRoomsOffset % 8 != 0 ||
+              !fits(header->mRoomsOffset, header->mRoomsBytes))) {
+    problem = "bad room labels";
+  }
+  if (problem) {
+    CAVE_LOG_WARN("CaveFile: " << path << ": " << problem);
+    unmapFile(data, size);
+    return false;
+  }
+
+  mData = data;
+  mSize = size;
+  mHeader = header;
+  mTiles = data + header->mTilesOffset;
+  if (header->mFlags & CaveFileHeader::FLAG_ROOM_LABELS) {
+    mRooms = reinterpret_cast<const int32_t*>(data + header->mRoomsOffset);
+  }
+  return true;
+}
+
+void CaveFile::close() {
+  if (mData) {
+    unmapFile(mData, mSize);
+  }
+  mData = nullptr;
+  mSize = 0;
+  mHeader = nullptr;
+  mTiles = nullptr;
+  mRooms = nullptr;
+}
+
+bool CaveFile::verify() const {
+  if (!mData) {
+    return false;
+  }
+  return hashBytes(mData + sizeof(CaveFileHeader),
+                   mSize - sizeof(CaveFileHeader)) == mHeader->mChecksum;
+}
+
+CaveInfo CaveFile::getInfo() const {
+  CaveInfo info;
+  info.mCaveWidth = mHeader->mCaveWidth;
+  info.mCaveHeight = mHeader->mCaveHeight;
+  info.mBorderWidth = mHeader->mBorderWidth;
+  info.mBorderHeight = mHeader->mBorderHeight;
+  info.mCellWidth = mHeader->mCellWidth;
+  info.mCellHeight = mHeader->mCellHeight;
+  info.mStartCellX = mHeader->mStartCellX;
+  info.mStartCellY = mHeader->mStartCellY;
+  info.mLayer = mHeader->mLayer;
+  const uint32_t options = mHeader->mOptions;
+  info.mSmoothing = (options & CaveFileHeader::OPTION_SMOOTHING) != 0;
+  info.mSmoothCorners = (options & CaveFileHeader::OPTION_SMOOTH_CORNERS) != 0;
+  info.mSmoothPoints = (options & CaveFileHeader::OPTION_SMOOTH_POINTS) != 0;
+  info.mRemoveDiagonals =
+      (options & CaveFileHeader::OPTION_REMOVE_DIAGONALS) != 0;
+  return info;
+}
+
+void CaveFile::copyTo(TileMap& tileMap) const {
+  const int width = getWidth();
+  tileMap.resize(getHeight());
+  for (int y = 0; y < getHeight(); ++y) {
+    const uint8_t* row = getRow(y);
+    tileMap[y].assign(row, row + width);
+  }
+}
+
+}  // namespace Cave
@@ -0,0 +1,162 @@
+#ifndef CAVE_FILE_H
+#define CAVE_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "CaveInfo.h"
+#include "Fingerprint.h"
+#include "GenerationParams.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// Binary file holding a generated cave so it can be loaded instead of
+// regenerated.
+//
+// Layout (native byte order, checked on load):
+//   CaveFileHeader  128 bytes
+//   tiles           (caveHeight + 2) * (caveWidth + 2) bytes, one TileName
+//                   per byte, row major, including the 1 tile border (i.e.
+//                   the same layout as the TileMap)
+//   room labels     optional, caveWidth * caveHeight int32s, row major,
+//                   without the border. 8 byte aligned.
+//
+// CaveFile::open memory maps the file and only checks the header, so it
+// costs the same whatever the size of the cave. The tiles are read
+// straight from the mapping.
+//
+struct CaveFileHeader {
+  char mMagic[8];  // "CAVEFILE"
+  uint32_t mVersion;
+  uint32_t mHeaderBytes;
+  uint32_t mByteOrder;  // 0x01020304 as written
+  uint32_t mFlags;      // FLAG_
+  int32_t mCaveWidth;
+  int32_t mCaveHeight;
+  int32_t mBorderWidth;
+  int32_t mBorderHeight;
+  int32_t mCellWidth;
+  int32_t mCellHeight;
+  int32_t mStartCellX;
+  int32_t mStartCellY;
+  int32_t mLayer;
+  uint32_t mOptions;    // OPTION_ (the CaveInfo smoothing bools)
+  uint64_t mInputHash;  // hashInputs(info, params)
+  uint64_t mChecksum;   // hashBytes of everything after the header
+  uint64_t mTilesOffset;
+  uint64_t mTilesBytes;
+  uint64_t mRoomsOffset;
+  uint64_t mRoomsBytes;
+  uint8_t mReserved[16];
+
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint32_t FLAG_ROOM_LABELS = 1;
+  static constexpr uint32_t OPTION_SMOOTHING = 1;
+  static constexpr uint32_t OPTION_SMOOTH_CORNERS = 2;
+  static constexpr uint32_t OPTION_SMOOTH_POINTS = 4;
+  static constexpr uint32_t OPTION_REMOVE_DIAGONALS = 8;
+};
+
+//
+// Write a cave to path (via a temporary file, so a reader never sees a half
+// written one). roomLabels, if given, are an int per cave cell (no border),
+// row major, stored as they are. CaveConnectivity::getLabels gives the
+// connected regions of the finished map, -1 for walls. (Not
+// Workspace::mCellRoom: that's the rooms before joinRooms dug the tunnels,
+// which are -1 in it.)
+// Returns false if it couldn't be written.
+//
+bool saveCaveFile(const std::string& path, const TileMap& tileMap,
+                  const CaveInfo& info, const GenerationParams& params,
+                  const std::vector<int>* roomLabels = nullptr);
+
+//
+// Writes a cave file a row at a time (without room labels), so the map
+// never has to be in memory all at once, e.g. for Cave::generateToFile.
+// Like saveCaveFile it writes a temporary file and renames it at the end.
+//
+class CaveFileWriter {
+ public:
+  CaveFileWriter() = default;
+  // Removes the temporary file if not finished
+  ~CaveFileWriter();
+  CaveFileWriter(const CaveFileWriter&) = delete;
+  CaveFileWriter& operator=(const CaveFileWriter&) = delete;
+
+  bool open(const std::string& path, const CaveInfo& info,
+            const GenerationParams& params);
+  // The TileMap's rows in order, including the border: caveHeight + 2
+  // rows of caveWidth + 2 tiles
+  void addRow(const std::vector<int>& row);
+  // Returns false if a write failed or the wrong number of rows were added
+  bool finish();
+
+ private:
+  std::string mPath;
+  std::ofstream mOut;
+  CaveFileHeader mHeader = {};
+  BytesHasher mHasher;
+  std::vector<unsigned char> mRow;
+  int mRows = 0;
+};
+
+//
+// A read-only, memory mapped cave file
+//
+class CaveFile {
+ public:
+  CaveFile() = default;
+  ~CaveFile();
+  CaveFile(CaveFile&& other) noexcept;
+  CaveFile& operator=(CaveFile&& other) noexcept;
+  CaveFile(const CaveFile&) = delete;
+  CaveFile& operator=(const CaveFile&) = delete;
+
+  // Returns false (and stays closed) if the file is missing, isn't a cave
+  // file, is a different version/byte order or is truncated
+  bool open(const std::string& path);
+  void close();
+  bool isOpen() const { return mData != nullptr; }
+
+  // Recompute the checksum of the tiles and labels. This reads the whole
+  // file so isn't done by open.
+  bool verify() const;
+
+  const CaveFileHeader& header() const { return *mHeader; }
+  CaveInfo getInfo() const;
+  uint64_t getInputHash() const { return mHeader->mInputHash; }
+
+  // The tile grid, including the border (same coords as the TileMap)
+  int getWidth() const { return mHeader->mCaveWidth + 2; }
+  int getHeight() const { return mHeader->mCaveHeight + 2; }
+  const uint8_t* getTiles() const { return mTiles; }
+  const uint8_t* getRow(int y) const {
+    return mTiles + (size_t)y * getWidth();
+  }
+  int getTile(int x, int y) const { return getRow(y)[x]; }
+
+  // Room label of a cave cell (no border), if the file has them
+  bool hasRoomLabels() const { return mRooms != nullptr; }
+  int getRoomLabel(int cx, int cy) const {
+    return mRooms[(size_t)cy * mHeader->mCaveWidth + cx];
+  }
+
+  // Copy out as an ordinary TileMap (resized to fit)
+  void copyTo(TileMap& tileMap) const;
+
+ private:
+  const unsigned char* mData = nullptr;
+  size_t mSize = 0;
+  const CaveFileHeader* mHeader = nullptr;
+  const uint8_t* mTiles = nullptr;
+  const int32_t* mRooms = nullptr;
+};
+
+}  // namespace Cave
+
+#endif
@@ -20,6 +20,16 @@ struct Vector2i {
   }
 };
 
+// x,y is the top left cell
+struct Rect2i {
+  int x = 0;
+  int y = 0;
+  int w = 0;
+  int h = 0;
+
+  bool empty() const { return w <= 0 || h <= 0; }
+};
+
 struct CaveInfo {
   bool mRemoveDiagonals = false;  // NOTE: Can't be used with mSmoothing
   bool mSmoothing = true;         // NOTE: Piority over mRemoveDiagonals
@@ -31,8 +41,8 @@ struct CaveInfo {
   int mBorderHeight = 1;
   int mCellWidth = 1;   // Only used for Godot GDCave
   int mCellHeight = 1;  // Only used for Godot GDCave
-  int mStartCellX = 0;  // Not used yet
-  int mStartCellY = 0;  // Not used yet
+  int mStartCellX = 0;  // For Cave::setDistanceMap
+  int mStartCellY = 0;
   int mLayer = 0;
 };
 
@@ -1,12 +1,15 @@
 #include "CaveSmoother.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 #include "Cave.h"
 #include "CaveInfo.h"
 #include "Debug.h"
+#include "Diagnostics.h"
 #include "TileTypes.h"
+#include "Trace.h"
 
 namespace Cave {
 
@@ -486,7 +489,7 @@ static const PointUpdate pointUpdates[] = {
 // Use the patterns to calc and modify the updates with mask,value and offsets
 //
 template <size_t SZ> void createUpdateInfos(UpdateInfo (&updateInfos)[SZ]) {
-  LOG_INFO("====================== SMOOTH CREATE UPDATES");
+  CAVE_LOG_DEBUG("====================== SMOOTH CREATE UPDATES");
   for (auto &u : updateInfos) {
     const unsigned char (*grid)[GRD_W] = u.pattern;
     int l_mask = 0;
@@ -546,10 +549,10 @@ template <size_t SZ> void createUpdateInfos(UpdateInfo (&updateInfos)[SZ]) {
     // Make P2 = P1 so don't need to check if 1 or 2 tiles being updated
     u.xoff2 = (l_xOff2 == -1) ? l_xOff1 : l_xOff2;
     u.yoff2 = (l_yOff2 == -1) ? l_yOff1 : l_yOff2;
-    LOG_DEBUG("UPDATE: msk:" << std::hex << u.mask << " val:" << u.value
-                             << std::dec << " of1: " << u.xoff1 << ","
-                             << u.yoff1 << " of2: " << u.xoff2 << ","
-                             << u.yoff2);
+    CAVE_LOG_TRACE("UPDATE: msk:" << std::hex << u.mask << " val:" << u.value
+                                  << std::dec << " of1: " << u.xoff1 << ","
+                                  << u.yoff1 << " of2: " << u.xoff2 << ","
+                                  << u.yoff2);
   }
 }
 
@@ -568,41 +571,93 @@ CaveSmoother::CaveSmoother(TileMap &tm, const CaveInfo &i)
 
 CaveSmoother::~CaveSmoother() {}
 
-void CaveSmoother::smooth() {
-  std::vector<std::vector<bool>> smoothedGrid(
-      info.mCaveHeight + GRD_H + 1,
-      std::vector<bool>(info.mCaveWidth + GRD_W + 1, false));
+void CaveSmoother::setExecutor(Executor *exec, int maxWorkers) {
+  this->executor = exec;
+  this->maxWorkers = maxWorkers;
+}
+
+Executor &CaveSmoother::getExecutor() const {
+  return executor ? *executor : Executor::getDefault();
+}
+
+void CaveSmoother::setWorkspace(Workspace *ws) { this->workspace = ws; }
+
+Workspace &CaveSmoother::getWorkspace() {
+  return workspace ? *workspace : ownWorkspace;
+}
+
+void CaveSmoother::smooth(GenerationStats *stats) {
+  CAVE_TRACE_SCOPE("CaveSmoother::smooth");
+  GenerationStats localStats;
+  GenerationStats &passStats = stats ? *stats : localStats;
 
   if (info.mSmoothing) {
-    smoothEdges(smoothedGrid);
+    std::vector<std::vector<bool>> &smoothedGrid =
+        getWorkspace().mSmoothedGrid;
+    resetGrid(smoothedGrid, info.mCaveHeight + GRD_H + 1,
+              info.mCaveWidth + GRD_W + 1, false);
+
+    smoothEdges(smoothedGrid, passStats);
 
     if (info.mSmoothCorners) {
-      smoothCorners(smoothedGrid);
+      smoothCorners(smoothedGrid, passStats);
     }
     if (info.mSmoothPoints) {
-      smoothPoints();
+      smoothPoints(passStats);
     }
   } else if (info.mRemoveDiagonals) {
-    removeDiagonalGaps();
+    removeDiagonalGaps(passStats);
+  }
+}
+
+int CaveSmoother::getUnsmoothedTile(int tile) {
+  switch (tile) {
+  // The second tile of the 30/60 pairs is put on the FLOOR (the 'M')
+  case V60a2:
+  case V60b2:
+  case V60c2:
+  case V60d2:
+  case H30a2:
+  case H30b2:
+  case H30c2:
+  case H30d2:
+    return FLOOR;
+  default:
+    return Cave::isEmpty(tile) ? FLOOR : WALL;
   }
 }
 
 /////////////////////////////////////////////////////////////////////////////
 
 template <size_t SZ>
-bool CaveSmoother::smoothTheGrid(UpdateInfo (&updateInfos)[SZ],
+int CaveSmoother::smoothTheGrid(UpdateInfo (&updateInfos)[SZ],
                                  std::vector<std::vector<int>> &inGrid,
                                  std::vector<std::vector<bool>> &smoothedGrid,
                                  bool updateInGrid) {
-  bool changed = false;
+  CAVE_TRACE_SCOPE("smoothTheGrid");
+  int changed = 0;
   //
   // Smooth the grid
   //
   for (int y = 0; y < info.mCaveHeight; y++) {
-    for (int x = 0; x < info.mCaveWidth; x++) {
-      // Get the value of the 4x4 grid
-      LOG_DEBUG("==MASK value " << x << "," << y);
-      int value = 0;
+    changed +=
+        smoothGridRow(updateInfos, inGrid, smoothedGrid, y, updateInGrid);
+  }
+  return changed;
+}
+
+template <size_t SZ>
+int CaveSmoother::smoothGridRow(UpdateInfo (&updateInfos)[SZ],
+                                std::vector<std::vector<int>> &inGrid,
+                                std::vector<std::vector<bool>> &smoothedGrid,
+                                int y, bool updateInGrid) {
+  int changed = 0;
+  int value = 0;
+  for (int x = 0; x < info.mCaveWidth; x++) {
+    // Get the value of the 4x4 grid
+    CAVE_LOG_TRACE("==MASK value " << x << "," << y);
+    if (x == 0 || updateInGrid) {
+      value = 0;
       int shift = (GRD_H * GRD_W) - 1;
       for (int r = 0; r < GRD_H; ++r) {
         for (int c = 0; c < GRD_W; ++c) {
@@ -612,59 +667,72 @@ bool CaveSmoother::smoothTheGrid(UpdateInfo (&updateInfos)[SZ],
           --shift;
         }
       }
-      LOG_DEBUG("==FIND " << x << "," << y << " val:" << std::hex << value
-                          << std::dec);
-
-      // Find the matching update(s) for that value
-      //
-      int idx = 0;
-      for (const auto &up : updateInfos) {
-        LOG_DEBUG("  NEXT up:" << idx << " msk:" << std::hex << up.mask
-                               << " val:" << up.value << " inVal:" << value
-                               << " and:" << (value & up.mask) << std::dec);
-        if ((value & up.mask) == up.value) {
-          Vector2i pos1{x + up.xoff1, y + up.yoff1};
-          Vector2i pos2{x + up.xoff2, y + up.yoff2};
-
-          LOG_DEBUG("      FOUND1 up:" << idx << " p1:" << pos1.x << ","
-                                       << pos1.y << " p2:" << pos2.x << ","
-                                       << pos2.y);
-          // Ensure not smoothed it already
-          // - can check both pos since p2 == p1 if no 2nd tile
-          if ((smoothedGrid[pos1.y][pos1.x] == false) &&
-              (smoothedGrid[pos2.y][pos2.x] == false)) {
-            LOG_DEBUG("         SMOOTH1 -> " << up.t1);
-            // Smooth the first (N/O) tile
+    } else {
+      // Moving right a cell shifts each row's bits left one and brings in
+      // the next column (not when updates change inGrid as they go)
+      value = (value << 1) & 0xEEEE;
+      for (int r = 0; r < GRD_H; ++r) {
+        if (inGrid[y + r][x + GRD_W - 1] == SOLID) {
+          value |= 1 << ((GRD_H - 1 - r) * GRD_W);
+        }
+      }
+    }
+    CAVE_LOG_TRACE("==FIND " << x << "," << y << " val:" << std::hex << value
+                             << std::dec);
+
+    // Find the matching update(s) for that value
+    //
+    int idx = 0;
+    for (const auto &up : updateInfos) {
+      CAVE_LOG_TRACE("  NEXT up:" << idx << " msk:" << std::hex << up.mask
+                                  << " val:" << up.value
+                                  << " inVal:" << value
+                                  << " and:" << (value & up.mask)
+                                  << std::dec);
+      if ((value & up.mask) == up.value) {
+        Vector2i pos1{x + up.xoff1, y + up.yoff1};
+        Vector2i pos2{x + up.xoff2, y + up.yoff2};
+
+        CAVE_LOG_TRACE("      FOUND1 up:" << idx << " p1:" << pos1.x << ","
+                                          << pos1.y << " p2:" << pos2.x << ","
+                                          << pos2.y);
+        // Ensure not smoothed it already
+        // - can check both pos since p2 == p1 if no 2nd tile
+        if ((smoothedGrid[pos1.y][pos1.x] == false) &&
+            (smoothedGrid[pos2.y][pos2.x] == false)) {
+          CAVE_LOG_TRACE("         SMOOTH1 -> " << up.t1);
+          // Smooth the first (N/O) tile
+          // - Need to translate the grid pos back to cave pos
+          Cave::setCell(tileMap, pos1.x - 1, pos1.y - 1, up.t1);
+          // Removing Diagonals needs to update the inGrid
+          if (updateInGrid) {
+            inGrid[pos1.y][pos1.x] = up.t1;
+          }
+          smoothedGrid[pos1.y][pos1.x] = true;
+          ++changed;
+          // Check if there is a second (M) tile
+          if (up.t2 != IGNORE) {
+            CAVE_LOG_TRACE("      FOUND2 " << pos2.x << "," << pos2.y);
+            CAVE_LOG_TRACE("         SMOOTH2 -> " << up.t2);
+            // Smooth the second (M) tile
             // - Need to translate the grid pos back to cave pos
-            Cave::setCell(tileMap, pos1.x - 1, pos1.y - 1, up.t1);
+            Cave::setCell(tileMap, pos2.x - 1, pos2.y - 1, up.t2);
             // Removing Diagonals needs to update the inGrid
             if (updateInGrid) {
-              inGrid[pos1.y][pos1.x] = up.t1;
-            }
-            smoothedGrid[pos1.y][pos1.x] = true;
-            changed = true;
-            // Check if there is a second (M) tile
-            if (up.t2 != IGNORE) {
-              LOG_DEBUG("      FOUND2 " << pos2.x << "," << pos2.y);
-              LOG_DEBUG("         SMOOTH2 -> " << up.t2);
-              // Smooth the second (M) tile
-              // - Need to translate the grid pos back to cave pos
-              Cave::setCell(tileMap, pos2.x - 1, pos2.y - 1, up.t2);
-              // Removing Diagonals needs to update the inGrid
-              if (updateInGrid) {
-                inGrid[pos2.y][pos2.x] = up.t2;
-              }
-              smoothedGrid[pos2.y][pos2.x] = true;
-            } else {
-              LOG_DEBUG("  IGNORE TILE2: " << pos2.x << "," << pos2.y);
+              inGrid[pos2.y][pos2.x] = up.t2;
             }
+            smoothedGrid[pos2.y][pos2.x] = true;
+            ++changed;
           } else {
-            LOG_DEBUG("  IGNORE p1:" << smoothedGrid[pos1.y][pos1.x]
-                                     << " p2:" << smoothedGrid[pos2.y][pos2.x]);
+            CAVE_LOG_TRACE("  IGNORE TILE2: " << pos2.x << "," << pos2.y);
           }
+        } else {
+          CAVE_LOG_TRACE("  IGNORE p1:"
+                         << smoothedGrid[pos1.y][pos1.x]
+                         << " p2:" << smoothedGrid[pos2.y][pos2.x]);
         }
-        ++idx;
       }
+      ++idx;
     }
   }
   return changed;
@@ -677,50 +745,73 @@ bool CaveSmoother::smoothTheGrid(UpdateInfo (&updateInfos)[SZ],
 // and find any matching update(s). For each match set the TileMapLayer
 // cell(s) for the 1 or 2 tiles for each update.
 //
-void CaveSmoother::smoothEdges(std::vector<std::vector<bool>> &smoothedGrid) {
+void CaveSmoother::smoothEdges(std::vector<std::vector<bool>> &smoothedGrid,
+                               GenerationStats &stats) {
+  StageTimer timer(stats.mSmoothEdges);
+  CAVE_TRACE_SCOPE("smoothEdges");
+  CAVE_LOG_DEBUG("====================== SMOOTH EDGES");
+  std::vector<std::vector<int>> &inGrid = getWorkspace().mInGrid;
+  buildEdgeGrid(inGrid);
+  stats.mEdgeTilesChanged = smoothTheGrid(updates, inGrid, smoothedGrid);
+  stats.noteScratch(gridBytes(tileMap) + gridBytes(inGrid) +
+                    gridBytes(smoothedGrid));
+}
+
+void CaveSmoother::buildEdgeGrid(std::vector<std::vector<int>> &inGrid) {
   //
   // NOTE: So we can do a 4x4 with the top and left edge being the border
   // we shift the maze 0,0 to 1,1. We also make it wider to allow the
   // right and bottom edges to be a border
   //
-  LOG_INFO("====================== SMOOTH EDGES");
-  //
   // Copy the current cave
   // NOTE: Translate the cave 0,0 => 1,1 of grids
   //
-  std::vector<std::vector<int>> inGrid(
-      info.mCaveHeight + GRD_H + 1,
-      std::vector<int>(info.mCaveWidth + GRD_W + 1, SOLID));
-
-  for (int y = 0; y < info.mCaveHeight; y++) {
-    for (int x = 0; x < info.mCaveWidth; x++) {
-      inGrid[y + 1][x + 1] = Cave::isEmpty(tileMap, x, y) ? FLOOR : SOLID;
-    }
-  }
-  smoothTheGrid(updates, inGrid, smoothedGrid);
+  resetGrid(inGrid, info.mCaveHeight + GRD_H + 1, info.mCaveWidth + GRD_W + 1,
+            (int)SOLID);
+
+  parallelForRows(getExecutor(), info.mCaveHeight, maxWorkers,
+                  [&](int rowBegin, int rowEnd) {
+                    CAVE_TRACE_SCOPE("build inGrid band");
+                    for (int y = rowBegin; y < rowEnd; y++) {
+                      for (int x = 0; x < info.mCaveWidth; x++) {
+                        inGrid[y + 1][x + 1] =
+                            Cave::isEmpty(tileMap, x, y) ? FLOOR : SOLID;
+                      }
+                    }
+                  });
 }
 
-void CaveSmoother::smoothCorners(std::vector<std::vector<bool>> &smoothedGrid) {
+void CaveSmoother::smoothCorners(std::vector<std::vector<bool>> &smoothedGrid,
+                                 GenerationStats &stats) {
+  StageTimer timer(stats.mSmoothCorners);
+  CAVE_TRACE_SCOPE("smoothCorners");
+  CAVE_LOG_DEBUG("====================== SMOOTH CORNERS");
   //
-  // NOTE: So we can do a 4x4 with the top and left edge being the border
-  // we shift the maze 0,0 to 1,1. We also make it wider to allow the
-  // right and bottom edges to be a border
-  //
-  LOG_INFO("====================== SMOOTH CORNERS");
-  //
-  // Copy the current cave
-  // NOTE: Translate the cave 0,0 => 1,1 of grids
+  // Copy the current cave (as for the edges)
   //
-  std::vector<std::vector<int>> inGrid(
-      info.mCaveHeight + GRD_H + 1,
-      std::vector<int>(info.mCaveWidth + GRD_W + 1, SOLID));
+  std::vector<std::vector<int>> &inGrid = getWorkspace().mInGrid;
+  resetGrid(inGrid, info.mCaveHeight + GRD_H + 1, info.mCaveWidth + GRD_W + 1,
+            (int)SOLID);
+
+  parallelForRows(getExecutor(), info.mCaveHeight, maxWorkers,
+                  [&](int rowBegin, int rowEnd) {
+                    CAVE_TRACE_SCOPE("build inGrid band");
+                    fillCornerGridRows(inGrid, rowBegin, rowEnd);
+                  });
+  stats.mCornerTilesChanged =
+      smoothTheGrid(cornerUpdates, inGrid, smoothedGrid);
+  stats.noteScratch(gridBytes(tileMap) + gridBytes(inGrid) +
+                    gridBytes(smoothedGrid));
+}
 
-  for (int y = 0; y < info.mCaveHeight; y++) {
+void CaveSmoother::fillCornerGridRows(std::vector<std::vector<int>> &inGrid,
+                                      int rowBegin, int rowEnd) {
+  for (int y = rowBegin; y < rowEnd; y++) {
     for (int x = 0; x < info.mCaveWidth; x++) {
-      // Walls and End caps can make right angle corners we want to round
-      // Thought I could do something clever with IGNORE vs FLOOR, but all
-      // the smoothed tiles are treated as not set, hence I pass in the
-      // smoothedGrid
+      // Walls and End caps can make right angle corners we want to
+      // round Thought I could do something clever with IGNORE vs
+      // FLOOR, but all the smoothed tiles are treated as not set, hence
+      // I pass in the smoothedGrid
       bool isWall = Cave::isWall(tileMap, x, y) ||
                     Cave::isTile(tileMap, x, y, END_N) ||
                     Cave::isTile(tileMap, x, y, END_S) ||
@@ -731,78 +822,208 @@ void CaveSmoother::smoothCorners(std::vector<std::vector<bool>> &smoothedGrid) {
                                                             : IGNORE;
     }
   }
-  smoothTheGrid(cornerUpdates, inGrid, smoothedGrid);
 }
 
-void CaveSmoother::smoothPoints() {
-  LOG_INFO("====================== SMOOTH POINTS");
-  auto tileMapCopy(tileMap);
-  std::vector<std::vector<bool>> smoothedGrid(
-      info.mCaveHeight + 2 + 1,
-      std::vector<bool>(info.mCaveWidth + 2 + 1, false));
+void CaveSmoother::smoothPoints(GenerationStats &stats) {
+  StageTimer timer(stats.mSmoothPoints);
+  CAVE_TRACE_SCOPE("smoothPoints");
+  CAVE_LOG_DEBUG("====================== SMOOTH POINTS");
+  int changed = 0;
+  TileMap &tileMapCopy = getWorkspace().mTileMapCopy;
+  tileMapCopy = tileMap;
+  std::vector<std::vector<bool>> &smoothedGrid = getWorkspace().mPointsGrid;
+  resetGrid(smoothedGrid, info.mCaveHeight + 2 + 1, info.mCaveWidth + 2 + 1,
+            false);
   for (int y = 0; y < info.mCaveHeight; y++) {
-    for (int x = 0; x < info.mCaveWidth; x++) {
-      int idx = 0;
-      for (const auto &up : pointUpdates) {
-        for (int i = 0; i < up.numGrids; ++i) {
-          if (smoothedGrid[y + up.yoff1][x + up.xoff1])
-            continue;
-          bool match = true;
-          LOG_DEBUG("SPNT: " << x << "," << y << " up:" << up.xoff1 << ","
-                             << up.yoff1 << " tile:" << up.tile1);
-          const auto *grid = up.grids[i];
-          for (int yo = 0; yo < 2 && match; ++yo) {
-            for (int xo = 0; xo < 2 && match; ++xo) {
-              TileName wantTile = grid[yo][xo];
-              if (wantTile != IGNORE) {
-                // Use the original grid to check for matches
-                if (!Cave::isTile(tileMapCopy, x + xo, y + yo, wantTile)) {
-                  match = false;
-                } else {
-                  LOG_DEBUG("...match off: " << xo << "," << yo);
-                }
+    changed += smoothPointsRow(tileMapCopy, smoothedGrid, y);
+  }
+  stats.mPointTilesChanged = changed;
+  stats.noteScratch(gridBytes(tileMap) + gridBytes(tileMapCopy) +
+                    gridBytes(smoothedGrid));
+}
+
+int CaveSmoother::smoothPointsRow(const TileMap &tileMapCopy,
+                                  std::vector<std::vector<bool>> &smoothedGrid,
+                                  int y) {
+  int changed = 0;
+  // Every point pattern wants slope tiles (all before SINGLE)
+  auto isSlope = [&](int x, int y) {
+    return Cave::getTile(tileMapCopy, x, y) < SINGLE;
+  };
+  for (int x = 0; x < info.mCaveWidth; x++) {
+    if (!isSlope(x, y) && !isSlope(x + 1, y) && !isSlope(x, y + 1) &&
+        !isSlope(x + 1, y + 1)) {
+      continue;
+    }
+    for (const auto &up : pointUpdates) {
+      for (int i = 0; i < up.numGrids; ++i) {
+        if (smoothedGrid[y + up.yoff1][x + up.xoff1])
+          continue;
+        bool match = true;
+        CAVE_LOG_TRACE("SPNT: " << x << "," << y << " up:" << up.xoff1 << ","
+                                << up.yoff1 << " tile:" << up.tile1);
+        const auto *grid = up.grids[i];
+        for (int yo = 0; yo < 2 && match; ++yo) {
+          for (int xo = 0; xo < 2 && match; ++xo) {
+            TileName wantTile = grid[yo][xo];
+            if (wantTile != IGNORE) {
+              // Use the original grid to check for matches
+              if (!Cave::isTile(tileMapCopy, x + xo, y + yo, wantTile)) {
+                match = false;
+              } else {
+                CAVE_LOG_TRACE("...match off: " << xo << "," << yo);
               }
             }
           }
-          if (match) {
-            LOG_DEBUG("...FULL MATCH set:" << x + 1 + up.xoff1 << ","
-                                           << y + 1 + up.yoff1
-                                           << " tile:" << up.tile1);
-            Cave::setCell(tileMap, x + up.xoff1, y + up.yoff1, up.tile1);
-            smoothedGrid[y + up.yoff1][x + up.xoff1] = true;
-            break;
-          }
+        }
+        if (match) {
+          CAVE_LOG_TRACE("...FULL MATCH set:" << x + 1 + up.xoff1 << ","
+                                              << y + 1 + up.yoff1
+                                              << " tile:" << up.tile1);
+          Cave::setCell(tileMap, x + up.xoff1, y + up.yoff1, up.tile1);
+          smoothedGrid[y + up.yoff1][x + up.xoff1] = true;
+          ++changed;
+          break;
         }
       }
     }
   }
+  return changed;
 }
 
-void CaveSmoother::removeDiagonalGaps() {
-  std::vector<std::vector<bool>> smoothedGrid(
-      info.mCaveHeight + GRD_H + 1,
-      std::vector<bool>(info.mCaveWidth + GRD_W + 1, false));
+void CaveSmoother::removeDiagonalGaps(GenerationStats &stats) {
+  StageTimer timer(stats.mRemoveDiagonals);
+  CAVE_TRACE_SCOPE("removeDiagonalGaps");
+  std::vector<std::vector<bool>> &smoothedGrid = getWorkspace().mSmoothedGrid;
+  resetGrid(smoothedGrid, info.mCaveHeight + GRD_H + 1,
+            info.mCaveWidth + GRD_W + 1, false);
+
+  CAVE_LOG_DEBUG("====================== REMOVE DIAGONAL GAPS");
+  std::vector<std::vector<int>> &inGrid = getWorkspace().mInGrid;
+  buildEdgeGrid(inGrid);
+  stats.mDiagonalTilesChanged =
+      smoothTheGrid(diagonalUpdates, inGrid, smoothedGrid, true);
+  stats.noteScratch(gridBytes(tileMap) + gridBytes(inGrid) +
+                    gridBytes(smoothedGrid));
+}
 
-  //
-  // NOTE: So we can do a 4x4 with the top and left edge being the border
-  // we shift the maze 0,0 to 1,1. We also make it wider to allow the
-  // right and bottom edges to be a border
-  //
-  LOG_INFO("====================== REMOVE DIAGONAL GAPS");
-  //
-  // Copy the current cave
-  // NOTE: Translate the cave 0,0 => 1,1 of grids
-  //
-  std::vector<std::vector<int>> inGrid(
-      info.mCaveHeight + GRD_H + 1,
-      std::vector<int>(info.mCaveWidth + GRD_W + 1, SOLID));
+/////////////////////////////////////////////////////////////////////////////
 
-  for (int y = 0; y < info.mCaveHeight; y++) {
-    for (int x = 0; x < info.mCaveWidth; x++) {
-      inGrid[y + 1][x + 1] = Cave::isEmpty(tileMap, x, y) ? FLOOR : SOLID;
+//
+// The same passes as smooth() but interleaved a row at a time, so the rows
+// at the top are finished (and given to the sink) while the passes are
+// still working further down.
+//
+// A 4x4 pattern scanned at row y changes cave rows y-1 to y+2, so once a
+// 4x4 pass has scanned rows [0, n) it won't change rows above n-1 again. A
+// points scan changes rows y and y+1, so it's done with the rows above n.
+// Each pass only scans a row once the pass before is done with every row it
+// reads (and marks in smoothedGrid), which keeps the result identical to
+// running the passes one after the other.
+//
+void CaveSmoother::smoothRows(const RowSink &sink, GenerationStats *stats) {
+  CAVE_TRACE_SCOPE("CaveSmoother::smoothRows");
+  GenerationStats localStats;
+  GenerationStats &passStats = stats ? *stats : localStats;
+  const int height = info.mCaveHeight;
+
+  int emitted = 0;
+  auto emitRows = [&](int rows) {
+    for (; emitted < rows; ++emitted) {
+      sink(emitted, &tileMap[emitted + 1][1]);
+    }
+  };
+  auto gridDone = [height](int scanned) {
+    return scanned == height ? height : std::max(0, scanned - 1);
+  };
+
+  if (!info.mSmoothing && !info.mRemoveDiagonals) {
+    emitRows(height);
+    return;
+  }
+
+  Workspace &ws = getWorkspace();
+  std::vector<std::vector<bool>> &smoothedGrid = ws.mSmoothedGrid;
+  resetGrid(smoothedGrid, height + GRD_H + 1, info.mCaveWidth + GRD_W + 1,
+            false);
+  std::vector<std::vector<int>> &inGrid = ws.mInGrid;
+  buildEdgeGrid(inGrid);
+
+  if (!info.mSmoothing) {
+    int changed = 0;
+    for (int y = 0; y < height; y++) {
+      {
+        StageTimer timer(passStats.mRemoveDiagonals);
+        changed +=
+            smoothGridRow(diagonalUpdates, inGrid, smoothedGrid, y, true);
+      }
+      emitRows(gridDone(y + 1));
+    }
+    passStats.mDiagonalTilesChanged = changed;
+    passStats.noteScratch(gridBytes(tileMap) + gridBytes(inGrid) +
+                          gridBytes(smoothedGrid));
+    return;
+  }
+
+  // The edges pass reads inGrid all the way down, so the corners pass
+  // builds its own as the edges are finished
+  std::vector<std::vector<int>> &cornerGrid = ws.mCornerGrid;
+  if (info.mSmoothCorners) {
+    resetGrid(cornerGrid, height + GRD_H + 1, info.mCaveWidth + GRD_W + 1,
+              (int)SOLID);
+  }
+  // The points pass reads a copy of the rows from before it changed them
+  TileMap &tileMapCopy = ws.mTileMapCopy;
+  std::vector<std::vector<bool>> &pointsGrid = ws.mPointsGrid;
+  if (info.mSmoothPoints) {
+    tileMapCopy.resize(tileMap.size());
+    tileMapCopy.front() = tileMap.front();
+    tileMapCopy.back() = tileMap.back();
+    resetGrid(pointsGrid, height + 2 + 1, info.mCaveWidth + 2 + 1, false);
+  }
+
+  int edges = 0;
+  int corners = 0;
+  int cornerRows = 0;
+  int points = 0;
+  int copiedRows = 0;
+  while (emitted < height) {
+    if (edges < height) {
+      StageTimer timer(passStats.mSmoothEdges);
+      passStats.mEdgeTilesChanged +=
+          smoothGridRow(updates, inGrid, smoothedGrid, edges++);
+    }
+    int done = gridDone(edges);
+    if (info.mSmoothCorners) {
+      // Scanning row y reads cave rows y-1 to y+2
+      while (corners < height && done >= std::min(corners + 3, height)) {
+        StageTimer timer(passStats.mSmoothCorners);
+        const int rows = std::min(corners + 3, height);
+        fillCornerGridRows(cornerGrid, cornerRows, rows);
+        cornerRows = rows;
+        passStats.mCornerTilesChanged +=
+            smoothGridRow(cornerUpdates, cornerGrid, smoothedGrid, corners++);
+      }
+      done = gridDone(corners);
+    }
+    if (info.mSmoothPoints) {
+      // Scanning row y reads cave rows y and y+1
+      while (points < height && done >= std::min(points + 2, height)) {
+        StageTimer timer(passStats.mSmoothPoints);
+        const int rows = std::min(points + 2, height);
+        for (; copiedRows < rows; ++copiedRows) {
+          tileMapCopy[copiedRows + 1] = tileMap[copiedRows + 1];
+        }
+        passStats.mPointTilesChanged +=
+            smoothPointsRow(tileMapCopy, pointsGrid, points++);
+      }
+      done = points;
     }
+    emitRows(done);
   }
-  smoothTheGrid(diagonalUpdates, inGrid, smoothedGrid, true);
+  passStats.noteScratch(gridBytes(tileMap) + gridBytes(inGrid) +
+                        gridBytes(smoothedGrid) + gridBytes(cornerGrid) +
+                        gridBytes(tileMapCopy) + gridBytes(pointsGrid));
 }
 
 } // namespace Cave
\ No newline at end of file
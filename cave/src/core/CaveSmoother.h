@@ -5,32 +5,73 @@
 #include <vector>
 
 #include "CaveInfo.h"
+#include "Executor.h"
+#include "GenerationStats.h"
 #include "TileTypes.h"
+#include "Workspace.h"
 
 namespace Cave {
 
 struct UpdateInfo;
 
 class CaveSmoother {
-  void removeDiagonalGaps();
-  void smoothEdges(std::vector<std::vector<bool>>& smoothedGrid);
-  void smoothCorners(std::vector<std::vector<bool>>& smoothedGrid);
-  void smoothPoints();
+  void removeDiagonalGaps(GenerationStats& stats);
+  void smoothEdges(std::vector<std::vector<bool>>& smoothedGrid,
+                   GenerationStats& stats);
+  void smoothCorners(std::vector<std::vector<bool>>& smoothedGrid,
+                     GenerationStats& stats);
+  void smoothPoints(GenerationStats& stats);
+  // Fill inGrid with the map's walls/floors for the edges (and diagonals)
+  void buildEdgeGrid(std::vector<std::vector<int>>& inGrid);
+  // Cave rows [rowBegin, rowEnd) of the corners pass's inGrid
+  void fillCornerGridRows(std::vector<std::vector<int>>& inGrid, int rowBegin,
+                          int rowEnd);
+  // Returns the number of tiles changed
   template <size_t SZ>
-  bool smoothTheGrid(UpdateInfo (&updateInfos)[SZ],
+  int smoothTheGrid(UpdateInfo (&updateInfos)[SZ],
                      std::vector<std::vector<int>>& inGrid,
                      std::vector<std::vector<bool>>& smoothedGrid,
                      bool updateInGrid = false);
+  // One row of the above
+  template <size_t SZ>
+  int smoothGridRow(UpdateInfo (&updateInfos)[SZ],
+                    std::vector<std::vector<int>>& inGrid,
+                    std::vector<std::vector<bool>>& smoothedGrid, int y,
+                    bool updateInGrid = false);
+  int smoothPointsRow(const TileMap& tileMapCopy,
+                      std::vector<std::vector<bool>>& smoothedGrid, int y);
 
  public:
   CaveSmoother(TileMap& tm, const CaveInfo& i);
   ~CaveSmoother();
 
-  void smooth();
+  // Run the parallel parts on the given executor (nullptr = the default)
+  void setExecutor(Executor* exec, int maxWorkers = 0);
+
+  // Use the workspace's grids (nullptr = the smoother's own)
+  void setWorkspace(Workspace* ws);
+
+  // Optionally record the time and tiles changed for each pass
+  void smooth(GenerationStats* stats = nullptr);
+
+  // Smooth the same, but pass the rows to the sink in order as each is
+  // finished, a few rows behind the passes (see smoothRows in the .cpp)
+  void smoothRows(const RowSink& sink, GenerationStats* stats = nullptr);
+
+  // The WALL or FLOOR a smoothed tile was made from, as near as can be told
+  // (the tiles that round off a wall end are FLOOR, so are read as FLOOR)
+  static int getUnsmoothedTile(int tile);
 
  private:
+  Executor& getExecutor() const;
+  Workspace& getWorkspace();
+
   TileMap& tileMap;
   const CaveInfo& info;
+  Executor* executor = nullptr;
+  int maxWorkers = 0;
+  Workspace* workspace = nullptr;
+  Workspace ownWorkspace;
 };
 
 }  // namespace Cave
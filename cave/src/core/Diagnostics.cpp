@@ -0,0 +1,46 @@
+#include "Diagnostics.h"
+
+#include <atomic>
+
+#include "Debug.h"
+
+namespace Cave {
+
+namespace {
+
+class DebugSink : public DiagnosticSink {
+ public:
+  void write(LogLevel level, const std::string& message) override {
+    if (level <= LogLevel::Debug) {
+      LOG_DEBUG(message);
+    } else {
+      LOG_INFO(message);
+    }
+  }
+};
+
+DebugSink sDebugSink;
+std::atomic<DiagnosticSink*> sSink{&sDebugSink};
+std::atomic<LogLevel> sLevel{LogLevel::Trace};
+
+}  // namespace
+
+void Diagnostics::setSink(DiagnosticSink* sink) { sSink = sink; }
+
+DiagnosticSink* Diagnostics::getSink() { return sSink.load(); }
+
+void Diagnostics::setLevel(LogLevel level) { sLevel = level; }
+
+bool Diagnostics::isEnabled(LogLevel level) {
+  return (level >= sLevel.load(std::memory_order_relaxed)) &&
+         (sSink.load(std::memory_order_relaxed) != nullptr);
+}
+
+void Diagnostics::write(LogLevel level, const std::string& message) {
+  DiagnosticSink* sink = sSink.load();
+  if (sink) {
+    sink->write(level, message);
+  }
+}
+
+}  // namespace Cave
@@ -0,0 +1,90 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <sstream>
+#include <string>
+
+//
+// Diagnostic logging for the generator.
+//
+// CAVE_LOG_TRACE/DEBUG/INFO/WARN(stream expression) are filtered twice:
+// - at compile time by CAVE_LOG_LEVEL (cmake -DCAVE_LOG_LEVEL=DEBUG etc.).
+//   Levels below it expand to nothing, so the stream expression isn't even
+//   evaluated and per-cell tracing in the hot loops costs nothing.
+// - at run time by Diagnostics::setLevel and whether there is a sink.
+//
+// The default sink forwards to Debug.h's LOG_DEBUG/LOG_INFO. A host can
+// install its own (e.g. Godot's print) or none to silence everything.
+//
+#define CAVE_LOG_LEVEL_TRACE 0
+#define CAVE_LOG_LEVEL_DEBUG 1
+#define CAVE_LOG_LEVEL_INFO 2
+#define CAVE_LOG_LEVEL_WARN 3
+#define CAVE_LOG_LEVEL_OFF 4
+
+#ifndef CAVE_LOG_LEVEL
+#define CAVE_LOG_LEVEL CAVE_LOG_LEVEL_INFO
+#endif
+
+#define CAVE_LOG_AT(level, x)                                 \
+  do {                                                        \
+    if (::Cave::Diagnostics::isEnabled(level)) {              \
+      std::ostringstream caveLogStream;                       \
+      caveLogStream << x;                                     \
+      ::Cave::Diagnostics::write(level, caveLogStream.str()); \
+    }                                                         \
+  } while (0)
+
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_TRACE
+#define CAVE_LOG_TRACE(x) CAVE_LOG_AT(::Cave::LogLevel::Trace, x)
+#else
+#define CAVE_LOG_TRACE(x) ((void)0)
+#endif
+
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_DEBUG
+#define CAVE_LOG_DEBUG(x) CAVE_LOG_AT(::Cave::LogLevel::Debug, x)
+#else
+#define CAVE_LOG_DEBUG(x) ((void)0)
+#endif
+
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_INFO
+#define CAVE_LOG_INFO(x) CAVE_LOG_AT(::Cave::LogLevel::Info, x)
+#else
+#define CAVE_LOG_INFO(x) ((void)0)
+#endif
+
+#if CAVE_LOG_LEVEL <= CAVE_LOG_LEVEL_WARN
+#define CAVE_LOG_WARN(x) CAVE_LOG_AT(::Cave::LogLevel::Warn, x)
+#else
+#define CAVE_LOG_WARN(x) ((void)0)
+#endif
+
+namespace Cave {
+
+enum class LogLevel { Trace, Debug, Info, Warn };
+
+class DiagnosticSink {
+ public:
+  virtual ~DiagnosticSink() = default;
+  // May be called from the executor's threads. message has no trailing
+  // newline but may contain several lines (e.g. a map dump).
+  virtual void write(LogLevel level, const std::string& message) = 0;
+};
+
+class Diagnostics {
+ public:
+  // nullptr drops everything. The sink must outlive any generation.
+  static void setSink(DiagnosticSink* sink);
+  static DiagnosticSink* getSink();
+
+  // Run-time minimum level (on top of CAVE_LOG_LEVEL). Defaults to Trace,
+  // i.e. whatever was compiled in.
+  static void setLevel(LogLevel level);
+  static bool isEnabled(LogLevel level);
+
+  static void write(LogLevel level, const std::string& message);
+};
+
+}  // namespace Cave
+
+#endif
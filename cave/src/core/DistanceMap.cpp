@@ -0,0 +1,97 @@
+#include "DistanceMap.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "Cave.h"
+#include "Trace.h"
+
+namespace Cave {
+
+namespace {
+
+const Vector2i DIRS[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+constexpr uint8_t NO_FLOW = 0xff;
+
+}  // namespace
+
+void DistanceMap::build(const TileMap& tileMap, Vector2i start) {
+  CAVE_TRACE_SCOPE("DistanceMap::build");
+  // The map has a one cell border all round
+  mHeight = std::max(0, (int)tileMap.size() - 2);
+  mWidth = mHeight > 0 ? std::max(0, (int)tileMap[0].size() - 2) : 0;
+  mDistance.assign((size_t)mWidth * mHeight, -1);
+  mFlow.assign(mDistance.size(), NO_FLOW);
+  mMaxDistance = 0;
+  mNumReachable = 0;
+  mStart = start;
+  mExit = start;
+  if (mDistance.empty()) {
+    return;
+  }
+  mStart = findNearestFloor(tileMap, start);
+  mExit = mStart;
+  if (!Cave::isEmpty(tileMap, mStart.x, mStart.y)) {
+    return;  // No floor at all
+  }
+
+  // Breadth first, so the last cell out of the queue is one of the
+  // farthest
+  mQueue.clear();
+  mQueue.push_back(mStart);
+  mDistance[index(mStart.x, mStart.y)] = 0;
+  for (size_t next = 0; next < mQueue.size(); ++next) {
+    const Vector2i cell = mQueue[next];
+    const int dist = mDistance[index(cell.x, cell.y)];
+    for (int d = 0; d < 4; ++d) {
+      const int nx = cell.x + DIRS[d].x;
+      const int ny = cell.y + DIRS[d].y;
+      if (nx < 0 || ny < 0 || nx >= mWidth || ny >= mHeight ||
+          mDistance[index(nx, ny)] >= 0 || !Cave::isEmpty(tileMap, nx, ny)) {
+        continue;
+      }
+      mDistance[index(nx, ny)] = dist + 1;
+      // DIRS come in opposite pairs, so d ^ 1 steps back to the cell
+      mFlow[index(nx, ny)] = (uint8_t)(d ^ 1);
+      mQueue.push_back({nx, ny});
+    }
+  }
+  mExit = mQueue.back();
+  mMaxDistance = mDistance[index(mExit.x, mExit.y)];
+  mNumReachable = (int)mQueue.size();
+}
+
+Vector2i DistanceMap::getFlow(int cx, int cy) const {
+  if (cx < 0 || cy < 0 || cx >= mWidth || cy >= mHeight) {
+    return {0, 0};
+  }
+  const uint8_t flow = mFlow[index(cx, cy)];
+  return flow == NO_FLOW ? Vector2i{0, 0} : DIRS[flow];
+}
+
+Vector2i DistanceMap::findNearestFloor(const TileMap& tileMap,
+                                       Vector2i cell) const {
+  cell.x = std::min(std::max(cell.x, 0), mWidth - 1);
+  cell.y = std::min(std::max(cell.y, 0), mHeight - 1);
+  // Out in diamonds, top to bottom and left to right round each
+  const int farthest = mWidth + mHeight;
+  for (int steps = 0; steps <= farthest; ++steps) {
+    for (int dy = -steps; dy <= steps; ++dy) {
+      const int dx = steps - std::abs(dy);
+      const int cy = cell.y + dy;
+      if (cy < 0 || cy >= mHeight) {
+        continue;
+      }
+      if (cell.x - dx >= 0 && Cave::isEmpty(tileMap, cell.x - dx, cy)) {
+        return {cell.x - dx, cy};
+      }
+      if (dx > 0 && cell.x + dx < mWidth &&
+          Cave::isEmpty(tileMap, cell.x + dx, cy)) {
+        return {cell.x + dx, cy};
+      }
+    }
+  }
+  return cell;
+}
+
+}  // namespace Cave
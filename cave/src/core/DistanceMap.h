@@ -0,0 +1,67 @@
+#ifndef DISTANCE_MAP_H
+#define DISTANCE_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CaveInfo.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// How far every floor cell is from a start cell, walking to the 4
+// neighbours, and which way to step from each to get back to it (a flow
+// field). The farthest cell that can be reached makes a suggested exit.
+//
+// Floor is anything Cave::isEmpty, so the rounded floor tiles smoothing
+// leaves count too. A start that isn't floor is moved to the nearest cell
+// that is (by steps, ignoring walls, then in a fixed order).
+//
+class DistanceMap {
+ public:
+  DistanceMap() = default;
+  DistanceMap(const TileMap& tileMap, Vector2i start) {
+    build(tileMap, start);
+  }
+
+  void build(const TileMap& tileMap, Vector2i start);
+
+  // Cave coords
+  int getWidth() const { return mWidth; }
+  int getHeight() const { return mHeight; }
+  // Where it was measured from, after moving it onto the floor
+  Vector2i getStart() const { return mStart; }
+  // The farthest cell reached (the start if there's no floor)
+  Vector2i getExit() const { return mExit; }
+  int getMaxDistance() const { return mMaxDistance; }
+  int numReachable() const { return mNumReachable; }
+
+  // -1 for walls, cells that can't be reached and cells outside the map
+  int getDistance(int cx, int cy) const {
+    return (cx >= 0 && cy >= 0 && cx < mWidth && cy < mHeight)
+               ? mDistance[index(cx, cy)]
+               : -1;
+  }
+  // The step towards the start, 0,0 at the start and where there's no way
+  Vector2i getFlow(int cx, int cy) const;
+
+ private:
+  size_t index(int cx, int cy) const { return (size_t)cy * mWidth + cx; }
+  Vector2i findNearestFloor(const TileMap& tileMap, Vector2i cell) const;
+
+  int mWidth = 0;
+  int mHeight = 0;
+  Vector2i mStart;
+  Vector2i mExit;
+  int mMaxDistance = 0;
+  int mNumReachable = 0;
+  std::vector<int> mDistance;
+  std::vector<uint8_t> mFlow;  // Into the DIRS in DistanceMap.cpp, or NO_FLOW
+  std::vector<Vector2i> mQueue;
+};
+
+}  // namespace Cave
+
+#endif
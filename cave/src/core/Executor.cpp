@@ -0,0 +1,211 @@
+#include "Executor.h"
+
+#include <algorithm>
+
+#include "AllocTracker.h"
+
+namespace Cave {
+
+namespace {
+
+// Rows per band below which it isn't worth handing work to another thread
+const int MIN_ROWS_PER_BAND = 16;
+
+std::atomic<Executor*> sDefaultExecutor{nullptr};
+
+// So a task submitted from a worker goes on that worker's own queue
+thread_local const WorkStealingExecutor* tWorkerOwner = nullptr;
+thread_local int tWorkerIndex = -1;
+
+}  // namespace
+
+Executor& Executor::getDefault() {
+  Executor* executor = sDefaultExecutor.load();
+  if (executor) {
+    return *executor;
+  }
+  // NOTE: Deliberately leaked. Joining the workers from a static destructor
+  // can deadlock when the library is unloaded (DllMain on Windows).
+  static WorkStealingExecutor* builtIn = new WorkStealingExecutor();
+  return *builtIn;
+}
+
+void Executor::setDefault(Executor* executor) { sDefaultExecutor = executor; }
+
+/////////////////////////////////////////////////////////////////////////////
+
+void InlineExecutor::run(int count, int /*maxWorkers*/,
+                         const std::function<void(int)>& body) {
+  for (int i = 0; i < count; ++i) {
+    body(i);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void TaskExecutor::run(int count, int maxWorkers,
+                       const std::function<void(int)>& body) {
+  int workers = concurrency();
+  if (maxWorkers > 0) {
+    workers = std::min(workers, maxWorkers);
+  }
+  workers = std::min(workers, count);
+  if (workers <= 1) {
+    for (int i = 0; i < count; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  //
+  // The state is shared with the helpers so a helper that only gets to run
+  // after we've returned just finds nothing left to claim.
+  //
+  struct State {
+    std::function<void(int)> body;
+    int count = 0;
+    std::atomic<int> next{0};
+    std::atomic<int> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto state = std::make_shared<State>();
+  state->body = body;
+  state->count = count;
+
+  auto claimWork = [](State& s) {
+    for (int i = s.next++; i < s.count; i = s.next++) {
+      s.body(i);
+      if (++s.done == s.count) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.finished.notify_all();
+      }
+    }
+  };
+
+  for (int w = 1; w < workers; ++w) {
+    submit([state, claimWork] { claimWork(*state); });
+  }
+  claimWork(*state);
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&] { return state->done == state->count; });
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+FunctionExecutor::FunctionExecutor(std::function<void(Task)> submitFn,
+                                   int concurrency)
+    : mSubmitFn(std::move(submitFn)), mConcurrency(std::max(1, concurrency)) {}
+
+/////////////////////////////////////////////////////////////////////////////
+
+WorkStealingExecutor::WorkStealingExecutor(int numThreads) {
+  if (numThreads <= 0) {
+    numThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+  }
+  for (int i = 0; i < numThreads; ++i) {
+    mQueues.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 0; i < numThreads; ++i) {
+    mThreads.emplace_back(&WorkStealingExecutor::workerLoop, this, i);
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mWakeMutex);
+    mStop = true;
+  }
+  mWake.notify_all();
+  for (auto& thread : mThreads) {
+    thread.join();
+  }
+}
+
+void WorkStealingExecutor::submit(Task task) {
+  int index = (tWorkerOwner == this)
+                  ? tWorkerIndex
+                  : (int)(mNextQueue++ % mQueues.size());
+  {
+    std::lock_guard<std::mutex> lock(mQueues[index]->mutex);
+    mQueues[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mWakeMutex);
+    ++mPending;
+  }
+  mWake.notify_one();
+}
+
+bool WorkStealingExecutor::popTask(int index, Task& task) {
+  // Newest from our own queue first (it's still warm in cache)
+  {
+    Queue& own = *mQueues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  // Then steal the oldest from someone else
+  const int numQueues = (int)mQueues.size();
+  for (int i = 1; i < numQueues; ++i) {
+    Queue& victim = *mQueues[(index + i) % numQueues];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingExecutor::workerLoop(int index) {
+  tWorkerOwner = this;
+  tWorkerIndex = index;
+  for (;;) {
+    Task task;
+    if (popTask(index, task)) {
+      --mPending;
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mWakeMutex);
+    mWake.wait(lock, [&] { return mStop || mPending > 0; });
+    if (mStop && mPending <= 0) {
+      return;
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int numRowBands(Executor& executor, int numRows, int maxWorkers) {
+  int workers = executor.concurrency();
+  if (maxWorkers > 0) {
+    workers = std::min(workers, maxWorkers);
+  }
+  if (workers <= 1) {
+    return 1;
+  }
+  // A few bands per worker so a slow band doesn't leave the others idle
+  return std::max(1, std::min(workers * 4, numRows / MIN_ROWS_PER_BAND));
+}
+
+void runRowBands(Executor& executor, int numRows, int numBands,
+                 int maxWorkers, const std::function<void(int, int)>& fn) {
+  const int bandRows = (numRows + numBands - 1) / numBands;
+  numBands = (numRows + bandRows - 1) / bandRows;
+  // Charge the workers' allocations to the caller's stage
+  AllocCounters* counters = AllocTracker::current();
+  executor.run(numBands, maxWorkers, [&](int band) {
+    AllocScope allocScope(counters);
+    const int rowBegin = band * bandRows;
+    fn(rowBegin, std::min(numRows, rowBegin + bandRows));
+  });
+}
+
+}  // namespace Cave
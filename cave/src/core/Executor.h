@@ -0,0 +1,139 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Cave {
+
+//
+// All parallel work in Cave and CaveSmoother goes through an Executor so
+// the library never competes with the host's own threads. A host either
+// implements Executor directly (e.g. on top of Godot's WorkerThreadPool
+// group tasks), wraps its job system's "submit" in a FunctionExecutor, or
+// uses the built-in WorkStealingExecutor.
+//
+class Executor {
+ public:
+  virtual ~Executor() {}
+
+  // Max number of bodies that can usefully run at once (including the
+  // calling thread)
+  virtual int concurrency() const = 0;
+
+  // Call body(i) for every i in [0, count) using at most maxWorkers
+  // threads (0 = no cap) and return once all of them have finished.
+  virtual void run(int count, int maxWorkers,
+                   const std::function<void(int)>& body) = 0;
+
+  // Executor used when none has been given to Cave. Unless replaced with
+  // setDefault this is a WorkStealingExecutor created on first use.
+  static Executor& getDefault();
+  static void setDefault(Executor* executor);
+};
+
+//
+// Runs everything on the calling thread
+//
+class InlineExecutor : public Executor {
+ public:
+  int concurrency() const override { return 1; }
+  void run(int count, int maxWorkers,
+           const std::function<void(int)>& body) override;
+};
+
+//
+// Base for executors that can only queue fire-and-forget tasks. The calling
+// thread claims work alongside the queued helpers, so run() still completes
+// if the pool is saturated and the helpers start late (or never).
+//
+class TaskExecutor : public Executor {
+ public:
+  using Task = std::function<void()>;
+  virtual void submit(Task task) = 0;
+
+  void run(int count, int maxWorkers,
+           const std::function<void(int)>& body) override;
+};
+
+//
+// Adapts an external pool e.g. a game job system
+//
+class FunctionExecutor : public TaskExecutor {
+ public:
+  FunctionExecutor(std::function<void(Task)> submitFn, int concurrency);
+
+  int concurrency() const override { return mConcurrency; }
+  void submit(Task task) override { mSubmitFn(std::move(task)); }
+
+ private:
+  std::function<void(Task)> mSubmitFn;
+  int mConcurrency;
+};
+
+//
+// Built-in pool. Each worker has its own deque, pops from the back of it
+// and steals from the front of the others when it runs dry.
+//
+class WorkStealingExecutor : public TaskExecutor {
+ public:
+  // 0 = one less than the hardware threads (the caller makes up the rest)
+  explicit WorkStealingExecutor(int numThreads = 0);
+  ~WorkStealingExecutor();
+
+  int concurrency() const override { return (int)mThreads.size() + 1; }
+  void submit(Task task) override;
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void workerLoop(int index);
+  bool popTask(int index, Task& task);
+
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::vector<std::thread> mThreads;
+  std::mutex mWakeMutex;
+  std::condition_variable mWake;
+  std::atomic<int> mPending{0};
+  std::atomic<unsigned> mNextQueue{0};
+  bool mStop = false;
+};
+
+// How many bands parallelForRows splits numRows into (1 = not worth it)
+int numRowBands(Executor& executor, int numRows, int maxWorkers);
+
+// Run fn(rowBegin, rowEnd) for each of numBands bands on the executor
+void runRowBands(Executor& executor, int numRows, int numBands,
+                 int maxWorkers, const std::function<void(int, int)>& fn);
+
+//
+// Split rows [0, numRows) into bands and call fn(rowBegin, rowEnd) for each
+// band on the executor. Small maps, and a single worker, aren't worth the
+// hand-off so are run on the calling thread. That doesn't wrap fn in a
+// std::function, so allocates nothing.
+//
+template <typename Fn>
+void parallelForRows(Executor& executor, int numRows, int maxWorkers,
+                     const Fn& fn) {
+  const int numBands = numRowBands(executor, numRows, maxWorkers);
+  if (numBands <= 1) {
+    if (numRows > 0) {
+      fn(0, numRows);
+    }
+    return;
+  }
+  runRowBands(executor, numRows, numBands, maxWorkers, fn);
+}
+
+}  // namespace Cave
+
+#endif
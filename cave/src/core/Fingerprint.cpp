@@ -0,0 +1,233 @@
+#include "Fingerprint.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace Cave {
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const int LANES = 4;
+
+// Final avalanche (from MurmurHash3's fmix64)
+uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64_t hashRow(const int* cells, size_t count) {
+  uint64_t lanes[LANES] = {PRIME1, PRIME2, PRIME3, PRIME1 ^ PRIME2};
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    for (int l = 0; l < LANES; ++l) {
+      lanes[l] = (lanes[l] ^ (uint32_t)cells[i + l]) * PRIME1;
+    }
+  }
+  uint64_t h = count * PRIME3;
+  for (int l = 0; l < LANES; ++l) {
+    h = mix(h ^ lanes[l]);
+  }
+  for (; i < count; ++i) {
+    h = (h ^ (uint32_t)cells[i]) * PRIME2;
+  }
+  return mix(h);
+}
+
+// Fed one value at a time so the result doesn't depend on struct layout
+class InputHasher {
+ public:
+  void add(uint64_t value) { mHash = mix((mHash ^ value) * PRIME1 + PRIME3); }
+  void addInt(int value) { add((uint32_t)value); }
+  void addBool(bool value) { add(value ? 1 : 0); }
+  void addFloat(float value) {
+    if (value == 0) {
+      value = 0;  // -0.0 == 0.0
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    add(bits);
+  }
+  uint64_t get() const { return mHash; }
+
+ private:
+  uint64_t mHash = PRIME2;
+};
+
+}  // namespace
+
+uint64_t fingerprint(const TileMap& tileMap) {
+  const size_t width = tileMap.empty() ? 0 : tileMap[0].size();
+  uint64_t h = mix(tileMap.size() * PRIME1 + width * PRIME2);
+  for (const auto& row : tileMap) {
+    h = mix((h ^ hashRow(row.data(), row.size())) * PRIME3);
+  }
+  return h;
+}
+
+namespace {
+
+void addNoiseInputs(InputHasher& h, const CaveInfo& info,
+                    const GenerationParams& params) {
+  h.addInt(info.mCaveWidth);
+  h.addInt(info.mCaveHeight);
+  h.addInt(params.seed);
+  h.addBool(params.mPerlin);
+  if (params.mPerlin) {
+    h.addInt(params.mOctaves);
+    h.addFloat(params.mFreq);
+    h.addFloat(params.mAmp);
+  } else {
+    h.addFloat(params.mWallChance);
+  }
+}
+
+void addStep(InputHasher& h, const GenerationStep& gen) {
+  for (int value : {gen.b3_min, gen.b3_max, gen.b5_min, gen.b5_max,
+                    gen.s3_min, gen.s3_max, gen.s5_min, gen.s5_max,
+                    gen.reps}) {
+    h.addInt(value);
+  }
+}
+
+// Only if used, so hashes without it are as they were
+void addMultiresInputs(InputHasher& h, const GenerationParams& params) {
+  if (params.mCoarseLevels <= 0) {
+    return;
+  }
+  h.addInt(params.mCoarseLevels);
+  for (const auto* steps :
+       {&params.mCoarseGenerations, &params.mRefineGenerations}) {
+    h.add(steps->size());
+    for (const auto& gen : *steps) {
+      addStep(h, gen);
+    }
+  }
+}
+
+}  // namespace
+
+uint64_t hashInputs(const CaveInfo& info, const GenerationParams& params) {
+  InputHasher h;
+  h.add(GENERATOR_VERSION);
+  h.addInt(info.mCaveWidth);
+  h.addInt(info.mCaveHeight);
+  // Same precedence as CaveSmoother::smooth
+  h.addBool(info.mSmoothing);
+  if (info.mSmoothing) {
+    h.addBool(info.mSmoothCorners);
+    h.addBool(info.mSmoothPoints);
+  } else {
+    h.addBool(info.mRemoveDiagonals);
+  }
+  h.addInt(params.seed);
+  h.addBool(params.mPerlin);
+  if (params.mPerlin) {
+    h.addInt(params.mOctaves);
+    h.addFloat(params.mFreq);
+    h.addFloat(params.mAmp);
+  } else {
+    h.addFloat(params.mWallChance);
+  }
+  h.add(params.mGenerations.size());
+  for (const auto& gen : params.mGenerations) {
+    addStep(h, gen);
+  }
+  addMultiresInputs(h, params);
+  return h.get();
+}
+
+uint64_t hashStageInputs(const CaveInfo& info, const GenerationParams& params,
+                         int stage) {
+  InputHasher h;
+  h.add(GENERATOR_VERSION);
+  h.addInt(stage);
+  addNoiseInputs(h, info, params);
+  addMultiresInputs(h, params);
+  const int numSteps = (int)params.mGenerations.size();
+  for (int i = 0; i < std::min(stage, numSteps); ++i) {
+    addStep(h, params.mGenerations[i]);
+  }
+  if (stage > numSteps) {
+    h.add(params.mGenerations.size());  // The CA is finished
+  }
+  return h.get();
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t lanes[LANES] = {seed + PRIME1, seed + PRIME2, seed + PRIME3,
+                           seed ^ PRIME1 ^ PRIME2};
+  size_t i = 0;
+  for (; i + LANES * 8 <= size; i += LANES * 8) {
+    for (int l = 0; l < LANES; ++l) {
+      uint64_t word;
+      std::memcpy(&word, bytes + i + l * 8, sizeof(word));
+      lanes[l] = (lanes[l] ^ word) * PRIME1;
+    }
+  }
+  uint64_t h = size * PRIME3;
+  for (int l = 0; l < LANES; ++l) {
+    h = mix(h ^ lanes[l]);
+  }
+  for (; i < size; ++i) {
+    h = (h ^ bytes[i]) * PRIME2;
+  }
+  return mix(h);
+}
+
+BytesHasher::BytesHasher(uint64_t seed)
+    : mLanes{seed + PRIME1, seed + PRIME2, seed + PRIME3,
+             seed ^ PRIME1 ^ PRIME2} {
+  static_assert(BLOCK == LANES * 8, "BytesHasher block isn't a word a lane");
+}
+
+void BytesHasher::add(const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  mSize += size;
+  auto addBlock = [&](const unsigned char* block) {
+    for (int l = 0; l < LANES; ++l) {
+      uint64_t word;
+      std::memcpy(&word, block + l * 8, sizeof(word));
+      mLanes[l] = (mLanes[l] ^ word) * PRIME1;
+    }
+  };
+  // Top up a part block left from last time
+  if (mPendingBytes > 0) {
+    const size_t take = std::min(size, BLOCK - mPendingBytes);
+    std::memcpy(mPending + mPendingBytes, bytes, take);
+    mPendingBytes += take;
+    bytes += take;
+    size -= take;
+    if (mPendingBytes < (size_t)BLOCK) {
+      return;
+    }
+    addBlock(mPending);
+    mPendingBytes = 0;
+  }
+  for (; size >= (size_t)BLOCK; bytes += BLOCK, size -= BLOCK) {
+    addBlock(bytes);
+  }
+  std::memcpy(mPending, bytes, size);
+  mPendingBytes = size;
+}
+
+uint64_t BytesHasher::finish() const {
+  uint64_t h = mSize * PRIME3;
+  for (int l = 0; l < LANES; ++l) {
+    h = mix(h ^ mLanes[l]);
+  }
+  for (size_t i = 0; i < mPendingBytes; ++i) {
+    h = (h ^ mPending[i]) * PRIME2;
+  }
+  return mix(h);
+}
+
+}  // namespace Cave
@@ -0,0 +1,69 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "CaveInfo.h"
+#include "GenerationParams.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// 64-bit hash of a map's size and every tile. Used to check that changes
+// to the generator keep the output for existing seeds identical (saved
+// games only store the seed).
+//
+// The value is the same on every platform. Rows are hashed in four
+// independent lanes so the inner loop vectorises.
+//
+uint64_t fingerprint(const TileMap& tileMap);
+
+//
+// 64-bit hash of everything that affects generate()'s output: the size,
+// the smoothing options that apply, the seed, the noise settings, every
+// GenerationStep in order and the multiresolution settings if used.
+// Options that are ignored (e.g. mSmoothCorners without mSmoothing) and
+// fields that don't change the map (border, cell size, layer) are left
+// out, so equivalent inputs hash the same.
+//
+// GENERATOR_VERSION is mixed in. Bump it when a change to the generator is
+// meant to change its output, so saved files and caches are invalidated.
+//
+const uint32_t GENERATOR_VERSION = 1;
+uint64_t hashInputs(const CaveInfo& info, const GenerationParams& params);
+
+//
+// Hash of the inputs that affect the map part way through generate():
+// stage 0 is after initialise, 1 to n after each of the n GenerationSteps
+// and n + 1 after joinRooms (the smoothing options only matter after that).
+// Used to key Workspace's checkpoints.
+//
+uint64_t hashStageInputs(const CaveInfo& info, const GenerationParams& params,
+                         int stage);
+
+// General purpose 64-bit hash of a block of bytes (e.g. file checksums)
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+//
+// hashBytes of bytes given a piece at a time (e.g. a file written a row at
+// a time). finish() is the same as hashBytes of all of them together.
+//
+class BytesHasher {
+ public:
+  explicit BytesHasher(uint64_t seed = 0);
+  void add(const void* data, size_t size);
+  uint64_t finish() const;
+
+ private:
+  static const int BLOCK = 32;  // A word for each of the 4 lanes
+  uint64_t mLanes[4];
+  unsigned char mPending[BLOCK];
+  size_t mPendingBytes = 0;
+  uint64_t mSize = 0;
+};
+
+}  // namespace Cave
+
+#endif
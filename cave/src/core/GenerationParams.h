@@ -21,6 +21,18 @@ struct GenerationParams {
     float mFreq = 1;
     float mAmp = 1;
     std::vector<GenerationStep> mGenerations;
+
+    //
+    // Multiresolution: with mCoarseLevels > 0 the noise and the CA start on
+    // the map halved in size that many times, running mCoarseGenerations
+    // (mGenerations if empty). Each level up doubles it (a cell becoming
+    // 2x2) and runs mRefineGenerations (if empty, one rep of a majority
+    // rule that rounds off the blocks). Structure forms at the coarse size
+    // for a fraction of the cost of running every rep at full size.
+    //
+    int mCoarseLevels = 0;
+    std::vector<GenerationStep> mCoarseGenerations;
+    std::vector<GenerationStep> mRefineGenerations;
 };
 
 }
@@ -0,0 +1,141 @@
+#ifndef GENERATION_STATS_H
+#define GENERATION_STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AllocTracker.h"
+
+namespace Cave {
+
+struct StageStats {
+  double mMillis = 0;  // Wall-clock time spent in the stage
+
+  // Only filled in with CAVE_ALLOC_TRACKING (see AllocTracker.h)
+  size_t mAllocCount = 0;
+  size_t mAllocBytes = 0;
+  size_t mPeakLiveBytes = 0;  // High-water mark above the start of the stage
+};
+
+//
+// Filled in by Cave::generate when asked for. Stages that didn't run
+// (e.g. the smoothing passes when mSmoothing is false) are left as zero.
+//
+struct GenerationStats {
+  StageStats mTotal;
+  StageStats mInitialise;
+  StageStats mCellularAutomata;
+  StageStats mFixUp;
+  StageStats mFindRooms;
+  StageStats mDetectBorderWalls;
+  StageStats mFindMST;
+  StageStats mCarveTunnels;
+  StageStats mSmoothEdges;
+  StageStats mSmoothCorners;
+  StageStats mSmoothPoints;
+  StageStats mRemoveDiagonals;
+  StageStats mWallDistance;  // With Cave::setWallDistance
+  StageStats mPathGraph;     // With Cave::setPathGraph
+  StageStats mRoomGraph;     // With Cave::setRoomGraph
+  StageStats mDistanceMap;   // With Cave::setDistanceMap
+
+  // The part of the stages above spent in the Libs' cellular automata
+  // (PCG::RogueCave) and DisjointSets, the loops feeding them included.
+  // They allocate their own storage every generation (see Workspace.h) so
+  // this tells their allocations apart from Cave's.
+  StageStats mLibs;
+
+  int mFixUpIterations = 0;
+  int mRooms = 0;
+  int mBorderWalls = 0;  // Candidates found by detectBorderWalls
+  int mMSTEdges = 0;     // i.e. tunnels carved
+  int mEdgeTilesChanged = 0;
+  int mCornerTilesChanged = 0;
+  int mPointTilesChanged = 0;
+  int mDiagonalTilesChanged = 0;
+
+  // The Workspace checkpoint generation started from (-1 = none). The
+  // stages before it didn't run, so their times are zero.
+  int mCheckpoint = -1;
+
+  // With a row sink (Cave::setRowSink), the time from the start of
+  // generation until the first row was given to it
+  double mFirstRowMillis = 0;
+
+  // Approximate high-water mark of the map plus the scratch buffers that
+  // were live at the same time (container overheads are estimated)
+  size_t mPeakScratchBytes = 0;
+
+  // Set mRecordFingerprints before calling generate() to also get the
+  // fingerprint (see Fingerprint.h) of the map after each stage
+  struct StageFingerprint {
+    const char* mStage;
+    uint64_t mFingerprint;
+  };
+  bool mRecordFingerprints = false;
+  std::vector<StageFingerprint> mFingerprints;
+
+  void noteScratch(size_t bytes) {
+    mPeakScratchBytes = std::max(mPeakScratchBytes, bytes);
+  }
+};
+
+//
+// Adds the time (and allocations, if tracked) from construction to
+// destruction to a stage
+//
+class StageTimer {
+ public:
+  explicit StageTimer(StageStats& stage)
+      : mStage(stage),
+        mStart(std::chrono::steady_clock::now()),
+        mAllocScope(initCounters()) {}
+  ~StageTimer() {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - mStart;
+    mStage.mMillis += elapsed.count();
+    if (AllocTracker::isEnabled()) {
+      mStage.mAllocCount += mCounters.count;
+      mStage.mAllocBytes += mCounters.bytes;
+      mStage.mPeakLiveBytes =
+          std::max(mStage.mPeakLiveBytes, (size_t)mCounters.peakLive.load());
+    }
+  }
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+ private:
+  AllocCounters* initCounters() {
+    mCounters.parent = AllocTracker::current();
+    return &mCounters;
+  }
+
+  StageStats& mStage;
+  std::chrono::steady_clock::time_point mStart;
+  AllocCounters mCounters;
+  AllocScope mAllocScope;
+};
+
+template <typename T>
+size_t gridBytes(const std::vector<std::vector<T>>& grid) {
+  size_t bytes = grid.capacity() * sizeof(std::vector<T>);
+  for (const auto& row : grid) {
+    bytes += row.capacity() * sizeof(T);
+  }
+  return bytes;
+}
+
+inline size_t gridBytes(const std::vector<std::vector<bool>>& grid) {
+  size_t bytes = grid.capacity() * sizeof(std::vector<bool>);
+  for (const auto& row : grid) {
+    bytes += row.capacity() / 8;
+  }
+  return bytes;
+}
+
+}  // namespace Cave
+
+#endif
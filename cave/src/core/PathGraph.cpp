@@ -0,0 +1,416 @@
+#include "PathGraph.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <utility>
+
+#include "Cave.h"
+#include "Trace.h"
+
+namespace Cave {
+
+namespace {
+
+const Vector2i DIRS[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+// Runs of floor across a cluster edge this long or longer get an entrance
+// at each end rather than one in the middle
+constexpr int ENTRANCE_SPLIT_LENGTH = 6;
+
+int distance(Vector2i a, Vector2i b) {
+  return std::abs(a.x - b.x) + std::abs(a.y - b.y);
+}
+
+}  // namespace
+
+void PathGraph::build(const TileMap& tileMap, Executor* executor,
+                      int maxWorkers) {
+  CAVE_TRACE_SCOPE("PathGraph::build");
+  // The map has a one cell border all round
+  mHeight = std::max(0, (int)tileMap.size() - 2);
+  mWidth = mHeight > 0 ? std::max(0, (int)tileMap[0].size() - 2) : 0;
+  mFloor.assign((size_t)mWidth * mHeight, 0);
+  for (int cy = 0; cy < mHeight; ++cy) {
+    for (int cx = 0; cx < mWidth; ++cx) {
+      mFloor[(size_t)cy * mWidth + cx] = Cave::isEmpty(tileMap, cx, cy);
+    }
+  }
+
+  mClustersWide = (mWidth + mClusterSize - 1) / mClusterSize;
+  mClustersHigh = (mHeight + mClusterSize - 1) / mClusterSize;
+  mClusters.assign((size_t)mClustersWide * mClustersHigh, Cluster());
+  for (int y = 0; y < mClustersHigh; ++y) {
+    for (int x = 0; x < mClustersWide; ++x) {
+      Rect2i& rect = mClusters[(size_t)y * mClustersWide + x].rect;
+      rect.x = x * mClusterSize;
+      rect.y = y * mClusterSize;
+      rect.w = std::min(mClusterSize, mWidth - rect.x);
+      rect.h = std::min(mClusterSize, mHeight - rect.y);
+    }
+  }
+  // A cluster's entrances only depend on the map, so they're all
+  // independent
+  parallelForRows(executor ? *executor : Executor::getDefault(),
+                  mClustersHigh, maxWorkers, [&](int rowBegin, int rowEnd) {
+    std::vector<int> dist;
+    std::vector<Vector2i> queue;
+    for (int y = rowBegin; y < rowEnd; ++y) {
+      for (int x = 0; x < mClustersWide; ++x) {
+        buildCluster(y * mClustersWide + x, dist, queue);
+      }
+    }
+  });
+  numberNodes();
+}
+
+void PathGraph::update(const TileMap& tileMap,
+                       const std::vector<Vector2i>& cells) {
+  std::vector<int> dirty;
+  for (const Vector2i& cell : cells) {
+    if (cell.x < 0 || cell.y < 0 || cell.x >= mWidth || cell.y >= mHeight) {
+      continue;
+    }
+    uint8_t& floor = mFloor[(size_t)cell.y * mWidth + cell.x];
+    const uint8_t now = Cave::isEmpty(tileMap, cell.x, cell.y);
+    if (floor == now) {
+      continue;
+    }
+    floor = now;
+    dirty.push_back(clusterAt(cell.x, cell.y));
+    // The entrances on an edge are shared with the next cluster
+    for (const Vector2i& dir : DIRS) {
+      const int nx = cell.x + dir.x;
+      const int ny = cell.y + dir.y;
+      if (nx >= 0 && ny >= 0 && nx < mWidth && ny < mHeight &&
+          clusterAt(nx, ny) != dirty.back()) {
+        dirty.push_back(clusterAt(nx, ny));
+      }
+    }
+  }
+  if (dirty.empty()) {
+    return;
+  }
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+  for (int cluster : dirty) {
+    buildCluster(cluster, mDist, mQueue);
+  }
+  numberNodes();
+}
+
+int PathGraph::findNode(int cluster, Vector2i pos) const {
+  const std::vector<Vector2i>& nodes = mClusters[cluster].nodes;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i] == pos) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+void PathGraph::buildCluster(int index, std::vector<int>& dist,
+                             std::vector<Vector2i>& queue) {
+  Cluster& cluster = mClusters[index];
+  cluster.nodes.clear();
+  const int x = index % mClustersWide;
+  const int y = index / mClustersWide;
+  if (y > 0) {
+    addEntrances(cluster, index - mClustersWide);
+  }
+  if (x > 0) {
+    addEntrances(cluster, index - 1);
+  }
+  if (x + 1 < mClustersWide) {
+    addEntrances(cluster, index + 1);
+  }
+  if (y + 1 < mClustersHigh) {
+    addEntrances(cluster, index + mClustersWide);
+  }
+
+  const size_t numNodes = cluster.nodes.size();
+  cluster.costs.assign(numNodes * numNodes, -1);
+  for (size_t i = 0; i < numNodes; ++i) {
+    searchCluster(cluster, cluster.nodes[i], dist, queue, nullptr);
+    for (size_t j = 0; j < numNodes; ++j) {
+      const Vector2i& to = cluster.nodes[j];
+      cluster.costs[i * numNodes + j] =
+          dist[(size_t)(to.y - cluster.rect.y) * cluster.rect.w + to.x -
+               cluster.rect.x];
+    }
+  }
+}
+
+void PathGraph::addEntrances(Cluster& cluster, int otherCluster) const {
+  // Go along the edge the same way from either side, so both clusters
+  // agree where the entrances are
+  const bool isFirst = &cluster < &mClusters[otherCluster];
+  const Rect2i& first = isFirst ? cluster.rect : mClusters[otherCluster].rect;
+  const bool across = first.y == (isFirst ? mClusters[otherCluster].rect.y
+                                          : cluster.rect.y);
+  const Vector2i step = across ? Vector2i{0, 1} : Vector2i{1, 0};
+  const Vector2i over = across ? Vector2i{1, 0} : Vector2i{0, 1};
+  const Vector2i edge = across ? Vector2i{first.x + first.w - 1, first.y}
+                               : Vector2i{first.x, first.y + first.h - 1};
+  const int length = across ? first.h : first.w;
+
+  auto addEntrance = [&](int i) {
+    Vector2i pos{edge.x + step.x * i, edge.y + step.y * i};
+    if (!isFirst) {
+      pos = {pos.x + over.x, pos.y + over.y};
+    }
+    if (std::find(cluster.nodes.begin(), cluster.nodes.end(), pos) ==
+        cluster.nodes.end()) {
+      cluster.nodes.push_back(pos);
+    }
+  };
+  int runStart = -1;
+  for (int i = 0; i <= length; ++i) {
+    const int cx = edge.x + step.x * i;
+    const int cy = edge.y + step.y * i;
+    const bool open = i < length && isFloor(cx, cy) &&
+                      isFloor(cx + over.x, cy + over.y);
+    if (open && runStart < 0) {
+      runStart = i;
+    } else if (!open && runStart >= 0) {
+      const int runLength = i - runStart;
+      if (runLength < ENTRANCE_SPLIT_LENGTH) {
+        addEntrance(runStart + runLength / 2);
+      } else {
+        addEntrance(runStart);
+        addEntrance(i - 1);
+      }
+      runStart = -1;
+    }
+  }
+}
+
+void PathGraph::searchCluster(const Cluster& cluster, Vector2i from,
+                              std::vector<int>& dist,
+                              std::vector<Vector2i>& queue,
+                              std::vector<Vector2i>* parent) const {
+  const Rect2i& rect = cluster.rect;
+  dist.assign((size_t)rect.w * rect.h, -1);
+  if (parent) {
+    parent->resize(dist.size());
+  }
+  queue.clear();
+  if (!isFloor(from.x, from.y)) {
+    return;
+  }
+  dist[(size_t)(from.y - rect.y) * rect.w + from.x - rect.x] = 0;
+  queue.push_back(from);
+  for (size_t next = 0; next < queue.size(); ++next) {
+    const Vector2i cell = queue[next];
+    const int cellDist =
+        dist[(size_t)(cell.y - rect.y) * rect.w + cell.x - rect.x];
+    for (const Vector2i& dir : DIRS) {
+      const int nx = cell.x + dir.x;
+      const int ny = cell.y + dir.y;
+      if (nx < rect.x || ny < rect.y || nx >= rect.x + rect.w ||
+          ny >= rect.y + rect.h || !isFloor(nx, ny)) {
+        continue;
+      }
+      const size_t index = (size_t)(ny - rect.y) * rect.w + nx - rect.x;
+      if (dist[index] < 0) {
+        dist[index] = cellDist + 1;
+        if (parent) {
+          (*parent)[index] = cell;
+        }
+        queue.push_back({nx, ny});
+      }
+    }
+  }
+}
+
+void PathGraph::numberNodes() {
+  mFirstNode.resize(mClusters.size() + 1);
+  mNodeCluster.clear();
+  mNodePos.clear();
+  for (size_t i = 0; i < mClusters.size(); ++i) {
+    mFirstNode[i] = (int)mNodePos.size();
+    for (const Vector2i& pos : mClusters[i].nodes) {
+      mNodeCluster.push_back((int)i);
+      mNodePos.push_back(pos);
+    }
+  }
+  mFirstNode[mClusters.size()] = (int)mNodePos.size();
+}
+
+int PathGraph::findWaypoints(Vector2i from, Vector2i to,
+                             std::vector<Vector2i>& waypoints) {
+  waypoints.clear();
+  if (!isFloor(from.x, from.y) || !isFloor(to.x, to.y)) {
+    return -1;
+  }
+  if (from == to) {
+    waypoints.push_back(from);
+    return 0;
+  }
+
+  // The start and goal go on the end of the nodes, joined to the nodes of
+  // their clusters (and each other) by searches of those
+  const int start = numNodes();
+  const int goal = start + 1;
+  const int startCluster = clusterAt(from.x, from.y);
+  const int goalCluster = clusterAt(to.x, to.y);
+  auto costsFrom = [&](int index, Vector2i pos, std::vector<int>& costs) {
+    const Cluster& cluster = mClusters[index];
+    searchCluster(cluster, pos, mDist, mQueue, nullptr);
+    costs.clear();
+    for (const Vector2i& node : cluster.nodes) {
+      costs.push_back(mDist[(size_t)(node.y - cluster.rect.y) *
+                                cluster.rect.w +
+                            node.x - cluster.rect.x]);
+    }
+  };
+  costsFrom(goalCluster, to, mGoalCosts);
+  costsFrom(startCluster, from, mStartCosts);
+  // mDist is still from the start
+  const int direct =
+      startCluster == goalCluster
+          ? mDist[(size_t)(to.y - mClusters[startCluster].rect.y) *
+                      mClusters[startCluster].rect.w +
+                  to.x - mClusters[startCluster].rect.x]
+          : -1;
+
+  mCost.resize(goal + 1);
+  mFrom.resize(goal + 1);
+  mVisitStamp.resize(goal + 1, 0);
+  if (++mVisitEpoch == 0) {
+    std::fill(mVisitStamp.begin(), mVisitStamp.end(), 0);
+    mVisitEpoch = 1;
+  }
+  // A* by cost plus the distance left
+  using Entry = std::pair<int, int>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+  auto reach = [&](int node, Vector2i pos, int cost, int via) {
+    if (mVisitStamp[node] != mVisitEpoch || cost < mCost[node]) {
+      mVisitStamp[node] = mVisitEpoch;
+      mCost[node] = cost;
+      mFrom[node] = via;
+      open.push({cost + distance(pos, to), node});
+    }
+  };
+  reach(start, from, 0, -1);
+  while (!open.empty()) {
+    const Entry entry = open.top();
+    open.pop();
+    const int node = entry.second;
+    const Vector2i pos = node == start  ? from
+                         : node == goal ? to
+                                        : mNodePos[node];
+    const int cost = mCost[node];
+    if (entry.first != cost + distance(pos, to)) {
+      continue;  // Since reached more cheaply
+    }
+    if (node == goal) {
+      break;
+    }
+    if (node == start) {
+      const int first = mFirstNode[startCluster];
+      for (size_t i = 0; i < mStartCosts.size(); ++i) {
+        if (mStartCosts[i] >= 0) {
+          reach(first + (int)i, mNodePos[first + i], mStartCosts[i], start);
+        }
+      }
+      if (direct >= 0) {
+        reach(goal, to, direct, start);
+      }
+      continue;
+    }
+    const int index = mNodeCluster[node];
+    const Cluster& cluster = mClusters[index];
+    const int first = mFirstNode[index];
+    const int i = node - first;
+    const size_t numNodes = cluster.nodes.size();
+    for (size_t j = 0; j < numNodes; ++j) {
+      const int step = cluster.costs[i * numNodes + j];
+      if (step > 0) {
+        reach(first + (int)j, cluster.nodes[j], cost + step, node);
+      }
+    }
+    if (index == goalCluster && mGoalCosts[i] >= 0) {
+      reach(goal, to, cost + mGoalCosts[i], node);
+    }
+    for (const Vector2i& dir : DIRS) {
+      const Vector2i next{pos.x + dir.x, pos.y + dir.y};
+      if (!isFloor(next.x, next.y)) {
+        continue;
+      }
+      const int nextCluster = clusterAt(next.x, next.y);
+      if (nextCluster == index) {
+        continue;
+      }
+      const int j = findNode(nextCluster, next);
+      if (j >= 0) {
+        reach(mFirstNode[nextCluster] + j, next, cost + 1, node);
+      }
+    }
+  }
+  if (mVisitStamp[goal] != mVisitEpoch) {
+    return -1;
+  }
+
+  for (int node = goal; node >= 0; node = mFrom[node]) {
+    const Vector2i pos = node == start  ? from
+                         : node == goal ? to
+                                        : mNodePos[node];
+    // The start or goal can be a node too
+    if (waypoints.empty() || !(waypoints.back() == pos)) {
+      waypoints.push_back(pos);
+    }
+  }
+  std::reverse(waypoints.begin(), waypoints.end());
+  return mCost[goal];
+}
+
+bool PathGraph::refine(Vector2i from, Vector2i to,
+                       std::vector<Vector2i>& cells) {
+  if (from == to) {
+    return true;
+  }
+  if (!isFloor(from.x, from.y) || !isFloor(to.x, to.y)) {
+    return false;
+  }
+  const int index = clusterAt(from.x, from.y);
+  if (clusterAt(to.x, to.y) != index) {
+    // Across an entrance
+    if (distance(from, to) != 1) {
+      return false;
+    }
+    cells.push_back(to);
+    return true;
+  }
+  const Cluster& cluster = mClusters[index];
+  const Rect2i& rect = cluster.rect;
+  searchCluster(cluster, from, mDist, mQueue, &mParent);
+  if (mDist[(size_t)(to.y - rect.y) * rect.w + to.x - rect.x] < 0) {
+    return false;
+  }
+  const size_t begin = cells.size();
+  for (Vector2i cell = to; !(cell == from);
+       cell = mParent[(size_t)(cell.y - rect.y) * rect.w + cell.x - rect.x]) {
+    cells.push_back(cell);
+  }
+  std::reverse(cells.begin() + begin, cells.end());
+  return true;
+}
+
+int PathGraph::findPath(Vector2i from, Vector2i to,
+                        std::vector<Vector2i>* path) {
+  const int cost = findWaypoints(from, to, mWaypoints);
+  if (path) {
+    path->clear();
+    if (cost >= 0) {
+      path->push_back(from);
+      for (size_t i = 1; i < mWaypoints.size(); ++i) {
+        refine(mWaypoints[i - 1], mWaypoints[i], *path);
+      }
+    }
+  }
+  return cost;
+}
+
+}  // namespace Cave
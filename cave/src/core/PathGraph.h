@@ -0,0 +1,133 @@
+#ifndef PATH_GRAPH_H
+#define PATH_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CaveInfo.h"
+#include "Executor.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// Hierarchical path finding (HPA*) over the floor of a map, for long paths
+// across big caves where A* over every cell is too slow.
+//
+// The map is cut into square clusters. Where a run of floor crosses from
+// one cluster into the next, an entrance is made: a node each side of the
+// middle of the run, or of both ends if it's long. Within a cluster, each
+// pair of nodes is joined by the length of the shortest path between them
+// that stays inside it. A query joins the start and goal to the nodes of
+// their clusters, searches this small graph, then (on demand) refines each
+// leg into cells with a search of one cluster.
+//
+// Moves are to the 4 neighbours, a cell each, and floor is anything
+// Cave::isEmpty, as in CaveConnectivity. The paths found are at most a
+// little longer than the shortest, as they have to go through entrances.
+//
+// Queries use scratch buffers, so one PathGraph can't be searched by two
+// threads at once.
+//
+class PathGraph {
+ public:
+  static constexpr int DEFAULT_CLUSTER_SIZE = 16;
+
+  explicit PathGraph(int clusterSize = DEFAULT_CLUSTER_SIZE)
+      : mClusterSize(clusterSize) {}
+
+  // Each cluster is built on the given executor (nullptr = the default)
+  void build(const TileMap& tileMap, Executor* executor = nullptr,
+             int maxWorkers = 0);
+
+  //
+  // Bring the given cells up to date with the map, e.g. the cells
+  // Cave::editCells reports as changed. Rebuilds the clusters they're in,
+  // and the next cluster over for cells on the edge of one.
+  //
+  void update(const TileMap& tileMap, const std::vector<Vector2i>& cells);
+
+  // Cave coords
+  int getWidth() const { return mWidth; }
+  int getHeight() const { return mHeight; }
+  int getClusterSize() const { return mClusterSize; }
+  int numNodes() const { return (int)mNodePos.size(); }
+  bool isFloor(int cx, int cy) const {
+    return cx >= 0 && cy >= 0 && cx < mWidth && cy < mHeight &&
+           mFloor[(size_t)cy * mWidth + cx];
+  }
+
+  //
+  // The length of a path from one cell to another (-1 if there isn't one)
+  // and, if asked for, its cells from from to to inclusive.
+  //
+  int findPath(Vector2i from, Vector2i to,
+               std::vector<Vector2i>* path = nullptr);
+
+  //
+  // The same path as just its waypoints: from, the entrances it goes
+  // through, then to. Each leg can be turned into cells with refine when
+  // it's needed.
+  //
+  int findWaypoints(Vector2i from, Vector2i to,
+                    std::vector<Vector2i>& waypoints);
+
+  // Add the cells after from up to and including to, for consecutive
+  // waypoints. Returns false if they aren't.
+  bool refine(Vector2i from, Vector2i to, std::vector<Vector2i>& cells);
+
+ private:
+  struct Cluster {
+    Rect2i rect;
+    std::vector<Vector2i> nodes;
+    // Between each pair of nodes, nodes.size() squared (-1 = no path
+    // inside the cluster)
+    std::vector<int> costs;
+  };
+
+  int clusterAt(int cx, int cy) const {
+    return (cy / mClusterSize) * mClustersWide + cx / mClusterSize;
+  }
+  int findNode(int cluster, Vector2i pos) const;
+  void buildCluster(int cluster, std::vector<int>& dist,
+                    std::vector<Vector2i>& queue);
+  // Add the cluster's side of the entrances on its edge with another
+  void addEntrances(Cluster& cluster, int otherCluster) const;
+  // Breadth first search of the cluster from a cell. dist is by cell of
+  // the cluster's rect (-1 = not reached), and parent (if given) the cell
+  // each was reached from.
+  void searchCluster(const Cluster& cluster, Vector2i from,
+                     std::vector<int>& dist, std::vector<Vector2i>& queue,
+                     std::vector<Vector2i>* parent) const;
+  void numberNodes();
+
+  int mClusterSize;
+  int mWidth = 0;
+  int mHeight = 0;
+  int mClustersWide = 0;
+  int mClustersHigh = 0;
+  std::vector<uint8_t> mFloor;
+  std::vector<Cluster> mClusters;
+
+  // Every node numbered, cluster by cluster
+  std::vector<int> mFirstNode;  // Per cluster, plus one past the end
+  std::vector<int> mNodeCluster;
+  std::vector<Vector2i> mNodePos;
+
+  // Scratch for the queries
+  std::vector<int> mCost;
+  std::vector<int> mFrom;
+  std::vector<uint32_t> mVisitStamp;  // mVisitEpoch when mCost is set
+  uint32_t mVisitEpoch = 0;
+  std::vector<int> mStartCosts;
+  std::vector<int> mGoalCosts;
+  std::vector<int> mDist;
+  std::vector<Vector2i> mParent;
+  std::vector<Vector2i> mQueue;
+  std::vector<Vector2i> mWaypoints;
+};
+
+}  // namespace Cave
+
+#endif
@@ -0,0 +1,250 @@
+#include "RoomGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+#include "Trace.h"
+
+namespace Cave {
+
+namespace {
+
+// The Euler tour is split into blocks this long. A query scans at most
+// two of them and looks up the sparse table for the blocks between.
+constexpr int EULER_BLOCK = 32;
+
+}  // namespace
+
+void RoomGraph::build(std::vector<Room> rooms, std::vector<Tunnel> tunnels,
+                      Executor* executor, int maxWorkers) {
+  CAVE_TRACE_SCOPE("RoomGraph::build");
+  Executor& exec = executor ? *executor : Executor::getDefault();
+  mRooms = std::move(rooms);
+  mTunnels = std::move(tunnels);
+  const int numRooms = (int)mRooms.size();
+
+  mLinkStart.assign(numRooms + 1, 0);
+  for (Tunnel& tunnel : mTunnels) {
+    const Room& room1 = mRooms[tunnel.mRoom1];
+    const Room& room2 = mRooms[tunnel.mRoom2];
+    tunnel.mDistance =
+        std::fabs(room1.mCentreX - tunnel.mFrom.x) +
+        std::fabs(room1.mCentreY - tunnel.mFrom.y) + tunnel.mLength + 1 +
+        std::fabs(room2.mCentreX - tunnel.mTo.x) +
+        std::fabs(room2.mCentreY - tunnel.mTo.y);
+    ++mLinkStart[tunnel.mRoom1 + 1];
+    ++mLinkStart[tunnel.mRoom2 + 1];
+  }
+  for (int i = 0; i < numRooms; ++i) {
+    mLinkStart[i + 1] += mLinkStart[i];
+  }
+  mLinks.resize(mLinkStart[numRooms]);
+  {
+    std::vector<int> next(mLinkStart.begin(), mLinkStart.end() - 1);
+    for (int t = 0; t < (int)mTunnels.size(); ++t) {
+      mLinks[next[mTunnels[t].mRoom1]++] = t;
+      mLinks[next[mTunnels[t].mRoom2]++] = t;
+    }
+  }
+
+  //
+  // Walk the tree depth first from each unvisited room, noting each room
+  // every time the walk passes through it
+  //
+  mComponent.assign(numRooms, -1);
+  mDepth.assign(numRooms, 0);
+  mRootDist.assign(numRooms, 0);
+  mFirstVisit.assign(numRooms, 0);
+  mEuler.clear();
+  int numComponents = 0;
+  std::vector<std::pair<int, int>> stack;  // Room, next of its links
+  for (int root = 0; root < numRooms; ++root) {
+    if (mComponent[root] >= 0) {
+      continue;
+    }
+    const int component = numComponents++;
+    mComponent[root] = component;
+    mFirstVisit[root] = (int)mEuler.size();
+    mEuler.push_back(root);
+    stack.push_back({root, mLinkStart[root]});
+    while (!stack.empty()) {
+      const int room = stack.back().first;
+      const int link = stack.back().second;
+      if (link == mLinkStart[room + 1]) {
+        stack.pop_back();
+        if (!stack.empty()) {
+          mEuler.push_back(stack.back().first);
+        }
+        continue;
+      }
+      ++stack.back().second;
+      const Tunnel& tunnel = mTunnels[mLinks[link]];
+      const int other = tunnel.mRoom1 == room ? tunnel.mRoom2 : tunnel.mRoom1;
+      if (mComponent[other] >= 0) {
+        continue;  // The way back
+      }
+      mComponent[other] = component;
+      mDepth[other] = mDepth[room] + 1;
+      mRootDist[other] = mRootDist[room] + tunnel.mDistance;
+      mFirstVisit[other] = (int)mEuler.size();
+      mEuler.push_back(other);
+      stack.push_back({other, mLinkStart[other]});
+    }
+  }
+  const int tourLength = (int)mEuler.size();
+  mEulerDepth.resize(tourLength);
+  for (int i = 0; i < tourLength; ++i) {
+    mEulerDepth[i] = mDepth[mEuler[i]];
+  }
+
+  // The shallowest of each block, then of each run of 2, 4, ... blocks
+  const int numBlocks = (tourLength + EULER_BLOCK - 1) / EULER_BLOCK;
+  mBlockMin.resize(1);
+  mBlockMin[0].resize(numBlocks);
+  parallelForRows(exec, numBlocks, maxWorkers, [&](int blockBegin,
+                                                   int blockEnd) {
+    for (int b = blockBegin; b < blockEnd; ++b) {
+      const int end = std::min(tourLength, (b + 1) * EULER_BLOCK);
+      int best = b * EULER_BLOCK;
+      for (int i = best + 1; i < end; ++i) {
+        best = shallower(best, i);
+      }
+      mBlockMin[0][b] = best;
+    }
+  });
+  for (int level = 1; (1 << level) <= numBlocks; ++level) {
+    const int half = 1 << (level - 1);
+    const int count = numBlocks - (1 << level) + 1;
+    mBlockMin.resize(level + 1);
+    const std::vector<int>& prev = mBlockMin[level - 1];
+    std::vector<int>& mins = mBlockMin[level];
+    mins.resize(count);
+    parallelForRows(exec, count, maxWorkers, [&](int blockBegin,
+                                                 int blockEnd) {
+      for (int b = blockBegin; b < blockEnd; ++b) {
+        mins[b] = shallower(prev[b], prev[b + half]);
+      }
+    });
+  }
+
+  //
+  // The longest paths: the room farthest from the root is one end, and the
+  // room farthest from that is the other
+  //
+  mFarEnds.assign(numComponents * 2, -1);
+  mHopEnds.assign(numComponents * 2, -1);
+  for (int room = 0; room < numRooms; ++room) {
+    int& farEnd = mFarEnds[mComponent[room] * 2];
+    if (farEnd < 0 || mRootDist[room] > mRootDist[farEnd]) {
+      farEnd = room;
+    }
+    int& hopEnd = mHopEnds[mComponent[room] * 2];
+    if (hopEnd < 0 || mDepth[room] > mDepth[hopEnd]) {
+      hopEnd = room;
+    }
+  }
+  for (int room = 0; room < numRooms; ++room) {
+    const int component = mComponent[room];
+    int& farEnd = mFarEnds[component * 2 + 1];
+    const int farFrom = mFarEnds[component * 2];
+    if (farEnd < 0 ||
+        getDistance(farFrom, room) > getDistance(farFrom, farEnd)) {
+      farEnd = room;
+    }
+    int& hopEnd = mHopEnds[component * 2 + 1];
+    const int hopFrom = mHopEnds[component * 2];
+    if (hopEnd < 0 || getHops(hopFrom, room) > getHops(hopFrom, hopEnd)) {
+      hopEnd = room;
+    }
+  }
+}
+
+int RoomGraph::commonAncestor(int room1, int room2) const {
+  int first = mFirstVisit[room1];
+  int last = mFirstVisit[room2];
+  if (first > last) {
+    std::swap(first, last);
+  }
+  // The shallowest room the tour passes between them
+  const int firstBlock = first / EULER_BLOCK;
+  const int lastBlock = last / EULER_BLOCK;
+  int best = first;
+  if (firstBlock == lastBlock) {
+    for (int i = first + 1; i <= last; ++i) {
+      best = shallower(best, i);
+    }
+    return mEuler[best];
+  }
+  for (int i = first + 1; i < (firstBlock + 1) * EULER_BLOCK; ++i) {
+    best = shallower(best, i);
+  }
+  for (int i = lastBlock * EULER_BLOCK; i <= last; ++i) {
+    best = shallower(best, i);
+  }
+  const int between = lastBlock - firstBlock - 1;
+  if (between > 0) {
+    int level = 0;
+    while ((2 << level) <= between) {
+      ++level;
+    }
+    best = shallower(best, mBlockMin[level][firstBlock + 1]);
+    best = shallower(best, mBlockMin[level][lastBlock - (1 << level)]);
+  }
+  return mEuler[best];
+}
+
+int RoomGraph::getHops(int room1, int room2) const {
+  if (!connected(room1, room2)) {
+    return -1;
+  }
+  return mDepth[room1] + mDepth[room2] -
+         2 * mDepth[commonAncestor(room1, room2)];
+}
+
+float RoomGraph::getDistance(int room1, int room2) const {
+  if (!connected(room1, room2)) {
+    return -1;
+  }
+  return mRootDist[room1] + mRootDist[room2] -
+         2 * mRootDist[commonAncestor(room1, room2)];
+}
+
+int RoomGraph::getFarthestRoom(int room, bool byHops) const {
+  const std::vector<int>& ends = byHops ? mHopEnds : mFarEnds;
+  const int end1 = ends[mComponent[room] * 2];
+  const int end2 = ends[mComponent[room] * 2 + 1];
+  if (byHops) {
+    return getHops(room, end1) >= getHops(room, end2) ? end1 : end2;
+  }
+  return getDistance(room, end1) >= getDistance(room, end2) ? end1 : end2;
+}
+
+void RoomGraph::getRoomsWithin(int room, int hops,
+                               std::vector<int>& rooms) const {
+  rooms.assign(1, room);
+  // A hop at a time, so the rooms come out nearest first. It's a tree, so
+  // only the way back needs skipping.
+  std::vector<int> from(1, -1);
+  size_t hopBegin = 0;
+  for (int hop = 0; hop < hops && hopBegin < rooms.size(); ++hop) {
+    const size_t hopEnd = rooms.size();
+    for (size_t next = hopBegin; next < hopEnd; ++next) {
+      const int here = rooms[next];
+      for (int link = mLinkStart[here]; link < mLinkStart[here + 1];
+           ++link) {
+        const Tunnel& tunnel = mTunnels[mLinks[link]];
+        const int other =
+            tunnel.mRoom1 == here ? tunnel.mRoom2 : tunnel.mRoom1;
+        if (other != from[next]) {
+          rooms.push_back(other);
+          from.push_back(here);
+        }
+      }
+    }
+    hopBegin = hopEnd;
+  }
+}
+
+}  // namespace Cave
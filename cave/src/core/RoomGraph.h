@@ -0,0 +1,108 @@
+#ifndef ROOM_GRAPH_H
+#define ROOM_GRAPH_H
+
+#include <vector>
+
+#include "CaveInfo.h"
+#include "Executor.h"
+
+namespace Cave {
+
+//
+// The rooms Cave::findRooms found and the tunnels joinRooms dug between
+// them, kept for placing things by room (e.g. the room farthest from the
+// start, or the rooms a few rooms away).
+//
+// The tunnels are a minimum spanning tree, so there's exactly one way from
+// a room to another and the number of tunnels (hops) and the distance
+// between them come from their common ancestor in the tree. That's found
+// in constant time from the Euler tour of the tree with a sparse table of
+// its blocks' minimums, without a room-by-room matrix (there can be
+// hundreds of thousands of rooms). The room farthest from any room is one
+// of the two ends of the longest path through the tree, so that's a
+// lookup too.
+//
+// The distance through a tunnel is from one room's centre to its end of
+// the tunnel, along it, then on to the other room's centre, counting
+// steps to the 4 neighbours (so it can be short inside a winding room).
+//
+class RoomGraph {
+ public:
+  struct Room {
+    int mArea = 0;  // Floor cells, before the tunnels were dug
+    Rect2i mBounds;
+    float mCentreX = 0;  // Mean of the cells
+    float mCentreY = 0;
+  };
+
+  struct Tunnel {
+    int mRoom1 = 0;
+    int mRoom2 = 0;
+    Vector2i mFrom;  // The floor cells in each room it joins
+    Vector2i mTo;
+    Vector2i mDir;        // From mFrom to mTo
+    int mLength = 0;      // Wall cells dug
+    float mDistance = 0;  // Centre to centre, through the tunnel
+  };
+
+  // The tunnels' mDistance are filled in. The tables are built on the
+  // given executor (nullptr = the default).
+  void build(std::vector<Room> rooms, std::vector<Tunnel> tunnels,
+             Executor* executor = nullptr, int maxWorkers = 0);
+
+  int numRooms() const { return (int)mRooms.size(); }
+  const Room& getRoom(int room) const { return mRooms[room]; }
+  const std::vector<Tunnel>& getTunnels() const { return mTunnels; }
+  // Indexes into getTunnels()
+  std::vector<int> getTunnelsOf(int room) const {
+    return std::vector<int>(mLinks.begin() + mLinkStart[room],
+                            mLinks.begin() + mLinkStart[room + 1]);
+  }
+
+  // If not, the hops and distance are -1
+  bool connected(int room1, int room2) const {
+    return mComponent[room1] == mComponent[room2];
+  }
+  int getHops(int room1, int room2) const;
+  float getDistance(int room1, int room2) const;
+
+  // The room farthest from the given one (by distance, or by hops) that
+  // can be reached from it
+  int getFarthestRoom(int room, bool byHops = false) const;
+
+  // The rooms (including this one) at most hops away, nearest first. Costs
+  // the number found.
+  void getRoomsWithin(int room, int hops, std::vector<int>& rooms) const;
+
+ private:
+  int commonAncestor(int room1, int room2) const;
+  // Of two places in the Euler tour, the one visiting the shallower room
+  int shallower(int i, int j) const {
+    return mEulerDepth[i] <= mEulerDepth[j] ? i : j;
+  }
+
+  std::vector<Room> mRooms;
+  std::vector<Tunnel> mTunnels;
+  // Room i's tunnels are mLinks[mLinkStart[i]] to mLinks[mLinkStart[i + 1]]
+  std::vector<int> mLinkStart;
+  std::vector<int> mLinks;
+
+  // The spanning tree, rooted at the lowest numbered room of each component
+  std::vector<int> mComponent;
+  std::vector<int> mDepth;       // In hops
+  std::vector<float> mRootDist;  // Distance from the root
+  std::vector<int> mFirstVisit;  // Into the Euler tour
+  std::vector<int> mEuler;       // Rooms as the tour visits them
+  std::vector<int> mEulerDepth;
+  // mBlockMin[level][b] is the index in the tour of the shallowest room in
+  // blocks b to b + 2^level - 1
+  std::vector<std::vector<int>> mBlockMin;
+  // Per component (two each), the ends of the longest path by distance and
+  // by hops
+  std::vector<int> mFarEnds;
+  std::vector<int> mHopEnds;
+};
+
+}  // namespace Cave
+
+#endif
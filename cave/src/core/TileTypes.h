@@ -1,10 +1,15 @@
 #ifndef TILE_TYPES_H
 #define TILE_TYPES_H
+#include <functional>
 #include <vector>
 
 namespace Cave {
 using TileMap = std::vector<std::vector<int>>;
 
+// Given the rows of a map in order as they're finished: the row (cave
+// coords) and its width tiles, without the border
+using RowSink = std::function<void(int cy, const int* tiles)>;
+
 // TileName is used to identify the type of tile to be placed in the map.
 // This is used by the core library and the Godot wrapper will map these
 // to actual tile atlas coordinates.
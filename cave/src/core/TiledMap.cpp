@@ -0,0 +1,918 @@
+#include "TiledMap.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveSmoother.h"
+#include "Diagnostics.h"
+
+namespace Cave {
+
+namespace {
+
+const int ATLAS_TILES = 64;  // 8x8, see Cave::getAtlasIndex
+
+const char* BASE64 =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+uint32_t getGid(int tile) { return (uint32_t)Cave::getAtlasIndex(tile) + 1; }
+
+// Deflate's length and distance codes (RFC 1951 3.2.5)
+const int LENGTH_BASE[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11,  13,
+                             15, 17, 19, 23,  27,  31,  35,  43,  51,  59,
+                             67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                              2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int DISTANCE_BASE[30] = {
+    1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+    33,   49,   65,   97,   129,  193,  257,  385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const int DISTANCE_EXTRA[30] = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
+                                4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
+                                9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+uint32_t updateAdler(uint32_t adler, const uint8_t* bytes, size_t size) {
+  const uint32_t MOD = 65521;
+  uint32_t a = adler & 0xFFFF;
+  uint32_t b = adler >> 16;
+  while (size > 0) {
+    // Largest block that can't overflow before the modulo
+    const size_t block = std::min<size_t>(size, 5552);
+    for (size_t i = 0; i < block; ++i) {
+      a += bytes[i];
+      b += a;
+    }
+    a %= MOD;
+    b %= MOD;
+    bytes += block;
+    size -= block;
+  }
+  return (b << 16) | a;
+}
+
+//
+// base64 onto the stream as bytes arrive, carrying up to 2 bytes between
+// writes
+//
+class Base64Writer {
+ public:
+  explicit Base64Writer(std::ostream& out) : mOut(out) {}
+
+  void write(const uint8_t* bytes, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      mCarry[mNumCarry++] = bytes[i];
+      if (mNumCarry == 3) {
+        putGroup(3);
+      }
+    }
+    if (mText.size() >= 4096) {
+      flushText();
+    }
+  }
+
+  void finish() {
+    if (mNumCarry > 0) {
+      for (int i = mNumCarry; i < 3; ++i) {
+        mCarry[i] = 0;
+      }
+      putGroup(mNumCarry);
+    }
+    flushText();
+  }
+
+ private:
+  void putGroup(int numBytes) {
+    const uint32_t group = (mCarry[0] << 16) | (mCarry[1] << 8) | mCarry[2];
+    mText += BASE64[(group >> 18) & 63];
+    mText += BASE64[(group >> 12) & 63];
+    mText += (numBytes > 1) ? BASE64[(group >> 6) & 63] : '=';
+    mText += (numBytes > 2) ? BASE64[group & 63] : '=';
+    mNumCarry = 0;
+  }
+
+  void flushText() {
+    mOut.write(mText.data(), mText.size());
+    mText.clear();
+  }
+
+  std::ostream& mOut;
+  uint32_t mCarry[3] = {};
+  int mNumCarry = 0;
+  std::string mText;
+};
+
+//
+// A zlib stream holding one fixed Huffman deflate block. The only matches
+// tried are against the previous tile (runs) and the same place in the
+// previous row, which is where nearly all the redundancy in a cave is, so
+// only the previous row has to be kept.
+//
+class ZlibWriter {
+ public:
+  ZlibWriter(Base64Writer& out, size_t rowBytes)
+      : mOut(out), mRowBytes(rowBytes), mWindow(rowBytes * 2) {
+    const uint8_t header[2] = {0x78, 0x01};
+    mOut.write(header, sizeof(header));
+    putBits(1, 1);  // Final block
+    putBits(1, 2);  // Fixed Huffman codes
+  }
+
+  // Rows are rowBytes each
+  void addRow(const uint8_t* row) {
+    mAdler = updateAdler(mAdler, row, mRowBytes);
+    // Previous row in the first half of the window, this one in the second
+    std::copy(mWindow.begin() + mRowBytes, mWindow.end(), mWindow.begin());
+    std::copy(row, row + mRowBytes, mWindow.begin() + mRowBytes);
+
+    const size_t start = (mRows > 0) ? 0 : mRowBytes;
+    const size_t end = mRowBytes * 2;
+    const size_t distances[2] = {4, mRowBytes};
+    size_t pos = mRowBytes;
+    while (pos < end) {
+      size_t bestLength = 0, bestDistance = 0;
+      for (size_t distance : distances) {
+        if (distance > MAX_DISTANCE || pos - start < distance) {
+          continue;
+        }
+        size_t length = 0;
+        while (length < MAX_LENGTH && pos + length < end &&
+               mWindow[pos + length] == mWindow[pos + length - distance]) {
+          ++length;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = distance;
+        }
+      }
+      if (bestLength >= MIN_LENGTH) {
+        putMatch((int)bestLength, (int)bestDistance);
+        pos += bestLength;
+      } else {
+        putSymbol(mWindow[pos]);
+        ++pos;
+      }
+    }
+    ++mRows;
+    flushBytes();
+  }
+
+  void finish() {
+    putSymbol(256);  // End of block
+    if (mNumBits > 0) {
+      mBytes.push_back((uint8_t)mBits);
+      mBits = 0;
+      mNumBits = 0;
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      mBytes.push_back((uint8_t)(mAdler >> shift));
+    }
+    mOut.write(mBytes.data(), mBytes.size());
+    mBytes.clear();
+  }
+
+ private:
+  static const size_t MIN_LENGTH = 3;
+  static const size_t MAX_LENGTH = 258;
+  static const size_t MAX_DISTANCE = 32768;
+
+  // Extra bits are least significant bit first
+  void putBits(uint32_t value, int count) {
+    mBits |= (uint64_t)value << mNumBits;
+    mNumBits += count;
+    while (mNumBits >= 8) {
+      mBytes.push_back((uint8_t)mBits);
+      mBits >>= 8;
+      mNumBits -= 8;
+    }
+  }
+
+  // Huffman codes are most significant bit first
+  void putCode(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    putBits(reversed, length);
+  }
+
+  // The fixed literal/length code
+  void putSymbol(int symbol) {
+    if (symbol < 144) {
+      putCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      putCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      putCode(symbol - 256, 7);
+    } else {
+      putCode(0xC0 + symbol - 280, 8);
+    }
+  }
+
+  void putMatch(int length, int distance) {
+    int code = 28;
+    while (LENGTH_BASE[code] > length) {
+      --code;
+    }
+    putSymbol(257 + code);
+    putBits(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+    code = 29;
+    while (DISTANCE_BASE[code] > distance) {
+      --code;
+    }
+    putCode(code, 5);
+    putBits(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+  }
+
+  void flushBytes() {
+    mOut.write(mBytes.data(), mBytes.size());
+    mBytes.clear();
+  }
+
+  Base64Writer& mOut;
+  size_t mRowBytes;
+  std::vector<uint8_t> mWindow;
+  int mRows = 0;
+  uint64_t mBits = 0;
+  int mNumBits = 0;
+  std::vector<uint8_t> mBytes;
+  uint32_t mAdler = 1;
+};
+
+void writeCsvRows(std::ostream& out, const TileMap& tileMap,
+                  const char* rowSeparator) {
+  // The text of each tile's gid
+  std::vector<std::string> gidText(IGNORE + 1);
+  for (int tile = 0; tile <= IGNORE; ++tile) {
+    gidText[tile] = std::to_string(getGid(tile));
+  }
+  std::string text;
+  for (size_t y = 0; y < tileMap.size(); ++y) {
+    text.clear();
+    for (size_t x = 0; x < tileMap[y].size(); ++x) {
+      const int tile = tileMap[y][x];
+      text += (tile >= 0 && tile <= IGNORE) ? gidText[tile]
+                                            : std::to_string(getGid(tile));
+      if (x + 1 < tileMap[y].size()) {
+        text += ',';
+      }
+    }
+    if (y + 1 < tileMap.size()) {
+      text += rowSeparator;
+    }
+    out.write(text.data(), text.size());
+  }
+}
+
+void writeZlibRows(std::ostream& out, const TileMap& tileMap) {
+  const size_t width = tileMap[0].size();
+  Base64Writer base64(out);
+  ZlibWriter zlib(base64, width * 4);
+  std::vector<uint8_t> row(width * 4);
+  for (const auto& tiles : tileMap) {
+    // Little endian uint32 gids
+    for (size_t x = 0; x < width; ++x) {
+      const uint32_t gid = getGid(tiles[x]);
+      for (int i = 0; i < 4; ++i) {
+        row[x * 4 + i] = (uint8_t)(gid >> (8 * i));
+      }
+    }
+    zlib.addRow(row.data());
+  }
+  zlib.finish();
+  base64.finish();
+}
+
+void writeJson(std::ostream& out, const TileMap& tileMap,
+               const TiledOptions& options) {
+  const size_t width = tileMap[0].size();
+  const size_t height = tileMap.size();
+  const bool csv = (options.mEncoding == TiledOptions::CSV);
+  out << "{ \"compressionlevel\":-1,\n"
+      << " \"height\":" << height << ",\n"
+      << " \"infinite\":false,\n"
+      << " \"layers\":[\n"
+      << "    {\n";
+  if (!csv) {
+    out << "     \"compression\":\"zlib\",\n";
+  }
+  out << "     \"data\":" << (csv ? "[" : "\"");
+  if (csv) {
+    writeCsvRows(out, tileMap, ",\n");
+  } else {
+    writeZlibRows(out, tileMap);
+  }
+  out << (csv ? "]" : "\"") << ",\n";
+  if (!csv) {
+    out << "     \"encoding\":\"base64\",\n";
+  }
+  out << "     \"height\":" << height << ",\n"
+      << "     \"id\":1,\n"
+      << "     \"name\":\"" << options.mLayerName << "\",\n"
+      << "     \"opacity\":1,\n"
+      << "     \"type\":\"tilelayer\",\n"
+      << "     \"visible\":true,\n"
+      << "     \"width\":" << width << ",\n"
+      << "     \"x\":0,\n"
+      << "     \"y\":0\n"
+      << "    }],\n"
+      << " \"nextlayerid\":2,\n"
+      << " \"nextobjectid\":1,\n"
+      << " \"orientation\":\"orthogonal\",\n"
+      << " \"renderorder\":\"right-down\",\n"
+      << " \"tiledversion\":\"1.10.2\",\n"
+      << " \"tileheight\":" << options.mTileHeight << ",\n"
+      << " \"tilesets\":[\n"
+      << "    {\n"
+      << "     \"columns\":8,\n"
+      << "     \"firstgid\":1,\n"
+      << "     \"image\":\"" << options.mTilesetImage << "\",\n"
+      << "     \"imageheight\":" << options.mTileHeight * 8 << ",\n"
+      << "     \"imagewidth\":" << options.mTileWidth * 8 << ",\n"
+      << "     \"margin\":0,\n"
+      << "     \"name\":\"cave\",\n"
+      << "     \"spacing\":0,\n"
+      << "     \"tilecount\":" << ATLAS_TILES << ",\n"
+      << "     \"tileheight\":" << options.mTileHeight << ",\n"
+      << "     \"tilewidth\":" << options.mTileWidth << "\n"
+      << "    }],\n"
+      << " \"tilewidth\":" << options.mTileWidth << ",\n"
+      << " \"type\":\"map\",\n"
+      << " \"version\":\"1.10\",\n"
+      << " \"width\":" << width << "\n"
+      << "}\n";
+}
+
+void writeTmx(std::ostream& out, const TileMap& tileMap,
+              const TiledOptions& options) {
+  const size_t width = tileMap[0].size();
+  const size_t height = tileMap.size();
+  const bool csv = (options.mEncoding == TiledOptions::CSV);
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<map version=\"1.10\" tiledversion=\"1.10.2\" "
+      << "orientation=\"orthogonal\" renderorder=\"right-down\" width=\""
+      << width << "\" height=\"" << height << "\" tilewidth=\""
+      << options.mTileWidth << "\" tileheight=\"" << options.mTileHeight
+      << "\" infinite=\"0\" nextlayerid=\"2\" nextobjectid=\"1\">\n"
+      << " <tileset firstgid=\"1\" name=\"cave\" tilewidth=\""
+      << options.mTileWidth << "\" tileheight=\"" << options.mTileHeight
+      << "\" tilecount=\"" << ATLAS_TILES << "\" columns=\"8\">\n"
+      << "  <image source=\"" << options.mTilesetImage << "\" width=\""
+      << options.mTileWidth * 8 << "\" height=\"" << options.mTileHeight * 8
+      << "\"/>\n"
+      << " </tileset>\n"
+      << " <layer id=\"1\" name=\"" << options.mLayerName << "\" width=\""
+      << width << "\" height=\"" << height << "\">\n";
+  if (csv) {
+    out << "  <data encoding=\"csv\">\n";
+    writeCsvRows(out, tileMap, ",\n");
+    out << "\n</data>\n";
+  } else {
+    out << "  <data encoding=\"base64\" compression=\"zlib\">\n   ";
+    writeZlibRows(out, tileMap);
+    out << "\n  </data>\n";
+  }
+  out << " </layer>\n"
+      << "</map>\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Import
+
+// gid - 1 -> tile
+std::vector<int> makeAtlasTiles() {
+  std::vector<int> tiles(ATLAS_TILES, -1);
+  for (int tile = 0; tile < SOLID; ++tile) {
+    const int index = Cave::getAtlasIndex(tile);
+    if (index >= 0 && index < ATLAS_TILES && tiles[index] < 0) {
+      tiles[index] = tile;
+    }
+  }
+  return tiles;
+}
+
+int getTileFromGid(uint32_t gid, const std::vector<int>& atlasTiles) {
+  gid &= 0x0FFFFFFF;  // Flip flags
+  if (gid == 0 || gid > (uint32_t)ATLAS_TILES || atlasTiles[gid - 1] < 0) {
+    return FLOOR;
+  }
+  return atlasTiles[gid - 1];
+}
+
+// Position just after `"key":` or `key="`, or npos
+size_t findValue(const std::string& text, size_t from, size_t to,
+                 const std::string& key, bool json) {
+  const std::string pattern = json ? "\"" + key + "\"" : " " + key + "=\"";
+  size_t pos = text.find(pattern, from);
+  if (pos == std::string::npos || pos >= to) {
+    return std::string::npos;
+  }
+  pos += pattern.size();
+  if (json) {
+    while (pos < text.size() && (isspace((unsigned char)text[pos]) ||
+                                 text[pos] == ':')) {
+      ++pos;
+    }
+  }
+  return pos;
+}
+
+bool findInt(const std::string& text, size_t from, size_t to,
+             const std::string& key, bool json, int& value) {
+  const size_t pos = findValue(text, from, to, key, json);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  value = std::atoi(text.c_str() + pos);
+  return value > 0;
+}
+
+std::string findString(const std::string& text, size_t from, size_t to,
+                       const std::string& key, bool json) {
+  size_t pos = findValue(text, from, to, key, json);
+  if (pos == std::string::npos) {
+    return "";
+  }
+  if (json) {
+    if (text[pos] != '"') {
+      return "";
+    }
+    ++pos;
+  }
+  const size_t end = text.find('"', pos);
+  return (end == std::string::npos) ? "" : text.substr(pos, end - pos);
+}
+
+bool parseCsv(const std::string& text, size_t begin, size_t end,
+              std::vector<uint32_t>& gids) {
+  uint64_t value = 0;
+  bool inNumber = false;
+  for (size_t i = begin; i < end; ++i) {
+    const char c = text[i];
+    if (c >= '0' && c <= '9') {
+      value = value * 10 + (c - '0');
+      inNumber = true;
+    } else if (c == ',' || isspace((unsigned char)c)) {
+      if (inNumber) {
+        gids.push_back((uint32_t)value);
+      }
+      value = 0;
+      inNumber = false;
+    } else {
+      return false;
+    }
+  }
+  if (inNumber) {
+    gids.push_back((uint32_t)value);
+  }
+  return true;
+}
+
+bool decodeBase64(const std::string& text, size_t begin, size_t end,
+                  std::vector<uint8_t>& bytes) {
+  uint32_t bits = 0;
+  int numBits = 0;
+  for (size_t i = begin; i < end; ++i) {
+    const char c = text[i];
+    if (isspace((unsigned char)c) || c == '=') {
+      continue;
+    }
+    const char* found = std::strchr(BASE64, c);
+    if (!found || c == '\0') {
+      return false;
+    }
+    bits = (bits << 6) | (uint32_t)(found - BASE64);
+    numBits += 6;
+    if (numBits >= 8) {
+      numBits -= 8;
+      bytes.push_back((uint8_t)(bits >> numBits));
+    }
+  }
+  return true;
+}
+
+//
+// Reads a zlib stream (RFC 1950/1951): stored, fixed and dynamic Huffman
+// blocks, so both our own output and Tiled's. Codes are decoded a bit at a
+// time from the canonical code counts (as zlib's puff.c does), which is
+// slow next to zlib but only has to keep up with reading the file.
+//
+class Inflater {
+ public:
+  Inflater(const std::vector<uint8_t>& in, size_t maxBytes)
+      : mIn(in), mMaxBytes(maxBytes) {}
+
+  bool inflate(std::vector<uint8_t>& out) {
+    if (mIn.size() < 6 || (mIn[0] & 0x0F) != 8 || (mIn[1] & 0x20) != 0 ||
+        ((mIn[0] << 8) | mIn[1]) % 31 != 0) {
+      return false;  // Not deflate, or needs a preset dictionary
+    }
+    mPos = 2;
+    bool last = false;
+    while (!last) {
+      last = getBits(1) != 0;
+      const int type = getBits(2);
+      bool ok = false;
+      if (type == 0) {
+        ok = storedBlock(out);
+      } else if (type == 1) {
+        ok = fixedBlock(out);
+      } else if (type == 2) {
+        ok = dynamicBlock(out);
+      }
+      if (!ok || mError) {
+        return false;
+      }
+    }
+    // The Adler-32 of the data follows, big endian, on a byte boundary
+    if (mPos + 4 > mIn.size()) {
+      return false;
+    }
+    uint32_t adler = 0;
+    for (int i = 0; i < 4; ++i) {
+      adler = (adler << 8) | mIn[mPos++];
+    }
+    return adler == updateAdler(1, out.data(), out.size());
+  }
+
+ private:
+  static const int MAX_BITS = 15;
+
+  // Canonical code: how many codes of each length, and the symbols in
+  // code order
+  struct Huffman {
+    int counts[MAX_BITS + 1];
+    std::vector<int> symbols;
+  };
+
+  int getBits(int count) {
+    while (mNumBits < count) {
+      if (mPos >= mIn.size()) {
+        mError = true;
+        return 0;
+      }
+      mBits |= (uint32_t)mIn[mPos++] << mNumBits;
+      mNumBits += 8;
+    }
+    const int value = (int)(mBits & ((1u << count) - 1));
+    mBits >>= count;
+    mNumBits -= count;
+    return value;
+  }
+
+  // False if the lengths describe more codes than there's room for
+  static bool build(Huffman& code, const int* lengths, int numSymbols) {
+    std::fill(code.counts, code.counts + MAX_BITS + 1, 0);
+    for (int symbol = 0; symbol < numSymbols; ++symbol) {
+      ++code.counts[lengths[symbol]];
+    }
+    int left = 1;
+    for (int length = 1; length <= MAX_BITS; ++length) {
+      left = (left << 1) - code.counts[length];
+      if (left < 0) {
+        return false;
+      }
+    }
+    int offsets[MAX_BITS + 1] = {0};
+    for (int length = 1; length < MAX_BITS; ++length) {
+      offsets[length + 1] = offsets[length] + code.counts[length];
+    }
+    code.symbols.assign(numSymbols, 0);
+    for (int symbol = 0; symbol < numSymbols; ++symbol) {
+      if (lengths[symbol] != 0) {
+        code.symbols[offsets[lengths[symbol]]++] = symbol;
+      }
+    }
+    return true;
+  }
+
+  // -1 if the bits aren't a code
+  int decode(const Huffman& code) {
+    int bits = 0, first = 0, index = 0;
+    for (int length = 1; length <= MAX_BITS; ++length) {
+      bits |= getBits(1);
+      const int count = code.counts[length];
+      if (bits - first < count) {
+        return code.symbols[index + bits - first];
+      }
+      index += count;
+      first = (first + count) << 1;
+      bits <<= 1;
+    }
+    return -1;
+  }
+
+  bool storedBlock(std::vector<uint8_t>& out) {
+    mBits = 0;
+    mNumBits = 0;
+    if (mPos + 4 > mIn.size()) {
+      return false;
+    }
+    const size_t length = mIn[mPos] | (mIn[mPos + 1] << 8);
+    const size_t check = mIn[mPos + 2] | (mIn[mPos + 3] << 8);
+    mPos += 4;
+    if (length != (~check & 0xFFFF) || mPos + length > mIn.size() ||
+        out.size() + length > mMaxBytes) {
+      return false;
+    }
+    out.insert(out.end(), mIn.begin() + mPos, mIn.begin() + mPos + length);
+    mPos += length;
+    return true;
+  }
+
+  bool fixedBlock(std::vector<uint8_t>& out) {
+    int lengths[288 + 30];
+    std::fill(lengths, lengths + 144, 8);
+    std::fill(lengths + 144, lengths + 256, 9);
+    std::fill(lengths + 256, lengths + 280, 7);
+    std::fill(lengths + 280, lengths + 288, 8);
+    std::fill(lengths + 288, lengths + 288 + 30, 5);
+    Huffman literals, distances;
+    build(literals, lengths, 288);
+    build(distances, lengths + 288, 30);
+    return codes(out, literals, distances);
+  }
+
+  bool dynamicBlock(std::vector<uint8_t>& out) {
+    static const int ORDER[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                  11, 4,  12, 3, 13, 2, 14, 1, 15};
+    const int numLiterals = getBits(5) + 257;
+    const int numDistances = getBits(5) + 1;
+    const int numLengths = getBits(4) + 4;
+    if (numLiterals > 286 || numDistances > 30) {
+      return false;
+    }
+    int lengths[286 + 30] = {0};
+    for (int i = 0; i < numLengths; ++i) {
+      lengths[ORDER[i]] = getBits(3);
+    }
+    Huffman lengthCode;
+    if (mError || !build(lengthCode, lengths, 19)) {
+      return false;
+    }
+
+    // The literal/length and distance code lengths, run length coded
+    const int numCodes = numLiterals + numDistances;
+    for (int i = 0; i < numCodes;) {
+      const int symbol = decode(lengthCode);
+      if (symbol < 0 || mError) {
+        return false;
+      }
+      if (symbol < 16) {
+        lengths[i++] = symbol;
+        continue;
+      }
+      int repeat = 0, length = 0;
+      if (symbol == 16) {
+        if (i == 0) {
+          return false;
+        }
+        length = lengths[i - 1];
+        repeat = 3 + getBits(2);
+      } else if (symbol == 17) {
+        repeat = 3 + getBits(3);
+      } else {
+        repeat = 11 + getBits(7);
+      }
+      if (i + repeat > numCodes) {
+        return false;
+      }
+      std::fill(lengths + i, lengths + i + repeat, length);
+      i += repeat;
+    }
+    if (lengths[256] == 0) {
+      return false;  // No end of block
+    }
+    Huffman literals, distances;
+    if (!build(literals, lengths, numLiterals) ||
+        !build(distances, lengths + numLiterals, numDistances)) {
+      return false;
+    }
+    return codes(out, literals, distances);
+  }
+
+  bool codes(std::vector<uint8_t>& out, const Huffman& literals,
+             const Huffman& distances) {
+    for (;;) {
+      int symbol = decode(literals);
+      if (symbol < 0 || mError) {
+        return false;
+      }
+      if (symbol < 256) {
+        if (out.size() >= mMaxBytes) {
+          return false;
+        }
+        out.push_back((uint8_t)symbol);
+        continue;
+      }
+      if (symbol == 256) {
+        return true;
+      }
+      symbol -= 257;
+      if (symbol >= 29) {
+        return false;
+      }
+      const size_t length =
+          LENGTH_BASE[symbol] + getBits(LENGTH_EXTRA[symbol]);
+      const int distanceSymbol = decode(distances);
+      if (distanceSymbol < 0 || distanceSymbol >= 30) {
+        return false;
+      }
+      const size_t distance = DISTANCE_BASE[distanceSymbol] +
+                              getBits(DISTANCE_EXTRA[distanceSymbol]);
+      if (mError || distance > out.size() ||
+          out.size() + length > mMaxBytes) {
+        return false;
+      }
+      // May overlap what it's copying, so a byte at a time
+      for (size_t i = 0; i < length; ++i) {
+        out.push_back(out[out.size() - distance]);
+      }
+    }
+  }
+
+  const std::vector<uint8_t>& mIn;
+  size_t mMaxBytes;
+  size_t mPos = 0;
+  uint32_t mBits = 0;
+  int mNumBits = 0;
+  bool mError = false;
+};
+
+// Little endian uint32 gids
+bool getGids(const std::vector<uint8_t>& bytes, std::vector<uint32_t>& gids) {
+  if (bytes.size() % 4 != 0) {
+    return false;
+  }
+  gids.resize(bytes.size() / 4);
+  for (size_t i = 0; i < gids.size(); ++i) {
+    gids[i] = bytes[i * 4] | (bytes[i * 4 + 1] << 8) |
+              (bytes[i * 4 + 2] << 16) | ((uint32_t)bytes[i * 4 + 3] << 24);
+  }
+  return true;
+}
+
+}  // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+
+bool exportTiled(std::ostream& out, const TileMap& tileMap,
+                 const TiledOptions& options) {
+  if (tileMap.empty() || tileMap[0].empty()) {
+    CAVE_LOG_WARN("exportTiled: empty map");
+    return false;
+  }
+  if (options.mFormat == TiledOptions::TMX) {
+    writeTmx(out, tileMap, options);
+  } else {
+    writeJson(out, tileMap, options);
+  }
+  return out.good();
+}
+
+bool exportTiled(const std::string& path, const TileMap& tileMap,
+                 const TiledOptions& options) {
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!exportTiled(out, tileMap, options) || !out.flush()) {
+      CAVE_LOG_WARN("exportTiled: can't write " << tmpPath);
+      out.close();
+      std::error_code error;
+      std::filesystem::remove(tmpPath, error);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmpPath, path, error);
+  if (error) {
+    CAVE_LOG_WARN("exportTiled: can't rename to " << path << ": "
+                                                  << error.message());
+    std::filesystem::remove(tmpPath, error);
+    return false;
+  }
+  return true;
+}
+
+bool importTiled(const std::string& path, TileMap& tileMap) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    CAVE_LOG_WARN("importTiled: can't open " << path);
+    return false;
+  }
+  const std::string text((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  const size_t first = text.find_first_not_of(" \t\r\n");
+  const bool json = (first != std::string::npos && text[first] == '{');
+
+  //
+  // Only what's needed to find the first layer's data is parsed
+  //
+  const char* problem = nullptr;
+  int width = 0, height = 0;
+  size_t dataBegin = std::string::npos, dataEnd = std::string::npos;
+  std::string encoding, compression;
+  if (json) {
+    const size_t layers = text.find("\"layers\"");
+    const size_t data = findValue(text, layers, text.size(), "data", true);
+    if (text.find("\"infinite\":true") != std::string::npos) {
+      problem = "infinite maps aren't supported";
+    } else if (layers == std::string::npos || data == std::string::npos ||
+               !findInt(text, layers, text.size(), "width", true, width) ||
+               !findInt(text, layers, text.size(), "height", true, height)) {
+      problem = "no tile layer";
+    } else {
+      encoding = findString(text, layers, text.size(), "encoding", true);
+      compression =
+          findString(text, layers, text.size(), "compression", true);
+      const char close = (text[data] == '[') ? ']' : '"';
+      dataBegin = data + 1;
+      dataEnd = text.find(close, dataBegin);
+      if (encoding.empty()) {
+        encoding = "csv";
+      }
+    }
+  } else {
+    const size_t layer = text.find("<layer");
+    const size_t data = text.find("<data", layer);
+    if (text.find(" infinite=\"1\"") != std::string::npos) {
+      problem = "infinite maps aren't supported";
+    } else if (layer == std::string::npos || data == std::string::npos ||
+               !findInt(text, layer, data, "width", false, width) ||
+               !findInt(text, layer, data, "height", false, height)) {
+      problem = "no tile layer";
+    } else {
+      const size_t tagEnd = text.find('>', data);
+      encoding = findString(text, data, tagEnd, "encoding", false);
+      compression = findString(text, data, tagEnd, "compression", false);
+      dataBegin = (tagEnd == std::string::npos) ? tagEnd : tagEnd + 1;
+      dataEnd = text.find("</data>", data);
+    }
+  }
+  std::vector<uint32_t> gids;
+  if (!problem) {
+    if (dataBegin == std::string::npos || dataEnd == std::string::npos) {
+      problem = "no layer data";
+    } else if (!compression.empty() && compression != "zlib") {
+      problem = "only zlib compressed layer data is supported";
+    } else if (encoding == "csv") {
+      if (!parseCsv(text, dataBegin, dataEnd, gids)) {
+        problem = "bad CSV data";
+      }
+    } else if (encoding == "base64") {
+      std::vector<uint8_t> bytes;
+      if (!decodeBase64(text, dataBegin, dataEnd, bytes)) {
+        problem = "bad base64 data";
+      } else if (!compression.empty()) {
+        std::vector<uint8_t> inflated;
+        inflated.reserve((size_t)width * height * 4);
+        if (!Inflater(bytes, (size_t)width * height * 4).inflate(inflated)) {
+          problem = "bad zlib data";
+        }
+        bytes.swap(inflated);
+      }
+      if (!problem && !getGids(bytes, gids)) {
+        problem = "bad base64 data";
+      }
+    } else {
+      problem = "unsupported layer encoding";
+    }
+  }
+  if (!problem && gids.size() != (size_t)width * height) {
+    problem = "layer data is the wrong size";
+  }
+  if (problem) {
+    CAVE_LOG_WARN("importTiled: " << path << ": " << problem);
+    return false;
+  }
+
+  const std::vector<int> atlasTiles = makeAtlasTiles();
+  tileMap.resize(height);
+  for (int y = 0; y < height; ++y) {
+    tileMap[y].resize(width);
+    for (int x = 0; x < width; ++x) {
+      tileMap[y][x] = getTileFromGid(gids[(size_t)y * width + x], atlasTiles);
+    }
+  }
+  return true;
+}
+
+void resmooth(TileMap& tileMap, const CaveInfo& info, Workspace* workspace) {
+  for (auto& row : tileMap) {
+    for (int& tile : row) {
+      tile = CaveSmoother::getUnsmoothedTile(tile);
+    }
+  }
+  CaveSmoother smoother(tileMap, info);
+  smoother.setWorkspace(workspace);
+  smoother.smooth();
+}
+
+}  // namespace Cave
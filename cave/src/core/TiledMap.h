@@ -0,0 +1,63 @@
+#ifndef TILED_MAP_H
+#define TILED_MAP_H
+
+#include <ostream>
+#include <string>
+
+#include "CaveInfo.h"
+#include "TileTypes.h"
+#include "Workspace.h"
+
+namespace Cave {
+
+//
+// Export to / import from the Tiled map editor (https://www.mapeditor.org).
+//
+// The map is one tile layer using a single 8x8 tileset laid out like the
+// tile atlas, so each tile's gid is Cave::getAtlasIndex(tile) + 1. The whole
+// TileMap is written, border included.
+//
+// The exporter writes a row at a time straight to the stream, so memory use
+// is a few rows whatever the size of the map. base64+zlib data is compressed
+// as it goes (fixed Huffman deflate matching against the previous tile and
+// the previous row), which is much smaller than CSV but not as small as
+// Tiled's own output.
+//
+struct TiledOptions {
+  enum Format { JSON, TMX };
+  enum Encoding { CSV, BASE64_ZLIB };
+
+  Format mFormat = JSON;
+  Encoding mEncoding = BASE64_ZLIB;
+  int mTileWidth = 64;
+  int mTileHeight = 64;
+  std::string mTilesetImage = "tiles.png";
+  std::string mLayerName = "cave";
+};
+
+bool exportTiled(std::ostream& out, const TileMap& tileMap,
+                 const TiledOptions& options = TiledOptions());
+// Written under a temporary name and renamed into place
+bool exportTiled(const std::string& path, const TileMap& tileMap,
+                 const TiledOptions& options = TiledOptions());
+
+//
+// Read back the first tile layer of a map saved by Tiled, JSON or TMX, with
+// CSV, base64 or base64+zlib data (as exportTiled writes by default).
+// gzip and zstd compressed layers aren't supported. Tiles that aren't in
+// the atlas are read as FLOOR.
+//
+bool importTiled(const std::string& path, TileMap& tileMap);
+
+//
+// Redo the smoothing of an edited map: every tile is turned back into WALL
+// or FLOOR (CaveSmoother::getUnsmoothedTile) and then smoothed again as
+// generate() would. info gives the smoothing options and must match the
+// map's size. For a few cells, Cave::editCells is much cheaper.
+//
+void resmooth(TileMap& tileMap, const CaveInfo& info,
+              Workspace* workspace = nullptr);
+
+}  // namespace Cave
+
+#endif
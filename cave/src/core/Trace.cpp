@@ -0,0 +1,155 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Cave {
+
+namespace {
+
+const size_t SPANS_PER_THREAD = 1 << 16;
+
+struct Span {
+  const char* name;
+  uint64_t start;
+  uint64_t end;
+};
+
+//
+// Only the owning thread writes. It fills the slot and then publishes it by
+// bumping count, so the exporter can read up to count at any time.
+//
+struct ThreadBuffer {
+  int tid = 0;
+  std::unique_ptr<Span[]> spans{new Span[SPANS_PER_THREAD]};
+  std::atomic<size_t> count{0};
+  std::atomic<size_t> dropped{0};
+};
+
+std::atomic<bool> sRecording{false};
+std::atomic<uint64_t> sStartNanos{0};
+
+// Buffers outlive their threads so spans from finished workers still export
+std::mutex sRegistryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> sBuffers;
+
+ThreadBuffer& threadBuffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+    auto newBuffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> lock(sRegistryMutex);
+    newBuffer->tid = (int)sBuffers.size() + 1;
+    sBuffers.push_back(newBuffer);
+    return newBuffer;
+  }();
+  return *buffer;
+}
+
+std::vector<std::shared_ptr<ThreadBuffer>> allBuffers() {
+  std::lock_guard<std::mutex> lock(sRegistryMutex);
+  return sBuffers;
+}
+
+void writeJsonString(std::ostream& out, const char* str) {
+  out << '"';
+  for (const char* c = str; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      out << '\\';
+    }
+    out << *c;
+  }
+  out << '"';
+}
+
+}  // namespace
+
+void Tracer::start() {
+  uint64_t expected = 0;
+  sStartNanos.compare_exchange_strong(expected, nowNanos());
+  sRecording = true;
+}
+
+void Tracer::stop() { sRecording = false; }
+
+bool Tracer::isRecording() {
+  return sRecording.load(std::memory_order_relaxed);
+}
+
+void Tracer::clear() {
+  for (auto& buffer : allBuffers()) {
+    buffer->count = 0;
+    buffer->dropped = 0;
+  }
+  sStartNanos = 0;
+  if (sRecording) {
+    sStartNanos = nowNanos();
+  }
+}
+
+size_t Tracer::droppedSpans() {
+  size_t dropped = 0;
+  for (auto& buffer : allBuffers()) {
+    dropped += buffer->dropped;
+  }
+  return dropped;
+}
+
+uint64_t Tracer::nowNanos() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Tracer::record(const char* name, uint64_t startNanos,
+                    uint64_t endNanos) {
+  ThreadBuffer& buffer = threadBuffer();
+  const size_t index = buffer.count.load(std::memory_order_relaxed);
+  if (index >= SPANS_PER_THREAD) {
+    ++buffer.dropped;
+    return;
+  }
+  buffer.spans[index] = {name, startNanos, endNanos};
+  buffer.count.store(index + 1, std::memory_order_release);
+}
+
+size_t Tracer::writeChromeJson(std::ostream& out) {
+  const uint64_t origin = sStartNanos;
+  auto micros = [origin](uint64_t nanos) {
+    return (nanos > origin) ? (double)(nanos - origin) / 1000.0 : 0.0;
+  };
+
+  const std::ios::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(3);
+
+  size_t written = 0;
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (auto& buffer : allBuffers()) {
+    const size_t count = buffer->count.load(std::memory_order_acquire);
+    if (count == 0) {
+      continue;
+    }
+    out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+        << "\"pid\":1,\"tid\":" << buffer->tid
+        << ",\"args\":{\"name\":\"cave-" << buffer->tid << "\"}}";
+    first = false;
+    for (size_t i = 0; i < count; ++i) {
+      const Span& span = buffer->spans[i];
+      out << ",\n{\"name\":";
+      writeJsonString(out, span.name);
+      out << ",\"cat\":\"cave\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+          << ",\"ts\":" << micros(span.start)
+          << ",\"dur\":" << micros(span.end) - micros(span.start) << "}";
+      ++written;
+    }
+  }
+  out << "\n]}\n";
+  out.flags(flags);
+  out.precision(precision);
+  return written;
+}
+
+}  // namespace Cave
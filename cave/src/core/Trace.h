@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+//
+// Scoped timeline instrumentation for generation, exported as Chrome
+// trace-event JSON (load in Perfetto or chrome://tracing).
+//
+// Only compiled in when CAVE_TRACE_ENABLED is defined (cmake -DCAVE_TRACE=ON),
+// otherwise CAVE_TRACE_SCOPE expands to nothing. When compiled in, nothing is
+// recorded until Tracer::start() is called.
+//
+// Each thread appends to its own fixed-size buffer, so recording takes no
+// locks. Names must be string literals (only the pointer is stored).
+//
+#ifdef CAVE_TRACE_ENABLED
+#define CAVE_TRACE_CONCAT2(a, b) a##b
+#define CAVE_TRACE_CONCAT(a, b) CAVE_TRACE_CONCAT2(a, b)
+#define CAVE_TRACE_SCOPE(name) \
+  ::Cave::TraceScope CAVE_TRACE_CONCAT(caveTraceScope, __LINE__)(name)
+#else
+#define CAVE_TRACE_SCOPE(name) ((void)0)
+#endif
+
+namespace Cave {
+
+class Tracer {
+ public:
+  // Begin/end recording on all threads
+  static void start();
+  static void stop();
+  static bool isRecording();
+
+  // Forget all recorded spans. Only call when nothing is generating.
+  static void clear();
+
+  // Write everything recorded so far as a Chrome trace-event JSON object.
+  // Returns the number of spans written.
+  static size_t writeChromeJson(std::ostream& out);
+
+  // Spans lost because a thread's buffer filled up
+  static size_t droppedSpans();
+
+  // Called by TraceScope
+  static uint64_t nowNanos();
+  static void record(const char* name, uint64_t startNanos,
+                     uint64_t endNanos);
+};
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name)
+      : mName(name),
+        mStart(Tracer::isRecording() ? Tracer::nowNanos() : 0) {}
+  ~TraceScope() {
+    if (mStart != 0) {
+      Tracer::record(mName, mStart, Tracer::nowNanos());
+    }
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* mName;
+  uint64_t mStart;
+};
+
+}  // namespace Cave
+
+#endif
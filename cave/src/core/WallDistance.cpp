@@ -0,0 +1,215 @@
+#include "WallDistance.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Cave.h"
+#include "Trace.h"
+
+namespace Cave {
+
+namespace {
+
+const float SQRT2 = 1.41421356f;
+
+bool isWall(int tile) { return !Cave::isEmpty(tile); }
+
+}  // namespace
+
+float WallDistance::getSetBack(int tile) {
+  switch (tile) {
+    case T45a:
+    case T45b:
+    case T45c:
+    case T45d:
+    case T45a2CT:
+    case T45b2CT:
+    case T45c2CT:
+    case T45d2CT:
+    case T45abCT:
+    case T45adCT:
+    case T45baCT:
+    case T45bcCT:
+    case T45cbCT:
+    case T45cdCT:
+    case T45daCT:
+    case T45dcCT:
+      return 0.5f;
+    case V60a1:
+    case V60b1:
+    case V60c1:
+    case V60d1:
+    case H30a1:
+    case H30b1:
+    case H30c1:
+    case H30d1:
+    case V60aCT:
+    case V60bCT:
+    case V60cCT:
+    case V60dCT:
+    case H30aCT:
+    case H30bCT:
+    case H30cCT:
+    case H30dCT:
+    case SINGLE:
+    case END_N:
+    case END_S:
+    case END_E:
+    case END_W:
+      return 0.25f;
+    case V60a2:
+    case V60b2:
+    case V60c2:
+    case V60d2:
+    case H30a2:
+    case H30b2:
+    case H30c2:
+    case H30d2:
+      return 0.75f;
+    default:
+      return 0;
+  }
+}
+
+void WallDistance::build(const TileMap& tileMap, Executor* executor,
+                         int maxWorkers) {
+  CAVE_TRACE_SCOPE("WallDistance::build");
+  // The map has a one cell border all round, which is all wall
+  const int mapHeight = (int)tileMap.size();
+  mStride = mapHeight > 0 ? (int)tileMap[0].size() : 0;
+  mHeight = std::max(0, mapHeight - 2);
+  mWidth = std::max(0, mStride - 2);
+  mDistance.assign((size_t)mapHeight * mStride, 0);
+  if (mHeight == 0 || mWidth == 0) {
+    return;
+  }
+  if (mMetric == CHAMFER) {
+    buildChamfer(tileMap);
+  } else {
+    buildEuclidean(tileMap, executor ? *executor : Executor::getDefault(),
+                   maxWorkers);
+  }
+}
+
+void WallDistance::buildEuclidean(const TileMap& tileMap, Executor& executor,
+                                  int maxWorkers) {
+  const int mapHeight = (int)tileMap.size();
+  const int lastRow = mapHeight - 1;
+  mNearestRow.resize((size_t)mapHeight * mStride);
+
+  // The nearest wall above each cell, then below if that's nearer. A row
+  // at a time so the inner loops run along the rows.
+  int* nearest = mNearestRow.data();
+  for (int x = 0; x < mStride; ++x) {
+    nearest[x] = 0;
+  }
+  for (int y = 1; y < mapHeight; ++y) {
+    const int* above = nearest + (size_t)(y - 1) * mStride;
+    int* here = nearest + (size_t)y * mStride;
+    const int* row = tileMap[y].data();
+    for (int x = 0; x < mStride; ++x) {
+      here[x] = isWall(row[x]) ? y : above[x];
+    }
+  }
+  for (int y = lastRow - 1; y >= 0; --y) {
+    const int* below = nearest + (size_t)(y + 1) * mStride;
+    int* here = nearest + (size_t)y * mStride;
+    for (int x = 0; x < mStride; ++x) {
+      // The border makes below[x] a wall at or below y + 1
+      if (below[x] - y < y - here[x]) {
+        here[x] = below[x];
+      }
+    }
+  }
+
+  // Each row is then the lower envelope of the parabolas
+  // (x - wx)^2 + (y - nearest row)^2 over the columns wx
+  parallelForRows(executor, mapHeight, maxWorkers,
+                  [&](int rowBegin, int rowEnd) {
+    std::vector<double> height(mStride);
+    std::vector<int> apex(mStride);
+    std::vector<double> from(mStride + 1);
+    for (int y = rowBegin; y < rowEnd; ++y) {
+      const int* rows = nearest + (size_t)y * mStride;
+      for (int x = 0; x < mStride; ++x) {
+        const double dy = rows[x] - y;
+        height[x] = dy * dy;
+      }
+      // apex[0..k] are the parabolas on the envelope, apex[i] lowest from
+      // from[i] to from[i + 1]
+      int k = 0;
+      apex[0] = 0;
+      from[0] = -std::numeric_limits<double>::infinity();
+      from[1] = std::numeric_limits<double>::infinity();
+      for (int q = 1; q < mStride; ++q) {
+        double s;
+        for (;;) {
+          const int p = apex[k];
+          s = ((height[q] + (double)q * q) - (height[p] + (double)p * p)) /
+              (2.0 * (q - p));
+          if (s > from[k]) {
+            break;
+          }
+          --k;
+        }
+        ++k;
+        apex[k] = q;
+        from[k] = s;
+        from[k + 1] = std::numeric_limits<double>::infinity();
+      }
+      k = 0;
+      float* out = mDistance.data() + (size_t)y * mStride;
+      for (int x = 0; x < mStride; ++x) {
+        while (from[k + 1] < x) {
+          ++k;
+        }
+        const int wx = apex[k];
+        const double dx = x - wx;
+        const int wy = rows[wx];
+        out[x] = (float)std::sqrt(dx * dx + height[wx]) +
+                 getSetBack(tileMap[wy][wx]);
+      }
+    }
+  });
+}
+
+void WallDistance::buildChamfer(const TileMap& tileMap) {
+  const int mapHeight = (int)tileMap.size();
+  const float far = std::numeric_limits<float>::max() / 2;
+  for (int y = 0; y < mapHeight; ++y) {
+    float* out = mDistance.data() + (size_t)y * mStride;
+    const int* row = tileMap[y].data();
+    for (int x = 0; x < mStride; ++x) {
+      out[x] = isWall(row[x]) ? getSetBack(row[x]) : far;
+    }
+  }
+  // Down and to the right from the cells above and to the left, then back
+  // up. The border is wall, so the edge cells never need looking past.
+  for (int y = 1; y < mapHeight - 1; ++y) {
+    float* out = mDistance.data() + (size_t)y * mStride;
+    const float* above = out - mStride;
+    for (int x = 1; x < mStride - 1; ++x) {
+      float d = out[x];
+      d = std::min(d, above[x - 1] + SQRT2);
+      d = std::min(d, above[x] + 1);
+      d = std::min(d, above[x + 1] + SQRT2);
+      d = std::min(d, out[x - 1] + 1);
+      out[x] = d;
+    }
+  }
+  for (int y = mapHeight - 2; y >= 1; --y) {
+    float* out = mDistance.data() + (size_t)y * mStride;
+    const float* below = out + mStride;
+    for (int x = mStride - 2; x >= 1; --x) {
+      float d = out[x];
+      d = std::min(d, below[x + 1] + SQRT2);
+      d = std::min(d, below[x] + 1);
+      d = std::min(d, below[x - 1] + SQRT2);
+      d = std::min(d, out[x + 1] + 1);
+      out[x] = d;
+    }
+  }
+}
+
+}  // namespace Cave
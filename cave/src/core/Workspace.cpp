@@ -0,0 +1,30 @@
+#include "Workspace.h"
+
+#include "GenerationStats.h"
+
+namespace Cave {
+
+size_t Workspace::bytes() const {
+  size_t total = (mWalls.capacity() + mFloors.capacity() +
+                  mRoomCells.capacity()) *
+                 sizeof(Vector2i);
+  total += mFixUpBands.capacity() * sizeof(CellLists);
+  for (const auto& band : mFixUpBands) {
+    total += (band.walls.capacity() + band.floors.capacity()) *
+             sizeof(Vector2i);
+  }
+  total += (mCellRoom.capacity() + mRoomIds.capacity() +
+            mRoomStart.capacity()) *
+           sizeof(int);
+  total += (mBorderWalls.capacity() + mMST.capacity()) * sizeof(BorderWall);
+  total += gridBytes(mInGrid) + gridBytes(mCornerGrid) +
+           gridBytes(mSmoothedGrid) + gridBytes(mPointsGrid) +
+           gridBytes(mTileMapCopy) + gridBytes(mEditRaw) +
+           gridBytes(mEditWindow);
+  for (const auto& checkpoint : mCheckpoints) {
+    total += gridBytes(checkpoint.mTileMap);
+  }
+  return total;
+}
+
+}  // namespace Cave
@@ -0,0 +1,110 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CaveInfo.h"
+#include "GenerationStats.h"
+#include "TileTypes.h"
+
+namespace Cave {
+
+//
+// The scratch buffers used by Cave::generate and CaveSmoother.
+//
+// Keep one around and hand it to each Cave (setWorkspace) to stop every
+// generation allocating and freeing them. Buffers are cleared, not freed, so
+// once a size has been generated, generating it again allocates nothing
+// here. Not thread safe: use one workspace per concurrent generation.
+//
+// NOTE: The cellular automata (PCG::RogueCave) and the DisjointSets still
+// allocate their own storage every generation (GenerationStats::mLibs), and
+// so does handing work to more than one worker, or logging below INFO. Run
+// on one worker with the same inputs, everything else allocates nothing the
+// second time.
+//
+struct Workspace {
+  // fixUp: cells to change in this pass, and the per band lists they are
+  // gathered from (indexed by the band's first row)
+  struct CellLists {
+    std::vector<Vector2i> walls;
+    std::vector<Vector2i> floors;
+  };
+  std::vector<Vector2i> mWalls;
+  std::vector<Vector2i> mFloors;
+  std::vector<CellLists> mFixUpBands;
+
+  //
+  // findRooms: the rooms, in order of their (DisjointSets) ID.
+  // mCellRoom is width * height, row major, holding the index into
+  // mRoomIds of the room the cell is in or -1 for walls. Room i's cells
+  // are mRoomCells[mRoomStart[i]] to mRoomCells[mRoomStart[i + 1]] - 1.
+  //
+  std::vector<int> mCellRoom;
+  std::vector<int> mRoomIds;
+  std::vector<int> mRoomStart;
+  std::vector<Vector2i> mRoomCells;
+
+  // joinRooms
+  struct BorderWall {
+    Vector2i floor1;
+    Vector2i floor2;
+    Vector2i dir;
+    int room1;
+    int room2;
+    int thickness;
+  };
+  std::vector<BorderWall> mBorderWalls;
+  std::vector<BorderWall> mMST;
+
+  // CaveSmoother
+  std::vector<std::vector<int>> mInGrid;
+  std::vector<std::vector<int>> mCornerGrid;  // Only when smoothing rows
+  std::vector<std::vector<bool>> mSmoothedGrid;
+  std::vector<std::vector<bool>> mPointsGrid;
+  TileMap mTileMapCopy;
+
+  // Cave::editCells: the unsmoothed cells around the edit and the part of
+  // them being smoothed, each as a small TileMap (with a border)
+  TileMap mEditRaw;
+  TileMap mEditWindow;
+
+  //
+  // Cave::generate's checkpoints, only kept if mKeepCheckpoints is set: the
+  // map after initialise [0], after each of the n GenerationSteps [1..n] and
+  // after joinRooms [n + 1], keyed by hashStageInputs. The next generation
+  // starts from the last one its inputs still match, so e.g. changing only
+  // the smoothing options just smooths again. Costs a copy of the map per
+  // checkpoint. Multiresolution CA is one stage, with no checkpoints
+  // between its steps.
+  //
+  struct Checkpoint {
+    uint64_t mKey = 0;
+    TileMap mTileMap;
+    GenerationStats mStats;  // As they were at that point
+  };
+  bool mKeepCheckpoints = false;
+  std::vector<Checkpoint> mCheckpoints;
+
+  int numRooms() const { return (int)mRoomIds.size(); }
+
+  // Approximate bytes held (by capacity)
+  size_t bytes() const;
+};
+
+// Resize to rows x cols and set every cell to value, reusing the rows'
+// existing storage
+template <typename T>
+void resetGrid(std::vector<std::vector<T>>& grid, size_t rows, size_t cols,
+               const T& value) {
+  grid.resize(rows);
+  for (auto& row : grid) {
+    row.assign(cols, value);
+  }
+}
+
+}  // namespace Cave
+
+#endif
@@ -89,6 +89,12 @@ CuteCave& CuteCave::setGenerations(std::vector<Cave::GenerationStep> gens) {
   return *this;
 }
 
+CuteCave& CuteCave::setExecutor(Cave::Executor* executor, int maxWorkers) {
+  m_executor = executor;
+  m_max_workers = maxWorkers;
+  return *this;
+}
+
 ///////////////////////////////////////////////////////////////////////
 
 CuteCave::TileAtlas CuteCave::loadTileAtlas(const char* virtual_path,
@@ -159,11 +165,19 @@ CuteCave::TileAtlas CuteCave::loadTileAtlas(const char* virtual_path,
 
 ///////////////////////////////////////////////////////////////////////
 
-const Cave::TileMap CuteCave::make_cave(int seed) {
+Cave::TileMap CuteCave::make_cave(int seed) {
+  Cave::TileMap tileMap;
+  make_cave_into(tileMap, seed);
+  return tileMap;
+}
+
+void CuteCave::make_cave_into(Cave::TileMap& tileMap, int seed) {
   m_gen_params.seed = seed;
 
   Cave::Cave cave(m_info, m_gen_params);
-  return cave.generate();
+  cave.setExecutor(m_executor, m_max_workers);
+  cave.setWorkspace(&m_workspace);
+  cave.generateInto(tileMap);
 }
 
 }  // namespace CuteCave
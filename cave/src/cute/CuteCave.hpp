@@ -4,8 +4,10 @@
 #include <cute.h>
 
 #include "CaveInfo.h"
+#include "Executor.h"
 #include "GenerationParams.h"
 #include "TileTypes.h"
+#include "Workspace.h"
 
 namespace CuteCave {
 
@@ -34,14 +36,21 @@ class CuteCave {
   CuteCave& setSmoothPoints(bool doSmoothPoints);
   CuteCave& setRemoveDiagonals(bool doRemoveDiagonas);
   CuteCave& setGenerations(std::vector<Cave::GenerationStep> gens);
+  CuteCave& setExecutor(Cave::Executor* executor, int maxWorkers = 0);
 
   TileAtlas loadTileAtlas(const char* virtual_path, int tile_size);
 
-  const Cave::TileMap make_cave(int seed);
+  Cave::TileMap make_cave(int seed);
+  // Regenerate into an existing map (e.g. the one from the last reroll)
+  // without reallocating it
+  void make_cave_into(Cave::TileMap& tileMap, int seed);
 
  private:
   Cave::CaveInfo m_info;
   Cave::GenerationParams m_gen_params;
+  Cave::Executor* m_executor = nullptr;
+  int m_max_workers = 0;
+  Cave::Workspace m_workspace;
 };
 
 }  // namespace CuteCave
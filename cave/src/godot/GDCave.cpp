@@ -5,6 +5,7 @@
 
 #include "Debug.h"
 #include "core/Cave.h"
+#include "core/Diagnostics.h"
 #include "core/TileTypes.h"
 
 using namespace godot;
@@ -30,8 +31,25 @@ void GDCave::_bind_methods() {
   ClassDB::bind_method(D_METHOD("set_amp", "amp"), &GDCave::setAmp);
   ClassDB::bind_method(D_METHOD("set_generations", "gens"),
                        &GDCave::setGenerations);
+  ClassDB::bind_method(D_METHOD("set_coarse_levels", "levels"),
+                       &GDCave::setCoarseLevels);
+  ClassDB::bind_method(D_METHOD("set_coarse_generations", "gens"),
+                       &GDCave::setCoarseGenerations);
+  ClassDB::bind_method(D_METHOD("set_refine_generations", "gens"),
+                       &GDCave::setRefineGenerations);
+  ClassDB::bind_method(D_METHOD("set_max_threads", "maxThreads"),
+                       &GDCave::setMaxThreads);
+  ClassDB::bind_method(D_METHOD("set_keep_checkpoints", "keep"),
+                       &GDCave::setKeepCheckpoints);
+  ClassDB::bind_method(D_METHOD("set_measure_distances", "measure"),
+                       &GDCave::setMeasureDistances);
   ClassDB::bind_method(D_METHOD("make_cave", "pTileMap", "layer", "seed"),
                        &GDCave::make_cave);
+  ClassDB::bind_method(D_METHOD("get_start_cell"), &GDCave::getStartCell);
+  ClassDB::bind_method(D_METHOD("get_exit_cell"), &GDCave::getExitCell);
+  ClassDB::bind_method(D_METHOD("get_distance", "x", "y"),
+                       &GDCave::getDistance);
+  ClassDB::bind_method(D_METHOD("get_flow", "x", "y"), &GDCave::getFlow);
 }
 
 GDCave::GDCave() {
@@ -100,8 +118,10 @@ GDCave* GDCave::setAmp(float amp) {
   return this;
 }
 
-GDCave* GDCave::setGenerations(const godot::Array& gens) {
-  m_gen_params.mGenerations.clear();
+// Each step is an array of the 9 GenerationStep values in order
+static void readGenerations(const godot::Array& gens,
+                            std::vector<Cave::GenerationStep>& steps) {
+  steps.clear();
   for (int i = 0; i < gens.size(); ++i) {
     Array gen = gens[i];
     if (gen.size() == 9) {
@@ -115,11 +135,51 @@ GDCave* GDCave::setGenerations(const godot::Array& gens) {
       step.s5_min = gen[6];
       step.s5_max = gen[7];
       step.reps = gen[8];
-      m_gen_params.mGenerations.push_back(step);
+      steps.push_back(step);
     } else {
       UtilityFunctions::push_warning("Invalid generation step size");
     }
   }
+}
+
+GDCave* GDCave::setGenerations(const godot::Array& gens) {
+  readGenerations(gens, m_gen_params.mGenerations);
+  return this;
+}
+
+GDCave* GDCave::setCoarseLevels(int levels) {
+  m_gen_params.mCoarseLevels = levels;
+  return this;
+}
+
+GDCave* GDCave::setCoarseGenerations(const godot::Array& gens) {
+  readGenerations(gens, m_gen_params.mCoarseGenerations);
+  return this;
+}
+
+GDCave* GDCave::setRefineGenerations(const godot::Array& gens) {
+  readGenerations(gens, m_gen_params.mRefineGenerations);
+  return this;
+}
+
+GDCave* GDCave::setMaxThreads(int maxThreads) {
+  m_max_threads = maxThreads;
+  return this;
+}
+
+GDCave* GDCave::setKeepCheckpoints(bool keep) {
+  m_workspace.mKeepCheckpoints = keep;
+  if (!keep) {
+    m_workspace.mCheckpoints.clear();
+  }
+  return this;
+}
+
+GDCave* GDCave::setMeasureDistances(bool measure) {
+  m_measure_distances = measure;
+  if (!measure) {
+    m_distance_map = Cave::DistanceMap();
+  }
   return this;
 }
 
@@ -127,16 +187,32 @@ void GDCave::make_cave(TileMapLayer* pTileMap, int layer, int seed) {
   m_gen_params.seed = seed;
 
   Cave::Cave cave(m_cave_info, m_gen_params);
-  const Cave::TileMap caveMap = cave.generate();
-  copy_core_to_tilemap(pTileMap, layer, caveMap);
-  LOG_INFO("CAVE DONE " << caveMap[0].size() << "x" << caveMap.size());
-  for (int y = 0; y < caveMap.size(); ++y) {
-    for (int x = 0; x < caveMap[0].size(); ++x) {
-      Cave::TileName tile_name = static_cast<Cave::TileName>(caveMap[y][x]);
-      LOG_DEBUG_CONT(Cave::Cave::isEmpty(tile_name) ? " " : "#");
-    }
-    LOG_DEBUG("");
-  }
+  cave.setExecutor(&m_executor, m_max_threads);
+  cave.setWorkspace(&m_workspace);
+  cave.setDistanceMap(m_measure_distances ? &m_distance_map : nullptr);
+  cave.generateInto(m_tile_map);
+  copy_core_to_tilemap(pTileMap, layer, m_tile_map);
+  LOG_INFO("CAVE DONE " << m_tile_map[0].size() << "x" << m_tile_map.size());
+  CAVE_LOG_TRACE("\n" << Cave::Cave::mapToString(m_tile_map));
+}
+
+Vector2i GDCave::getStartCell() const {
+  const Cave::Vector2i cell = m_distance_map.getStart();
+  return Vector2i(cell.x, cell.y);
+}
+
+Vector2i GDCave::getExitCell() const {
+  const Cave::Vector2i cell = m_distance_map.getExit();
+  return Vector2i(cell.x, cell.y);
+}
+
+int GDCave::getDistance(int x, int y) const {
+  return m_distance_map.getDistance(x, y);
+}
+
+Vector2i GDCave::getFlow(int x, int y) const {
+  const Cave::Vector2i step = m_distance_map.getFlow(x, y);
+  return Vector2i(step.x, step.y);
 }
 
 void GDCave::copy_core_to_tilemap(TileMapLayer* pTileMap, int layer,
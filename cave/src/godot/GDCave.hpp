@@ -6,8 +6,11 @@
 #include <vector>
 
 #include "core/CaveInfo.h"
+#include "core/DistanceMap.h"
 #include "core/GenerationParams.h"
 #include "core/TileTypes.h"
+#include "core/Workspace.h"
+#include "GDExecutor.hpp"
 
 #if defined(WIN32) || defined(_WIN32)
 #ifdef GDCAVE_EXPORTS
@@ -29,7 +32,14 @@ class GDCAVE_API GDCave : public Object {
 
   Cave::CaveInfo m_cave_info;
   Cave::GenerationParams m_gen_params;
-  std::vector<std::vector<int>> m_tile_map;
+  // Reused by every make_cave
+  Cave::TileMap m_tile_map;
+  Cave::Workspace m_workspace;
+  // From the start cell, redone by every make_cave if asked for
+  Cave::DistanceMap m_distance_map;
+  bool m_measure_distances = false;
+  GDExecutor m_executor;
+  int m_max_threads = 0;
 
   godot::Vector2i m_floor_tile;
   godot::Vector2i m_wall_tile;
@@ -50,9 +60,27 @@ class GDCAVE_API GDCave : public Object {
   GDCave* setFreq(float freq);
   GDCave* setAmp(float amp);
   GDCave* setGenerations(const godot::Array& gens);
+  // Multiresolution (see Cave::GenerationParams)
+  GDCave* setCoarseLevels(int levels);
+  GDCave* setCoarseGenerations(const godot::Array& gens);
+  GDCave* setRefineGenerations(const godot::Array& gens);
+  GDCave* setMaxThreads(int maxThreads);
+  // Keep the Workspace checkpoints (see Cave::Workspace), so tweaking e.g.
+  // the smoothing in the editor doesn't regenerate everything. Off by
+  // default, as each is a copy of the map.
+  GDCave* setKeepCheckpoints(bool keep);
+  // Build the DistanceMap the getters below read
+  GDCave* setMeasureDistances(bool measure);
 
   void make_cave(TileMapLayer* pTileMap, int layer, int seed);
 
+  // After make_cave with set_measure_distances(true) (see
+  // Cave::DistanceMap)
+  godot::Vector2i getStartCell() const;
+  godot::Vector2i getExitCell() const;
+  int getDistance(int x, int y) const;
+  godot::Vector2i getFlow(int x, int y) const;
+
   static godot::Vector2i getAtlasCoords(int tile_name);
 
  private:
@@ -0,0 +1,69 @@
+#include "GDExecutor.hpp"
+
+#include <algorithm>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
+#if __has_include(<godot_cpp/core/version.hpp>)
+#include <godot_cpp/core/version.hpp>
+#endif
+
+// WorkerThreadPool::get_caller_task_id / get_caller_group_id are 4.4 on
+#if defined(GODOT_VERSION_MAJOR) && defined(GODOT_VERSION_MINOR) && \
+    (GODOT_VERSION_MAJOR > 4 ||                                    \
+     (GODOT_VERSION_MAJOR == 4 && GODOT_VERSION_MINOR >= 4))
+#define GDCAVE_HAVE_CALLER_IDS 1
+#else
+#define GDCAVE_HAVE_CALLER_IDS 0
+#endif
+
+using namespace godot;
+
+namespace {
+
+// Set while this thread runs an element of one of our group tasks
+thread_local bool tInGroupTask = false;
+
+bool inPoolTask(WorkerThreadPool* pool) {
+  if (tInGroupTask) {
+    return true;
+  }
+#if GDCAVE_HAVE_CALLER_IDS
+  return pool->get_caller_task_id() >= 0 || pool->get_caller_group_id() >= 0;
+#else
+  // The pool can't say, so anything but the main thread is taken to be
+  // one of its tasks
+  (void)pool;
+  OS* os = OS::get_singleton();
+  return os->get_thread_caller_id() != os->get_main_thread_id();
+#endif
+}
+
+}  // namespace
+
+int GDExecutor::concurrency() const {
+  return std::max(1, (int)OS::get_singleton()->get_processor_count());
+}
+
+void GDExecutor::run(int count, int maxWorkers,
+                     const std::function<void(int)>& body) {
+  WorkerThreadPool* pool = WorkerThreadPool::get_singleton();
+  if (count <= 1 || maxWorkers == 1 || inPoolTask(pool)) {
+    for (int i = 0; i < count; ++i) {
+      body(i);
+    }
+    return;
+  }
+  // -1 lets the pool pick how many of its threads to use
+  int tasks = (maxWorkers > 0) ? std::min(maxWorkers, count) : -1;
+  int64_t groupId = pool->add_native_group_task(
+      &GDExecutor::runElement, const_cast<std::function<void(int)>*>(&body),
+      count, tasks, true, "GDCave");
+  pool->wait_for_group_task_completion(groupId);
+}
+
+void GDExecutor::runElement(void* userdata, uint32_t index) {
+  const bool wasInGroupTask = tInGroupTask;
+  tInGroupTask = true;
+  (*static_cast<const std::function<void(int)>*>(userdata))((int)index);
+  tInGroupTask = wasInGroupTask;
+}
@@ -0,0 +1,29 @@
+#ifndef GD_EXECUTOR_H
+#define GD_EXECUTOR_H
+
+#include <cstdint>
+#include <functional>
+
+#include "core/Executor.h"
+
+namespace godot {
+
+//
+// Runs the cave's parallel stages as WorkerThreadPool group tasks so
+// generation shares Godot's threads instead of starting its own. Called
+// from one of the pool's own tasks it runs inline instead, as waiting
+// there for a group can deadlock once every pool thread is waiting.
+//
+class GDExecutor : public Cave::Executor {
+ public:
+  int concurrency() const override;
+  void run(int count, int maxWorkers,
+           const std::function<void(int)>& body) override;
+
+ private:
+  static void runElement(void* userdata, uint32_t index);
+};
+
+}  // namespace godot
+
+#endif
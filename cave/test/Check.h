@@ -0,0 +1,35 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+//
+// Just enough for the cave_*_test executables: CHECK(cond) reports the
+// condition and where it is if it's false, and Check::result() is main's
+// return value.
+//
+#include <iostream>
+
+#define CHECK(cond) ::Check::check((cond), #cond, __FILE__, __LINE__)
+
+namespace Check {
+
+inline int& failures() {
+  static int count = 0;
+  return count;
+}
+
+inline bool check(bool ok, const char* what, const char* file, int line) {
+  if (!ok) {
+    std::cerr << file << ":" << line << ": FAIL " << what << std::endl;
+    ++failures();
+  }
+  return ok;
+}
+
+inline int result(const char* name) {
+  std::cerr << name << ": " << failures() << " failed" << std::endl;
+  return failures() ? 1 : 0;
+}
+
+}  // namespace Check
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CAVE_TEST_PRESETS_H
+#define CAVE_TEST_PRESETS_H
+
+#include <vector>
+
+#include "CaveInfo.h"
+#include "GenerationParams.h"
+
+//
+// The eight generation presets from the README, plus its base setup
+// (seed 424242, noise_freq 13.7, 1 octave, no perlin).
+//
+// add_gen_3x3 only sets the 3x3 ranges so the 5x5 ranges are left out of
+// reach (-1) to stop them ever matching.
+//
+namespace Presets {
+
+struct Preset {
+  const char* name;
+  float wallChance;
+  std::vector<Cave::GenerationStep> steps;
+};
+
+inline Cave::GenerationStep gen3x3(int b3min, int b3max, int s3min, int s3max,
+                                   int reps) {
+  return {b3min, b3max, -1, -1, s3min, s3max, -1, -1, reps};
+}
+
+inline Cave::GenerationStep gen3x3_5x5(int b3min, int b3max, int b5min,
+                                       int b5max, int s3min, int s3max,
+                                       int s5min, int s5max, int reps) {
+  return {b3min, b3max, b5min, b5max, s3min, s3max, s5min, s5max, reps};
+}
+
+inline const std::vector<Preset>& all() {
+  static const std::vector<Preset> presets = {
+      {"organic",
+       0.50f,
+       {gen3x3(5, 8, 4, 8, 6), gen3x3(6, 8, 3, 8, 6), gen3x3(4, 4, 4, 8, 5)}},
+      {"balanced", 0.40f, {gen3x3(4, 5, 4, 7, 4), gen3x3(3, 8, 1, 8, 1)}},
+      {"sparse_maze", 0.20f, {gen3x3(3, 3, 1, 5, 10)}},
+      {"connected_maze", 0.40f, {gen3x3(3, 3, 2, 4, 10)}},
+      {"open_maze", 0.35f, {gen3x3(3, 3, 2, 4, 6)}},
+      {"curvy_5x5", 0.40f, {gen3x3_5x5(5, 9, 15, 25, 3, 8, 15, 20, 4)}},
+      {"swiss_cheese", 0.65f, {gen3x3_5x5(3, 4, 12, 16, 2, 5, 10, 14, 2)}},
+      {"broken_walls", 0.40f, {gen3x3_5x5(4, 5, 13, 17, 4, 5, 14, 20, 4)}},
+  };
+  return presets;
+}
+
+inline Cave::GenerationParams makeParams(const Preset& preset, int seed) {
+  Cave::GenerationParams params;
+  params.seed = seed;
+  params.mOctaves = 1;
+  params.mPerlin = false;
+  params.mFreq = 13.7f;
+  params.mWallChance = preset.wallChance;
+  params.mGenerations = preset.steps;
+  return params;
+}
+
+inline Cave::CaveInfo makeInfo(int width, int height, bool smoothing) {
+  Cave::CaveInfo info;
+  info.mCaveWidth = width;
+  info.mCaveHeight = height;
+  info.mSmoothing = smoothing;
+  return info;
+}
+
+}  // namespace Presets
+
+#endif
@@ -0,0 +1,73 @@
+//
+// cave_alloc_test: generating the same cave again into the same map with
+// the same Workspace, on one worker, allocates nothing outside the Libs'
+// cellular automata and DisjointSets (GenerationStats::mLibs). Built
+// against the library with allocation tracking (see AllocTracker.h).
+//
+#include "AllocTracker.h"
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "Executor.h"
+#include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "Presets.h"
+#include "TileTypes.h"
+#include "Workspace.h"
+
+namespace {
+
+Cave::GenerationStats generateInto(const Cave::CaveInfo& info,
+                                   const Cave::GenerationParams& params,
+                                   Cave::Executor* executor, int maxWorkers,
+                                   Cave::Workspace& workspace,
+                                   Cave::TileMap& tileMap) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  cave.setExecutor(executor, maxWorkers);
+  cave.setWorkspace(&workspace);
+  Cave::GenerationStats stats;
+  cave.generateInto(tileMap, &stats);
+  return stats;
+}
+
+}  // namespace
+
+int main() {
+  CHECK(Cave::AllocTracker::isEnabled());
+  Cave::InlineExecutor inlineExecutor;
+  const auto& presets = Presets::all();
+  bool firstAllocates = true;
+  bool againAllocatesNothing = true;
+  bool sameMap = true;
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 33 + (int)p);
+    for (bool smoothing : {false, true}) {
+      const Cave::CaveInfo info = Presets::makeInfo(97, 61, smoothing);
+      // The default executor capped at one worker, and one that only has
+      // the one
+      for (Cave::Executor* executor : {(Cave::Executor*)nullptr,
+                                       (Cave::Executor*)&inlineExecutor}) {
+        Cave::Workspace workspace;
+        Cave::TileMap tileMap;
+        const int maxWorkers = executor ? 0 : 1;
+        const Cave::GenerationStats first = generateInto(
+            info, params, executor, maxWorkers, workspace, tileMap);
+        const Cave::TileMap firstMap = tileMap;
+        const Cave::GenerationStats again = generateInto(
+            info, params, executor, maxWorkers, workspace, tileMap);
+        firstAllocates &=
+            first.mTotal.mAllocCount > first.mLibs.mAllocCount;
+        againAllocatesNothing &=
+            again.mLibs.mAllocCount > 0 &&
+            again.mTotal.mAllocCount == again.mLibs.mAllocCount;
+        sameMap &= tileMap == firstMap;
+      }
+    }
+  }
+  CHECK(firstAllocates);
+  CHECK(againAllocatesNothing);
+  CHECK(sameMap);
+  return Check::result("cave_alloc_test");
+}
@@ -0,0 +1,272 @@
+//
+// cave_bench: times Cave::generate (broken down by stage) and the smoother
+// on its own, for each README preset, at each size, with smoothing on and
+// off. Results are written as JSON.
+//
+//   cave_bench [--sizes 64,256,...] [--max-size N] [--reps N] [--warmup N]
+//              [--preset name] [--seed N] [--out file.json]
+//              [--trace trace.json]
+//
+// --trace also writes the spans recorded during the run in Chrome's
+// trace-event format (open it in chrome://tracing or Perfetto). The spans
+// are only recorded when the library is built with -DCAVE_TRACE=ON,
+// otherwise the trace is empty.
+//
+// NOTE: The default sizes go up to 8192x8192 which takes a long time with
+// the default repetitions. Use --max-size for a quick run.
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "CaveSmoother.h"
+#include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "Presets.h"
+#include "TileTypes.h"
+#include "Trace.h"
+
+namespace {
+
+struct Options {
+  std::vector<int> sizes = {64, 128, 256, 512, 1024, 2048, 4096, 8192};
+  int reps = 5;
+  int warmup = 1;
+  int seed = 424242;
+  std::string preset;
+  std::string out = "cave_bench.json";
+  std::string trace;
+};
+
+// The stages reported from GenerationStats
+struct StageField {
+  const char* name;
+  Cave::StageStats Cave::GenerationStats::*stage;
+};
+const StageField STAGES[] = {
+    {"total", &Cave::GenerationStats::mTotal},
+    {"initialise", &Cave::GenerationStats::mInitialise},
+    {"runCellularAutomata", &Cave::GenerationStats::mCellularAutomata},
+    {"fixUp", &Cave::GenerationStats::mFixUp},
+    {"findRooms", &Cave::GenerationStats::mFindRooms},
+    {"detectBorderWalls", &Cave::GenerationStats::mDetectBorderWalls},
+    {"findMST", &Cave::GenerationStats::mFindMST},
+    {"carveTunnels", &Cave::GenerationStats::mCarveTunnels},
+    {"smoothEdges", &Cave::GenerationStats::mSmoothEdges},
+    {"smoothCorners", &Cave::GenerationStats::mSmoothCorners},
+    {"smoothPoints", &Cave::GenerationStats::mSmoothPoints},
+    {"removeDiagonals", &Cave::GenerationStats::mRemoveDiagonals},
+};
+
+double percentile(std::vector<double> samples, double pct) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  // Nearest rank
+  size_t rank = (size_t)(pct / 100.0 * (double)samples.size() + 0.5);
+  rank = std::min(std::max(rank, (size_t)1), samples.size());
+  return samples[rank - 1];
+}
+
+void writeDistribution(std::ostream& out, const std::vector<double>& ms) {
+  double sum = 0;
+  for (double v : ms) {
+    sum += v;
+  }
+  out << "{\"min\":" << percentile(ms, 0) << ",\"p50\":" << percentile(ms, 50)
+      << ",\"p90\":" << percentile(ms, 90) << ",\"p99\":" << percentile(ms, 99)
+      << ",\"max\":" << percentile(ms, 100)
+      << ",\"mean\":" << (ms.empty() ? 0 : sum / (double)ms.size()) << "}";
+}
+
+std::vector<int> parseSizes(const char* arg) {
+  std::vector<int> sizes;
+  for (const char* p = arg; *p;) {
+    sizes.push_back(std::atoi(p));
+    const char* comma = std::strchr(p, ',');
+    if (!comma) {
+      break;
+    }
+    p = comma + 1;
+  }
+  return sizes;
+}
+
+bool parseArgs(int argc, char** argv, Options& opts) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (arg == "--sizes") {
+      opts.sizes = parseSizes(value);
+    } else if (arg == "--max-size") {
+      int maxSize = std::atoi(value);
+      opts.sizes.erase(std::remove_if(opts.sizes.begin(), opts.sizes.end(),
+                                      [&](int s) { return s > maxSize; }),
+                       opts.sizes.end());
+    } else if (arg == "--reps") {
+      opts.reps = std::max(1, std::atoi(value));
+    } else if (arg == "--warmup") {
+      opts.warmup = std::max(0, std::atoi(value));
+    } else if (arg == "--seed") {
+      opts.seed = std::atoi(value);
+    } else if (arg == "--preset") {
+      opts.preset = value;
+    } else if (arg == "--out") {
+      opts.out = value;
+    } else if (arg == "--trace") {
+      opts.trace = value;
+    } else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+// Full generate(), keeping the per-stage times of each timed repetition
+//
+void benchGenerate(std::ostream& out, const Options& opts,
+                   const Presets::Preset& preset, int size, bool smoothing) {
+  Cave::CaveInfo info = Presets::makeInfo(size, size, smoothing);
+  Cave::GenerationParams params = Presets::makeParams(preset, opts.seed);
+
+  std::vector<std::vector<double>> stageMs(std::size(STAGES));
+  Cave::GenerationStats stats;
+  for (int rep = 0; rep < opts.warmup + opts.reps; ++rep) {
+    Cave::Cave cave(info, params);
+    cave.generate(&stats);
+    if (rep < opts.warmup) {
+      continue;
+    }
+    for (size_t s = 0; s < std::size(STAGES); ++s) {
+      stageMs[s].push_back((stats.*STAGES[s].stage).mMillis);
+    }
+  }
+
+  out << "{\"benchmark\":\"generate\",\"preset\":\"" << preset.name
+      << "\",\"width\":" << size << ",\"height\":" << size
+      << ",\"smoothing\":" << (smoothing ? "true" : "false")
+      << ",\"stages\":{";
+  for (size_t s = 0; s < std::size(STAGES); ++s) {
+    out << (s ? "," : "") << "\"" << STAGES[s].name << "\":";
+    writeDistribution(out, stageMs[s]);
+  }
+  // The counts are the same every repetition (same seed)
+  out << "},\"counts\":{\"fixUpIterations\":" << stats.mFixUpIterations
+      << ",\"rooms\":" << stats.mRooms
+      << ",\"borderWalls\":" << stats.mBorderWalls
+      << ",\"mstEdges\":" << stats.mMSTEdges
+      << ",\"edgeTilesChanged\":" << stats.mEdgeTilesChanged
+      << ",\"cornerTilesChanged\":" << stats.mCornerTilesChanged
+      << ",\"pointTilesChanged\":" << stats.mPointTilesChanged
+      << ",\"peakScratchBytes\":" << stats.mPeakScratchBytes
+      << ",\"allocCount\":" << stats.mTotal.mAllocCount
+      << ",\"allocBytes\":" << stats.mTotal.mAllocBytes
+      << ",\"peakLiveBytes\":" << stats.mTotal.mPeakLiveBytes << "}}";
+}
+
+//
+// The smoother on its own, run on copies of an unsmoothed cave
+//
+void benchSmoother(std::ostream& out, const Options& opts,
+                   const Presets::Preset& preset, int size) {
+  Cave::CaveInfo rawInfo = Presets::makeInfo(size, size, false);
+  Cave::GenerationParams params = Presets::makeParams(preset, opts.seed);
+  Cave::Cave cave(rawInfo, params);
+  const Cave::TileMap raw = cave.generate();
+
+  Cave::CaveInfo info = Presets::makeInfo(size, size, true);
+  std::vector<double> ms;
+  for (int rep = 0; rep < opts.warmup + opts.reps; ++rep) {
+    Cave::TileMap tileMap = raw;
+    auto start = std::chrono::steady_clock::now();
+    Cave::CaveSmoother smoother(tileMap, info);
+    smoother.smooth();
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (rep >= opts.warmup) {
+      ms.push_back(elapsed.count());
+    }
+  }
+
+  out << "{\"benchmark\":\"smoother\",\"preset\":\"" << preset.name
+      << "\",\"width\":" << size << ",\"height\":" << size
+      << ",\"smoothing\":true,\"stages\":{\"smooth\":";
+  writeDistribution(out, ms);
+  out << "}}";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!parseArgs(argc, argv, opts)) {
+    return 1;
+  }
+
+  std::ofstream out(opts.out);
+  if (!out) {
+    std::cerr << "Can't write " << opts.out << std::endl;
+    return 1;
+  }
+  std::ofstream trace;
+  if (!opts.trace.empty()) {
+    trace.open(opts.trace);
+    if (!trace) {
+      std::cerr << "Can't write " << opts.trace << std::endl;
+      return 1;
+    }
+#ifndef CAVE_TRACE_ENABLED
+    std::cerr << "Built without CAVE_TRACE, the trace will be empty"
+              << std::endl;
+#endif
+    Cave::Tracer::start();
+  }
+
+  out << "{\"tool\":\"cave_bench\",\"reps\":" << opts.reps
+      << ",\"warmup\":" << opts.warmup << ",\"seed\":" << opts.seed
+      << ",\"results\":[";
+  bool first = true;
+  for (const auto& preset : Presets::all()) {
+    if (!opts.preset.empty() && opts.preset != preset.name) {
+      continue;
+    }
+    for (int size : opts.sizes) {
+      for (bool smoothing : {false, true}) {
+        std::cerr << preset.name << " " << size << "x" << size
+                  << (smoothing ? " smoothed" : "") << std::endl;
+        out << (first ? "\n" : ",\n");
+        benchGenerate(out, opts, preset, size, smoothing);
+        first = false;
+      }
+      out << ",\n";
+      benchSmoother(out, opts, preset, size);
+    }
+  }
+  out << "\n]}\n";
+  std::cerr << "Wrote " << opts.out << std::endl;
+  if (trace.is_open()) {
+    Cave::Tracer::stop();
+    const size_t numSpans = Cave::Tracer::writeChromeJson(trace);
+    std::cerr << "Wrote " << numSpans << " spans to " << opts.trace;
+    if (Cave::Tracer::droppedSpans() > 0) {
+      std::cerr << " (" << Cave::Tracer::droppedSpans() << " dropped)";
+    }
+    std::cerr << std::endl;
+  }
+  return 0;
+}
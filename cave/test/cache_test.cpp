@@ -0,0 +1,193 @@
+//
+// cave_cache_test: CaveCache missing then hitting with the same map,
+// regenerating over truncated, damaged and mismatched files, and trimming
+// the oldest files down to 3/4 of maxBytes.
+//
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveCache.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* DIRECTORY = "cave_cache_test_dir";
+const uint64_t PLENTY = 1 << 30;
+
+Cave::TileMap generateFresh(const Cave::CaveInfo& info,
+                            const Cave::GenerationParams& params) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  return cave.generate();
+}
+
+std::vector<char> readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::vector<char>& bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), bytes.size());
+}
+
+void testMissThenHit(const Cave::CaveInfo& info,
+                     const Cave::GenerationParams& params) {
+  const Cave::TileMap expected = generateFresh(info, params);
+  Cave::CaveCache cache(DIRECTORY, PLENTY);
+  Cave::TileMap tileMap;
+  CHECK(!cache.generateInto(info, params, tileMap));
+  CHECK(tileMap == expected);
+  CHECK(fs::exists(cache.getPath(info, params)));
+
+  // Hits whatever the map held before, in this cache and a new one
+  tileMap.assign(3, std::vector<int>(4, Cave::FLOOR));
+  CHECK(cache.generateInto(info, params, tileMap));
+  CHECK(tileMap == expected);
+  Cave::CaveCache another(DIRECTORY, PLENTY);
+  Cave::TileMap loaded;
+  CHECK(another.generateInto(info, params, loaded));
+  CHECK(loaded == expected);
+  CHECK(cache.getStats().mMisses == 1 && cache.getStats().mHits == 1);
+  CHECK(cache.getStats().mCorrupt == 0);
+}
+
+// Damage the stored file, then expect it found bad and regenerated
+void testDamaged(const Cave::CaveInfo& info,
+                 const Cave::GenerationParams& params) {
+  const Cave::TileMap expected = generateFresh(info, params);
+  Cave::CaveCache cache(DIRECTORY, PLENTY);
+  const std::string path = cache.getPath(info, params);
+  Cave::TileMap tileMap;
+  cache.generateInto(info, params, tileMap);
+  const std::vector<char> good = readFile(path);
+
+  std::vector<std::vector<char>> damaged;
+  damaged.push_back({});  // Empty
+  damaged.push_back(std::vector<char>(good.begin(), good.begin() + 10));
+  damaged.push_back(std::vector<char>(good.begin(), good.end() - 1));
+  for (size_t at : {(size_t)0, (size_t)6, (size_t)14, good.size() / 2,
+                    good.size() - 1}) {
+    std::vector<char> flipped = good;
+    flipped[at] ^= 0x10;
+    damaged.push_back(flipped);
+  }
+
+  // Another cave's file under this one's name
+  Cave::GenerationParams other = params;
+  ++other.seed;
+  Cave::TileMap otherMap;
+  cache.generateInto(info, other, otherMap);
+  damaged.push_back(readFile(cache.getPath(info, other)));
+
+  bool regenerated = true;
+  bool counted = true;
+  bool rewritten = true;
+  for (const std::vector<char>& bytes : damaged) {
+    writeFile(path, bytes);
+    const int corrupt = cache.getStats().mCorrupt;
+    tileMap.clear();
+    regenerated &= !cache.generateInto(info, params, tileMap);
+    regenerated &= tileMap == expected;
+    counted &= cache.getStats().mCorrupt == corrupt + 1;
+    rewritten &= readFile(path) == good;
+  }
+  CHECK(regenerated);
+  CHECK(counted);
+  CHECK(rewritten);
+}
+
+uint64_t directoryBytes() {
+  uint64_t total = 0;
+  for (const auto& entry : fs::directory_iterator(DIRECTORY)) {
+    total += entry.file_size();
+  }
+  return total;
+}
+
+void testTrim(const Cave::CaveInfo& info,
+              const Cave::GenerationParams& params) {
+  fs::remove_all(DIRECTORY);
+  std::vector<std::string> paths;
+  std::vector<uint64_t> sizes;
+  uint64_t total = 0;
+  {
+    Cave::CaveCache cache(DIRECTORY, PLENTY);
+    for (int i = 0; i < 8; ++i) {
+      Cave::GenerationParams seeded = params;
+      seeded.seed = params.seed + i;
+      Cave::TileMap tileMap;
+      cache.generateInto(info, seeded, tileMap);
+      paths.push_back(cache.getPath(info, seeded));
+      sizes.push_back(fs::file_size(paths.back()));
+      total += sizes.back();
+    }
+    CHECK(cache.getStats().mEvicted == 0);
+  }
+  // Oldest first, an hour apart
+  const auto now = fs::file_time_type::clock::now();
+  for (size_t i = 0; i < paths.size(); ++i) {
+    fs::last_write_time(paths[i],
+                        now - std::chrono::hours(paths.size() - i));
+  }
+
+  // A hit makes the oldest the newest
+  Cave::CaveCache cache(DIRECTORY, total);
+  Cave::TileMap tileMap;
+  CHECK(cache.generateInto(info, params, tileMap));
+  const std::vector<size_t> order = {1, 2, 3, 4, 5, 6, 7, 0};
+
+  // One more goes over the limit
+  Cave::GenerationParams extra = params;
+  extra.seed = params.seed + 8;
+  CHECK(!cache.generateInto(info, extra, tileMap));
+  const uint64_t target = total / 4 * 3;
+  const uint64_t left = directoryBytes();
+  CHECK(left <= target);
+  CHECK(fs::exists(cache.getPath(info, extra)));
+
+  // The oldest went, and no more than needed
+  size_t evicted = 0;
+  while (evicted < order.size() && !fs::exists(paths[order[evicted]])) {
+    ++evicted;
+  }
+  CHECK(evicted > 0 && (int)evicted == cache.getStats().mEvicted);
+  bool keptNewer = true;
+  for (size_t i = evicted; i < order.size(); ++i) {
+    keptNewer &= fs::exists(paths[order[i]]);
+  }
+  CHECK(keptNewer);
+  CHECK(left + sizes[order[evicted - 1]] > target);
+}
+
+}  // namespace
+
+int main() {
+  fs::remove_all(DIRECTORY);
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 37 + (int)p);
+    for (bool smoothing : {false, true}) {
+      const Cave::CaveInfo info = Presets::makeInfo(53, 41, smoothing);
+      testMissThenHit(info, params);
+      testDamaged(info, params);
+    }
+  }
+  testTrim(Presets::makeInfo(40, 30, true),
+           Presets::makeParams(presets[0], 5));
+  fs::remove_all(DIRECTORY);
+  return Check::result("cave_cache_test");
+}
@@ -0,0 +1,13 @@
+# Checks the Chrome trace cave_bench --trace wrote (run by ctest).
+#   cmake -DTRACE_FILE=trace.json -DEXPECT_SPANS=ON -P check_trace.cmake
+if(NOT EXISTS "${TRACE_FILE}")
+    message(FATAL_ERROR "${TRACE_FILE} wasn't written")
+endif()
+file(READ "${TRACE_FILE}" trace)
+if(NOT trace MATCHES "^{\"displayTimeUnit\":\"ms\",\"traceEvents\":\\[")
+    message(FATAL_ERROR "${TRACE_FILE} isn't a Chrome trace")
+endif()
+# Spans are only recorded when the library is built with CAVE_TRACE
+if(EXPECT_SPANS AND NOT trace MATCHES "\"name\":\"generate\"")
+    message(FATAL_ERROR "${TRACE_FILE} has no generate spans")
+endif()
@@ -0,0 +1,143 @@
+//
+// cave_checkpoint_test: generating again in a Workspace that keeps
+// checkpoints gives the same map as a fresh generate, resuming from the
+// checkpoint after joinRooms when only the smoothing options changed and
+// from an earlier one when a later GenerationStep did.
+//
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "Presets.h"
+#include "TileTypes.h"
+#include "Workspace.h"
+
+namespace {
+
+// Smoothing with and without corners and points, removing diagonals,
+// and none
+std::vector<Cave::CaveInfo> smoothingOptions(int width, int height) {
+  std::vector<Cave::CaveInfo> infos;
+  for (int mode = 0; mode < 5; ++mode) {
+    Cave::CaveInfo info = Presets::makeInfo(width, height, mode < 3);
+    info.mSmoothCorners = mode == 0 || mode == 1;
+    info.mSmoothPoints = mode == 0 || mode == 2;
+    info.mRemoveDiagonals = mode == 3;
+    infos.push_back(info);
+  }
+  return infos;
+}
+
+Cave::TileMap generateFresh(const Cave::CaveInfo& info,
+                            const Cave::GenerationParams& params,
+                            Cave::GenerationStats* stats = nullptr) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  return cave.generate(stats);
+}
+
+Cave::TileMap generateIn(Cave::Workspace& workspace,
+                         const Cave::CaveInfo& info,
+                         const Cave::GenerationParams& params,
+                         Cave::GenerationStats& stats) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  cave.setWorkspace(&workspace);
+  return cave.generate(&stats);
+}
+
+bool sameFingerprints(const Cave::GenerationStats& a,
+                      const Cave::GenerationStats& b) {
+  if (a.mFingerprints.size() != b.mFingerprints.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.mFingerprints.size(); ++i) {
+    if (a.mFingerprints[i].mFingerprint != b.mFingerprints[i].mFingerprint) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Generate in the workspace and fresh, and compare
+struct Run {
+  bool same = true;
+  int checkpoint = -1;
+};
+
+Run generateBoth(Cave::Workspace& workspace, const Cave::CaveInfo& info,
+                 const Cave::GenerationParams& params) {
+  Cave::GenerationStats stats;
+  stats.mRecordFingerprints = true;
+  const Cave::TileMap tileMap = generateIn(workspace, info, params, stats);
+  Cave::GenerationStats freshStats;
+  freshStats.mRecordFingerprints = true;
+  Run run;
+  run.same = tileMap == generateFresh(info, params, &freshStats) &&
+             sameFingerprints(stats, freshStats);
+  run.checkpoint = stats.mCheckpoint;
+  return run;
+}
+
+void testSmoothingOnly(const Cave::GenerationParams& params) {
+  const std::vector<Cave::CaveInfo> infos = smoothingOptions(70, 50);
+  const int joined = (int)params.mGenerations.size() + 1;
+  Cave::Workspace workspace;
+  workspace.mKeepCheckpoints = true;
+  CHECK(generateBoth(workspace, infos[0], params).checkpoint == -1);
+
+  // Each one after the first, then back to the first
+  bool same = true;
+  bool resumed = true;
+  for (size_t i = 1; i <= infos.size(); ++i) {
+    const Run run = generateBoth(workspace, infos[i % infos.size()], params);
+    same &= run.same;
+    resumed &= run.checkpoint == joined;
+  }
+  CHECK(same);
+  CHECK(resumed);
+}
+
+void testOtherChanges(const Cave::GenerationParams& params) {
+  const Cave::CaveInfo info = smoothingOptions(70, 50)[0];
+  Cave::Workspace workspace;
+  workspace.mKeepCheckpoints = true;
+  generateBoth(workspace, info, params);
+
+  // The last step: from the checkpoint before it (multiresolution CA has
+  // none between its steps)
+  Cave::GenerationParams lastStep = params;
+  if (!lastStep.mGenerations.empty()) {
+    ++lastStep.mGenerations.back().reps;
+    const Run run = generateBoth(workspace, info, lastStep);
+    CHECK(run.same);
+    const int before = (int)params.mGenerations.size() - 1;
+    CHECK(run.checkpoint == (params.mCoarseLevels > 0 ? 0 : before));
+  }
+
+  // Another seed: from the start
+  Cave::GenerationParams seed = params;
+  ++seed.seed;
+  const Run run = generateBoth(workspace, info, seed);
+  CHECK(run.same);
+  CHECK(run.checkpoint == -1);
+
+  // and back to the first params
+  CHECK(generateBoth(workspace, info, params).same);
+}
+
+}  // namespace
+
+int main() {
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 21 + (int)p);
+    testSmoothingOnly(params);
+    testOtherChanges(params);
+  }
+  return Check::result("cave_checkpoint_test");
+}
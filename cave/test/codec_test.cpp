@@ -0,0 +1,217 @@
+//
+// cave_codec_test: encodeCave / decodeCave, the stream encoder and decoder,
+// and decodeCaveRegion (across chunk boundaries and at the edges), plus
+// corrupt and truncated input being turned away.
+//
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveCodec.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+Cave::TileMap generate(int width, int height, bool smoothing, int seed) {
+  Cave::CaveInfo info = Presets::makeInfo(width, height, smoothing);
+  Cave::Cave cave(info, Presets::makeParams(Presets::all()[1], seed));
+  return cave.generate();
+}
+
+// Every tile type scattered about, so rows mix raw and run length masks
+Cave::TileMap randomMap(int width, int height, std::mt19937& rng) {
+  Cave::TileMap tileMap(height, std::vector<int>(width));
+  std::uniform_int_distribution<int> tile(0, Cave::TILE_COUNT - 1);
+  std::uniform_int_distribution<int> percent(0, 99);
+  for (auto& row : tileMap) {
+    const int wallChance = percent(rng);
+    for (int& cell : row) {
+      const int roll = percent(rng);
+      cell = roll < wallChance ? Cave::WALL
+             : roll < 95       ? Cave::FLOOR
+                               : tile(rng);
+    }
+  }
+  return tileMap;
+}
+
+Cave::TileMap subMap(const Cave::TileMap& tileMap, int x, int y, int w,
+                     int h) {
+  Cave::TileMap region(h);
+  for (int ry = 0; ry < h; ++ry) {
+    region[ry].assign(tileMap[y + ry].begin() + x,
+                      tileMap[y + ry].begin() + x + w);
+  }
+  return region;
+}
+
+bool checkRegion(const std::vector<uint8_t>& data,
+                 const Cave::TileMap& tileMap, int x, int y, int w, int h) {
+  Cave::TileMap region;
+  return Cave::decodeCaveRegion(data.data(), data.size(), x, y, w, h,
+                                region) &&
+         region == subMap(tileMap, x, y, w, h);
+}
+
+void testRoundTrip(const Cave::TileMap& tileMap, int chunkRows,
+                   std::mt19937& rng) {
+  const int width = (int)tileMap[0].size();
+  const int height = (int)tileMap.size();
+  const std::vector<uint8_t> data = Cave::encodeCave(tileMap, chunkRows);
+
+  Cave::TileMap decoded;
+  CHECK(Cave::decodeCave(data.data(), data.size(), decoded));
+  CHECK(decoded == tileMap);
+
+  // The stream classes write and read the same bytes
+  std::ostringstream out(std::ios::binary);
+  Cave::CaveStreamEncoder encoder(out, width, height, chunkRows);
+  for (const auto& row : tileMap) {
+    encoder.addRow(row.data());
+  }
+  CHECK(encoder.finish());
+  const std::string streamed = out.str();
+  CHECK(std::vector<uint8_t>(streamed.begin(), streamed.end()) == data);
+
+  std::istringstream in(streamed, std::ios::binary);
+  Cave::CaveStreamDecoder decoder(in);
+  CHECK(decoder.isValid());
+  CHECK(decoder.getWidth() == width && decoder.getHeight() == height);
+  std::vector<int> row(width);
+  bool rowsMatch = true;
+  for (int y = 0; y < height; ++y) {
+    rowsMatch &= decoder.readRow(row.data()) && row == tileMap[y];
+  }
+  CHECK(rowsMatch);
+  CHECK(!decoder.readRow(row.data()));
+
+  // Regions: the whole map, the corners, each side of every chunk boundary
+  // and some at random
+  CHECK(checkRegion(data, tileMap, 0, 0, width, height));
+  CHECK(checkRegion(data, tileMap, 0, 0, 1, 1));
+  CHECK(checkRegion(data, tileMap, width - 1, height - 1, 1, 1));
+  for (int boundary = chunkRows; boundary < height; boundary += chunkRows) {
+    CHECK(checkRegion(data, tileMap, 0, boundary - 1, width, 2));
+    CHECK(checkRegion(data, tileMap, 0, boundary, width, 1));
+    CHECK(checkRegion(data, tileMap, width / 2, boundary - 1, 1, 1));
+  }
+  std::uniform_int_distribution<int> anyX(0, width - 1);
+  std::uniform_int_distribution<int> anyY(0, height - 1);
+  bool regionsMatch = true;
+  for (int i = 0; i < 50; ++i) {
+    const int x = anyX(rng);
+    const int y = anyY(rng);
+    const int w = std::uniform_int_distribution<int>(1, width - x)(rng);
+    const int h = std::uniform_int_distribution<int>(1, height - y)(rng);
+    regionsMatch &= checkRegion(data, tileMap, x, y, w, h);
+  }
+  CHECK(regionsMatch);
+
+  // Regions that don't fit
+  Cave::TileMap region;
+  CHECK(!Cave::decodeCaveRegion(data.data(), data.size(), -1, 0, 1, 1,
+                                region));
+  CHECK(!Cave::decodeCaveRegion(data.data(), data.size(), 0, 0, width + 1, 1,
+                                region));
+  CHECK(!Cave::decodeCaveRegion(data.data(), data.size(), 0, height, 1, 1,
+                                region));
+  CHECK(!Cave::decodeCaveRegion(data.data(), data.size(), 0, 0, 0, 1,
+                                region));
+}
+
+void testCorrupt(const Cave::TileMap& tileMap, std::mt19937& rng) {
+  const int width = (int)tileMap[0].size();
+  const int height = (int)tileMap.size();
+  const std::vector<uint8_t> data = Cave::encodeCave(tileMap, 8);
+  Cave::TileMap decoded;
+
+  // Anything cut short fails (the chunk index at the end goes first)
+  bool truncatedFails = true;
+  for (size_t size = 0; size < data.size(); ++size) {
+    truncatedFails &= !Cave::decodeCaveRegion(data.data(), size, 0, 0, width,
+                                              height, decoded);
+  }
+  CHECK(truncatedFails);
+  // Cut within the rows, neither decodeCave nor the stream decoder gets a
+  // whole map
+  const std::string bytes(data.begin(), data.end());
+  bool rowsCutFail = true;
+  for (size_t size = 0; size < data.size() / 2; ++size) {
+    rowsCutFail &= !Cave::decodeCave(data.data(), size, decoded);
+    std::istringstream in(bytes.substr(0, size), std::ios::binary);
+    Cave::CaveStreamDecoder decoder(in);
+    std::vector<int> row(width);
+    int rows = 0;
+    while (decoder.readRow(row.data())) {
+      ++rows;
+    }
+    rowsCutFail &= rows < height;
+  }
+  CHECK(rowsCutFail);
+
+  // A bad header
+  std::vector<uint8_t> bad = data;
+  bad[0] = 'X';
+  CHECK(!Cave::decodeCave(bad.data(), bad.size(), decoded));
+  CHECK(!Cave::decodeCaveRegion(bad.data(), bad.size(), 0, 0, 1, 1, decoded));
+  bad = data;
+  bad[4] = 99;  // Version
+  CHECK(!Cave::decodeCave(bad.data(), bad.size(), decoded));
+  std::istringstream in(std::string(bad.begin(), bad.end()),
+                        std::ios::binary);
+  CHECK(!Cave::CaveStreamDecoder(in).isValid());
+
+  // A chunk index pointing past the end
+  bad = data;
+  bad[bad.size() - 1] = 0x7f;
+  CHECK(!Cave::decodeCaveRegion(bad.data(), bad.size(), 0, height - 1, 1, 1,
+                                decoded));
+
+  // Random damage to the rows and index mustn't crash, and a map that does
+  // decode is the right size. (Past the header, which is checked above, so
+  // a damaged width can't ask for a huge map.)
+  std::uniform_int_distribution<size_t> anyByte(16, data.size() - 1);
+  bool sized = true;
+  for (int i = 0; i < 2000; ++i) {
+    bad = data;
+    for (int flips = 1 + i % 4; flips > 0; --flips) {
+      bad[anyByte(rng)] ^= (uint8_t)(1 + rng() % 255);
+    }
+    if (Cave::decodeCave(bad.data(), bad.size(), decoded)) {
+      sized &= (int)decoded.size() == height &&
+               (int)decoded[0].size() == width;
+    }
+    if (Cave::decodeCaveRegion(bad.data(), bad.size(), 1, height / 3, 5, 9,
+                               decoded)) {
+      sized &= decoded.size() == 9 && decoded[0].size() == 5;
+    }
+  }
+  CHECK(sized);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(1234);
+  const Cave::TileMap maps[] = {
+      generate(61, 45, false, 3),
+      generate(61, 45, true, 3),
+      generate(130, 70, true, 11),
+      randomMap(77, 53, rng),
+      randomMap(1, 1, rng),
+  };
+  for (const auto& tileMap : maps) {
+    for (int chunkRows : {1, 7, 16, 64, 1000}) {
+      testRoundTrip(tileMap, chunkRows, rng);
+    }
+  }
+  testCorrupt(maps[1], rng);
+  testCorrupt(maps[3], rng);
+  return Check::result("cave_codec_test");
+}
@@ -0,0 +1,177 @@
+//
+// cave_connectivity_test: CaveConnectivity kept up to date through random
+// digs and fills (addFloor, addWall and update) against build() on the map
+// as it is each time.
+//
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveConnectivity.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+//
+// The same cells are floor and the regions split them the same way (the
+// IDs can differ), with the same sizes
+//
+bool samePartition(const Cave::CaveConnectivity& kept,
+                   const Cave::CaveConnectivity& built) {
+  if (kept.numRegions() != built.numRegions() ||
+      kept.getWidth() != built.getWidth() ||
+      kept.getHeight() != built.getHeight()) {
+    return false;
+  }
+  std::map<int, int> keptToBuilt;
+  std::map<int, int> builtToKept;
+  for (int cy = 0; cy < built.getHeight(); ++cy) {
+    for (int cx = 0; cx < built.getWidth(); ++cx) {
+      const int a = kept.getRegion(cx, cy);
+      const int b = built.getRegion(cx, cy);
+      if ((a < 0) != (b < 0)) {
+        return false;
+      }
+      if (a < 0) {
+        continue;
+      }
+      if (keptToBuilt.emplace(a, b).first->second != b ||
+          builtToKept.emplace(b, a).first->second != a) {
+        return false;
+      }
+    }
+  }
+  for (const auto& ids : keptToBuilt) {
+    if (kept.getRegionSize(ids.first) != built.getRegionSize(ids.second)) {
+      return false;
+    }
+  }
+  return (int)keptToBuilt.size() == built.numRegions();
+}
+
+// The different regions next to a cell
+int regionsAround(const Cave::CaveConnectivity& connectivity, int cx,
+                  int cy) {
+  std::vector<int> regions;
+  for (Cave::Vector2i next :
+       {Cave::Vector2i{cx + 1, cy}, Cave::Vector2i{cx - 1, cy},
+        Cave::Vector2i{cx, cy + 1}, Cave::Vector2i{cx, cy - 1}}) {
+    const int region = connectivity.getRegion(next.x, next.y);
+    if (region >= 0 &&
+        std::find(regions.begin(), regions.end(), region) == regions.end()) {
+      regions.push_back(region);
+    }
+  }
+  return (int)regions.size();
+}
+
+// A cell at a time, checking what addFloor / addWall return as well
+void testSingleCells(Cave::TileMap tileMap, std::mt19937& rng) {
+  Cave::CaveConnectivity kept(tileMap);
+  const int width = kept.getWidth();
+  const int height = kept.getHeight();
+  std::uniform_int_distribution<int> anyX(0, width - 1);
+  std::uniform_int_distribution<int> anyY(0, height - 1);
+  bool partitions = true;
+  bool joins = true;
+  bool cuts = true;
+  for (int i = 0; i < 300; ++i) {
+    // Mostly next to floor, where it makes a difference
+    int cx = anyX(rng);
+    int cy = anyY(rng);
+    for (int tries = 0; tries < 20 && regionsAround(kept, cx, cy) == 0;
+         ++tries) {
+      cx = anyX(rng);
+      cy = anyY(rng);
+    }
+    const int before = kept.numRegions();
+    if (kept.isFloor(cx, cy)) {
+      Cave::Cave::setCell(tileMap, cx, cy, Cave::WALL);
+      const bool cut = kept.addWall(cx, cy);
+      const Cave::CaveConnectivity built(tileMap);
+      cuts &= cut == (built.numRegions() > before);
+      partitions &= samePartition(kept, built);
+    } else {
+      const bool joined = regionsAround(kept, cx, cy) > 1;
+      Cave::Cave::setCell(tileMap, cx, cy, Cave::FLOOR);
+      joins &= kept.addFloor(cx, cy) == joined;
+      partitions &= samePartition(kept, Cave::CaveConnectivity(tileMap));
+    }
+  }
+  CHECK(partitions);
+  CHECK(joins);
+  CHECK(cuts);
+
+  // Off the map changes nothing
+  const Cave::CaveConnectivity built(tileMap);
+  CHECK(!kept.addFloor(-1, 0) && !kept.addFloor(width, height - 1));
+  CHECK(!kept.addWall(0, -1) && !kept.addWall(width, 0));
+  CHECK(samePartition(kept, built));
+}
+
+// Rectangles dug and filled together, as update() gets them from editCells
+void testUpdate(Cave::TileMap tileMap, std::mt19937& rng) {
+  Cave::CaveConnectivity kept(tileMap);
+  const int width = kept.getWidth();
+  const int height = kept.getHeight();
+  std::uniform_int_distribution<int> anyX(0, width - 1);
+  std::uniform_int_distribution<int> anyY(0, height - 1);
+  std::uniform_int_distribution<int> anySize(1, 6);
+  bool partitions = true;
+  bool cuts = true;
+  for (int i = 0; i < 200; ++i) {
+    const int x0 = anyX(rng);
+    const int y0 = anyY(rng);
+    const int x1 = std::min(width, x0 + anySize(rng));
+    const int y1 = std::min(height, y0 + anySize(rng));
+    std::vector<Cave::Vector2i> cells;
+    for (int cy = y0; cy < y1; ++cy) {
+      for (int cx = x0; cx < x1; ++cx) {
+        // Some of each, so one update both digs and fills
+        const int tile = (rng() % 3 == 0) ? Cave::FLOOR : Cave::WALL;
+        const int old = Cave::Cave::getTile(tileMap, cx, cy);
+        if (Cave::Cave::isEmpty(old) != Cave::Cave::isEmpty(tile)) {
+          Cave::Cave::setCell(tileMap, cx, cy, tile);
+          cells.push_back({cx, cy});
+        }
+      }
+    }
+    const bool cut = kept.update(tileMap, cells);
+    const Cave::CaveConnectivity built(tileMap);
+    partitions &= samePartition(kept, built);
+    // Nothing filled, nothing cut
+    bool filled = false;
+    for (Cave::Vector2i cell : cells) {
+      filled |= !Cave::Cave::isEmpty(tileMap, cell.x, cell.y);
+    }
+    cuts &= filled || !cut;
+  }
+  CHECK(partitions);
+  CHECK(cuts);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(41);
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    for (bool smoothing : {false, true}) {
+      Cave::CaveInfo info = Presets::makeInfo(60, 45, smoothing);
+      Cave::Cave cave(info, Presets::makeParams(presets[p], 3 + (int)p));
+      const Cave::TileMap tileMap = cave.generate();
+      testSingleCells(tileMap, rng);
+      testUpdate(tileMap, rng);
+    }
+  }
+  // All wall, then dug out from nothing
+  Cave::TileMap solid(12, std::vector<int>(14, Cave::WALL));
+  testSingleCells(solid, rng);
+  testUpdate(solid, rng);
+  return Check::result("cave_connectivity_test");
+}
@@ -0,0 +1,271 @@
+//
+// cave_delta_test: CaveDelta recording, applying, merging, and encoding
+// round trips, plus decode turning away malformed varints and runs.
+//
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveDelta.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+const uint64_t BASE_HASH = 0x0123456789abcdefull;
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+// version, base hash, generation and number of runs, as encode() writes
+std::vector<uint8_t> header(uint64_t generation, uint64_t numRuns) {
+  std::vector<uint8_t> out(1, 1);
+  for (int i = 0; i < 8; ++i) {
+    out.push_back((uint8_t)(BASE_HASH >> (8 * i)));
+  }
+  putVarint(out, generation);
+  putVarint(out, numRuns);
+  return out;
+}
+
+void putRun(std::vector<uint8_t>& out, uint64_t dy, uint64_t dx,
+            const std::vector<uint64_t>& tiles) {
+  putVarint(out, dy);
+  putVarint(out, dx);
+  putVarint(out, tiles.size() - 1);
+  for (uint64_t tile : tiles) {
+    putVarint(out, tile);
+  }
+}
+
+bool decodes(const std::vector<uint8_t>& data) {
+  Cave::CaveDelta delta;
+  const bool ok = delta.decode(data.data(), data.size());
+  CHECK(ok || delta.empty());
+  return ok;
+}
+
+// Random changes, in runs and alone, to a copy of the map
+Cave::TileMap edit(const Cave::TileMap& tileMap, std::mt19937& rng) {
+  Cave::TileMap edited = tileMap;
+  const int width = (int)tileMap[0].size() - 2;
+  const int height = (int)tileMap.size() - 2;
+  std::uniform_int_distribution<int> anyX(0, width - 1);
+  std::uniform_int_distribution<int> anyY(0, height - 1);
+  std::uniform_int_distribution<int> anyTile(0, Cave::IGNORE);
+  for (int i = 0; i < 40; ++i) {
+    const int x = anyX(rng);
+    const int y = anyY(rng);
+    const int length = (i % 3 == 0) ? 1 + (int)(rng() % 12) : 1;
+    for (int cx = x; cx < std::min(width, x + length); ++cx) {
+      edited[y + 1][cx + 1] = anyTile(rng);
+    }
+  }
+  return edited;
+}
+
+void testRecordAndApply(const Cave::TileMap& tileMap, std::mt19937& rng) {
+  const Cave::TileMap edited = edit(tileMap, rng);
+  Cave::CaveDelta delta(BASE_HASH, 3);
+  delta.diff(tileMap, edited);
+  CHECK(!delta.empty());
+
+  // Sorted by row then column, one per cell
+  bool sorted = true;
+  const auto& changes = delta.getChanges();
+  for (size_t i = 1; i < changes.size(); ++i) {
+    sorted &= changes[i - 1].y < changes[i].y ||
+              (changes[i - 1].y == changes[i].y &&
+               changes[i - 1].x < changes[i].x);
+  }
+  CHECK(sorted);
+
+  Cave::TileMap applied = tileMap;
+  CHECK(delta.apply(applied));
+  CHECK(applied == edited);
+
+  // record() takes the same tiles from the cells given
+  std::vector<Cave::Vector2i> cells;
+  for (const auto& change : changes) {
+    cells.push_back({change.x, change.y});
+  }
+  Cave::CaveDelta recorded(BASE_HASH, 3);
+  recorded.record(edited, cells);
+  CHECK(recorded.encode() == delta.encode());
+
+  // Through the encoding and back
+  const std::vector<uint8_t> data = delta.encode();
+  Cave::CaveDelta decoded;
+  CHECK(decoded.decode(data.data(), data.size()));
+  CHECK(decoded.getBaseHash() == BASE_HASH);
+  CHECK(decoded.getGeneration() == 3);
+  CHECK(decoded.size() == delta.size());
+  applied = tileMap;
+  CHECK(decoded.apply(applied));
+  CHECK(applied == edited);
+  // A few bytes a run, nowhere near the size of the map
+  CHECK(data.size() < delta.size() * 4 + 64);
+}
+
+void testMerge(const Cave::TileMap& tileMap, std::mt19937& rng) {
+  const Cave::TileMap first = edit(tileMap, rng);
+  const Cave::TileMap second = edit(first, rng);
+  Cave::CaveDelta a(BASE_HASH, 4);
+  a.diff(tileMap, first);
+  Cave::CaveDelta b(BASE_HASH, 9);
+  b.diff(first, second);
+
+  // Applying the merge is applying one then the other
+  Cave::CaveDelta merged = a;
+  CHECK(merged.merge(b));
+  CHECK(merged.getGeneration() == 9);
+  Cave::TileMap applied = tileMap;
+  CHECK(merged.apply(applied));
+  CHECK(applied == second);
+
+  // Merging an older delta keeps the newer generation
+  Cave::CaveDelta older = b;
+  CHECK(older.merge(a));
+  CHECK(older.getGeneration() == 9);
+
+  // Later changes to the same cell win
+  Cave::CaveDelta x(BASE_HASH, 1), y(BASE_HASH, 2);
+  x.set(5, 5, Cave::WALL);
+  x.set(6, 5, Cave::WALL);
+  y.set(5, 5, Cave::FLOOR);
+  CHECK(x.merge(y));
+  CHECK(x.size() == 2 && x.getChanges()[0].tile == Cave::FLOOR);
+
+  // Different bases don't merge and leave it alone
+  Cave::CaveDelta other(BASE_HASH + 1, 20);
+  other.set(1, 1, Cave::WALL);
+  const std::vector<uint8_t> before = a.encode();
+  CHECK(!a.merge(other));
+  CHECK(a.encode() == before);
+}
+
+void testApplyOutside(const Cave::TileMap& tileMap) {
+  const int width = (int)tileMap[0].size() - 2;
+  const int height = (int)tileMap.size() - 2;
+  Cave::CaveDelta delta(BASE_HASH, 1);
+  delta.set(-1, 0, Cave::FLOOR);
+  delta.set(0, 0, Cave::WALL);
+  delta.set(width, 0, Cave::FLOOR);
+  delta.set(0, height, Cave::FLOOR);
+  Cave::TileMap applied = tileMap;
+  CHECK(!delta.apply(applied));
+  // The cell inside is still set, the border isn't touched
+  CHECK(applied[1][1] == Cave::WALL);
+  applied[1][1] = tileMap[1][1];
+  CHECK(applied == tileMap);
+}
+
+void testDecodeRejects() {
+  // Well formed: two runs on one row, one on a later row
+  std::vector<uint8_t> good = header(7, 3);
+  putRun(good, 2, 3, {Cave::WALL, Cave::FLOOR});
+  putRun(good, 0, 1, {Cave::WALL});
+  putRun(good, 4, 0, {Cave::FLOOR});
+  Cave::CaveDelta delta;
+  CHECK(delta.decode(good.data(), good.size()));
+  CHECK(delta.size() == 4 && delta.getGeneration() == 7);
+  CHECK(delta.getChanges()[2].x == 6 && delta.getChanges()[2].y == 2);
+  CHECK(delta.getChanges()[3].x == 0 && delta.getChanges()[3].y == 6);
+
+  // Every shorter prefix, and anything after the end
+  bool prefixesFail = true;
+  for (size_t size = 0; size < good.size(); ++size) {
+    prefixesFail &= !decodes(std::vector<uint8_t>(good.begin(),
+                                                  good.begin() + size));
+  }
+  CHECK(prefixesFail);
+  std::vector<uint8_t> bad = good;
+  bad.push_back(0);
+  CHECK(!decodes(bad));
+
+  // Wrong version
+  bad = good;
+  bad[0] = 2;
+  CHECK(!decodes(bad));
+
+  // Generation too big for 32 bits
+  bad = header(1ull << 32, 0);
+  CHECK(!decodes(bad));
+
+  // A varint that never ends, and one past 64 bits
+  bad = header(1, 1);
+  bad.insert(bad.end(), 9, 0x80);
+  CHECK(!decodes(bad));
+  bad = header(1, 1);
+  bad.insert(bad.end(), 12, 0xFF);
+  bad.push_back(0x01);
+  CHECK(!decodes(bad));
+
+  // More runs than there could be bytes for
+  bad = header(1, 1000);
+  putRun(bad, 0, 0, {Cave::WALL});
+  CHECK(!decodes(bad));
+
+  // A tile that isn't one
+  bad = header(1, 1);
+  putRun(bad, 0, 0, {(uint64_t)Cave::IGNORE + 1});
+  CHECK(!decodes(bad));
+
+  // A run touching the one before on the same row
+  bad = header(1, 2);
+  putRun(bad, 0, 0, {Cave::WALL});
+  putRun(bad, 0, 0, {Cave::WALL});
+  CHECK(!decodes(bad));
+
+  // Steps that would wrap round to earlier cells
+  bad = header(1, 2);
+  putRun(bad, 5, 0, {Cave::WALL});
+  putRun(bad, UINT64_MAX - 2, 0, {Cave::WALL});
+  CHECK(!decodes(bad));
+  bad = header(1, 2);
+  putRun(bad, 0, 9, {Cave::WALL});
+  putRun(bad, 0, UINT64_MAX - 4, {Cave::WALL});
+  CHECK(!decodes(bad));
+
+  // A length that would wrap round to 0
+  bad = header(1, 1);
+  putVarint(bad, 0);
+  putVarint(bad, 0);
+  putVarint(bad, UINT64_MAX);
+  CHECK(!decodes(bad));
+
+  // Coordinates past the limit
+  bad = header(1, 1);
+  putRun(bad, 1 << 24, 0, {Cave::WALL});
+  CHECK(!decodes(bad));
+
+  // An empty delta is fine
+  CHECK(decodes(header(0, 0)));
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(99);
+  for (bool smoothing : {false, true}) {
+    Cave::CaveInfo info = Presets::makeInfo(70, 50, smoothing);
+    Cave::Cave cave(info, Presets::makeParams(Presets::all()[2], 17));
+    const Cave::TileMap tileMap = cave.generate();
+    for (int i = 0; i < 10; ++i) {
+      testRecordAndApply(tileMap, rng);
+      testMerge(tileMap, rng);
+    }
+    testApplyOutside(tileMap);
+  }
+  testDecodeRejects();
+  return Check::result("cave_delta_test");
+}
@@ -0,0 +1,163 @@
+//
+// cave_distancemap_test: DistanceMap against a breadth first search from
+// its start: the same distances, each flow step going one closer, the
+// exit at the greatest distance, and the start moved onto the nearest
+// floor. Also Cave::setDistanceMap measuring from CaveInfo's start cell.
+//
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "DistanceMap.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+// Steps from start to every cell, -1 for walls and cells out of reach
+std::vector<int> breadthFirst(const Cave::TileMap& tileMap, int width,
+                              int height, Cave::Vector2i start) {
+  std::vector<int> dist((size_t)width * height, -1);
+  if (!Cave::Cave::isEmpty(tileMap, start.x, start.y)) {
+    return dist;
+  }
+  std::vector<Cave::Vector2i> queue = {start};
+  dist[(size_t)start.y * width + start.x] = 0;
+  const Cave::Vector2i dirs[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+  for (size_t next = 0; next < queue.size(); ++next) {
+    const Cave::Vector2i cell = queue[next];
+    const int d = dist[(size_t)cell.y * width + cell.x];
+    for (const Cave::Vector2i& dir : dirs) {
+      const int nx = cell.x + dir.x;
+      const int ny = cell.y + dir.y;
+      if (nx >= 0 && ny >= 0 && nx < width && ny < height &&
+          dist[(size_t)ny * width + nx] < 0 &&
+          Cave::Cave::isEmpty(tileMap, nx, ny)) {
+        dist[(size_t)ny * width + nx] = d + 1;
+        queue.push_back({nx, ny});
+      }
+    }
+  }
+  return dist;
+}
+
+// Steps (ignoring walls) from cell, kept on the map, to the nearest floor
+int stepsToFloor(const Cave::TileMap& tileMap, int width, int height,
+                 Cave::Vector2i cell) {
+  cell.x = std::min(std::max(cell.x, 0), width - 1);
+  cell.y = std::min(std::max(cell.y, 0), height - 1);
+  int steps = -1;
+  for (int cy = 0; cy < height; ++cy) {
+    for (int cx = 0; cx < width; ++cx) {
+      const int d = std::abs(cx - cell.x) + std::abs(cy - cell.y);
+      if (Cave::Cave::isEmpty(tileMap, cx, cy) && (steps < 0 || d < steps)) {
+        steps = d;
+      }
+    }
+  }
+  return steps;
+}
+
+void testFrom(const Cave::TileMap& tileMap, Cave::Vector2i start) {
+  const Cave::DistanceMap distances(tileMap, start);
+  const int width = distances.getWidth();
+  const int height = distances.getHeight();
+  CHECK(width == (int)tileMap[0].size() - 2 &&
+        height == (int)tileMap.size() - 2);
+
+  // Moved onto the nearest floor
+  const Cave::Vector2i from = distances.getStart();
+  const int steps = stepsToFloor(tileMap, width, height, start);
+  if (steps < 0) {
+    CHECK(distances.numReachable() == 0 && distances.getMaxDistance() == 0);
+    CHECK(distances.getExit() == from);
+    return;
+  }
+  CHECK(Cave::Cave::isEmpty(tileMap, from.x, from.y));
+  const Cave::Vector2i clamped = {
+      std::min(std::max(start.x, 0), width - 1),
+      std::min(std::max(start.y, 0), height - 1)};
+  CHECK(std::abs(from.x - clamped.x) + std::abs(from.y - clamped.y) == steps);
+
+  const std::vector<int> expected = breadthFirst(tileMap, width, height, from);
+  bool sameDistances = true;
+  bool flowsBack = true;
+  int reachable = 0;
+  int farthest = 0;
+  for (int cy = 0; cy < height; ++cy) {
+    for (int cx = 0; cx < width; ++cx) {
+      const int d = expected[(size_t)cy * width + cx];
+      sameDistances &= distances.getDistance(cx, cy) == d;
+      reachable += d >= 0;
+      farthest = std::max(farthest, d);
+      const Cave::Vector2i flow = distances.getFlow(cx, cy);
+      if (d <= 0) {
+        flowsBack &= flow.x == 0 && flow.y == 0;
+        continue;
+      }
+      // One step, to a cell one closer
+      flowsBack &= std::abs(flow.x) + std::abs(flow.y) == 1 &&
+                   distances.getDistance(cx + flow.x, cy + flow.y) == d - 1;
+    }
+  }
+  CHECK(sameDistances);
+  CHECK(flowsBack);
+  CHECK(distances.numReachable() == reachable);
+  CHECK(distances.getMaxDistance() == farthest);
+  const Cave::Vector2i exit = distances.getExit();
+  CHECK(distances.getDistance(exit.x, exit.y) == farthest);
+
+  // Off the map
+  CHECK(distances.getDistance(-1, 0) == -1 &&
+        distances.getDistance(width, height - 1) == -1);
+  CHECK(distances.getFlow(0, height) == (Cave::Vector2i{0, 0}));
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(50);
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 50 + (int)p);
+    for (bool smoothing : {false, true}) {
+      Cave::CaveInfo info = Presets::makeInfo(71, 53, smoothing);
+      info.mStartCellX = 70;
+      info.mStartCellY = 0;
+      Cave::Cave cave(info, params);
+      Cave::DistanceMap measured;
+      cave.setDistanceMap(&measured);
+      const Cave::TileMap tileMap = cave.generate();
+
+      // The same as measuring from the start cell afterwards
+      const Cave::DistanceMap expected(tileMap, {70, 0});
+      bool same = measured.getStart() == expected.getStart() &&
+                  measured.getExit() == expected.getExit();
+      for (int cy = 0; cy < 53; ++cy) {
+        for (int cx = 0; cx < 71; ++cx) {
+          same &= measured.getDistance(cx, cy) == expected.getDistance(cx, cy);
+        }
+      }
+      CHECK(same);
+
+      // From anywhere, on the map or off it
+      std::uniform_int_distribution<int> anyX(-5, 75);
+      std::uniform_int_distribution<int> anyY(-5, 57);
+      for (int i = 0; i < 6; ++i) {
+        testFrom(tileMap, {anyX(rng), anyY(rng)});
+      }
+    }
+  }
+  // All wall, and a single cell of floor
+  Cave::TileMap solid(12, std::vector<int>(9, Cave::WALL));
+  testFrom(solid, {3, 3});
+  Cave::Cave::setCell(solid, 6, 9, Cave::FLOOR);
+  testFrom(solid, {0, 0});
+  return Check::result("cave_distancemap_test");
+}
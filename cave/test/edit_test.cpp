@@ -0,0 +1,130 @@
+//
+// cave_edit_test: Cave::editCells against resmooth of the whole map, on
+// maps that resmooth leaves as they are, and the cells it says changed.
+//
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "CaveSmoother.h"
+#include "Check.h"
+#include "Presets.h"
+#include "TileTypes.h"
+#include "TiledMap.h"
+
+namespace {
+
+Cave::TileMap unsmoothed(const Cave::TileMap& tileMap) {
+  Cave::TileMap raw = tileMap;
+  for (auto& row : raw) {
+    for (int& tile : row) {
+      tile = Cave::CaveSmoother::getUnsmoothedTile(tile);
+    }
+  }
+  return raw;
+}
+
+// Every cell (cave coords) where the maps differ, row by row
+std::vector<Cave::Vector2i> differences(const Cave::TileMap& a,
+                                        const Cave::TileMap& b) {
+  std::vector<Cave::Vector2i> cells;
+  for (int cy = 0; cy + 2 < (int)a.size(); ++cy) {
+    for (int cx = 0; cx + 2 < (int)a[0].size(); ++cx) {
+      if (Cave::Cave::getTile(a, cx, cy) != Cave::Cave::getTile(b, cx, cy)) {
+        cells.push_back({cx, cy});
+      }
+    }
+  }
+  return cells;
+}
+
+bool sameCells(const std::vector<Cave::Vector2i>& a,
+               const std::vector<Cave::Vector2i>& b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const Cave::Vector2i& p, const Cave::Vector2i& q) {
+                      return p.x == q.x && p.y == q.y;
+                    });
+}
+
+struct Counts {
+  int plain = 0;
+  int fixedUp = 0;
+};
+
+void testEdits(const Cave::CaveInfo& info,
+               const Cave::GenerationParams& params, std::mt19937& rng,
+               Counts& counts) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  Cave::TileMap base = cave.generate();
+  // A map resmooth leaves alone, so anything resmooth changes after an
+  // edit is down to the edit
+  Cave::resmooth(base, info);
+  Cave::TileMap again = base;
+  Cave::resmooth(again, info);
+  CHECK(again == base);
+  if (again != base) {
+    return;
+  }
+
+  const int width = info.mCaveWidth;
+  const int height = info.mCaveHeight;
+  std::uniform_int_distribution<int> anyX(-2, width - 1);
+  std::uniform_int_distribution<int> anyY(-2, height - 1);
+  std::uniform_int_distribution<int> anySize(1, 5);
+  bool matches = true;
+  bool changedRight = true;
+  for (int i = 0; i < 60; ++i) {
+    const Cave::Rect2i region = {anyX(rng), anyY(rng), anySize(rng),
+                                 anySize(rng)};
+    const int tile = (i % 2) ? Cave::WALL : Cave::FLOOR;
+    Cave::TileMap edited = base;
+    const std::vector<Cave::Vector2i> changed =
+        cave.editCells(edited, region, tile);
+    changedRight &= sameCells(changed, differences(base, edited));
+
+    // The edited cells set, and resmooth from there
+    Cave::TileMap expected = unsmoothed(base);
+    for (int cy = std::max(region.y, 0);
+         cy < std::min(region.y + region.h, height); ++cy) {
+      for (int cx = std::max(region.x, 0);
+           cx < std::min(region.x + region.w, width); ++cx) {
+        Cave::Cave::setCell(expected, cx, cy, tile);
+      }
+    }
+    if (unsmoothed(edited) == expected) {
+      Cave::resmooth(expected, info);
+      matches &= edited == expected;
+      ++counts.plain;
+    } else {
+      // fixUp (or the smoothing) moved cells next to the edit too, which
+      // resmooth alone wouldn't
+      ++counts.fixedUp;
+    }
+  }
+  CHECK(matches);
+  CHECK(changedRight);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(40);
+  Counts counts;
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    for (int mode = 0; mode < 3; ++mode) {
+      Cave::CaveInfo info = Presets::makeInfo(90, 70, true);
+      info.mSmoothing = mode != 2;
+      info.mSmoothCorners = info.mSmoothPoints = mode == 0;
+      info.mRemoveDiagonals = mode == 2;
+      testEdits(info, Presets::makeParams(presets[p], 11 + (int)p), rng,
+                counts);
+    }
+  }
+  // Most edits need no fixUp, so the comparison above does check something
+  CHECK(counts.plain > counts.fixedUp);
+  return Check::result("cave_edit_test");
+}
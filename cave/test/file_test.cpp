@@ -0,0 +1,212 @@
+//
+// cave_file_test: saveCaveFile / CaveFileWriter round trips through
+// CaveFile, and CaveFile turning away truncated and corrupt files.
+//
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveConnectivity.h"
+#include "CaveFile.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "Fingerprint.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+const char* PATH = "cave_file_test.cave";
+const char* DAMAGED_PATH = "cave_file_test_damaged.cave";
+
+std::vector<char> readFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::vector<char>& bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), bytes.size());
+}
+
+bool sameTiles(const Cave::CaveFile& file, const Cave::TileMap& tileMap) {
+  if (file.getHeight() != (int)tileMap.size()) {
+    return false;
+  }
+  for (int y = 0; y < file.getHeight(); ++y) {
+    for (int x = 0; x < file.getWidth(); ++x) {
+      if (file.getTile(x, y) != tileMap[y][x]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void testRoundTrip(const Cave::CaveInfo& info,
+                   const Cave::GenerationParams& params,
+                   const Cave::TileMap& tileMap) {
+  const Cave::CaveConnectivity connectivity(tileMap);
+  CHECK(Cave::saveCaveFile(PATH, tileMap, info, params,
+                           &connectivity.getLabels()));
+
+  Cave::CaveFile file;
+  CHECK(file.open(PATH));
+  if (!file.isOpen()) {
+    return;
+  }
+  CHECK(file.verify());
+  CHECK(file.getInputHash() == Cave::hashInputs(info, params));
+  const Cave::CaveInfo loaded = file.getInfo();
+  CHECK(loaded.mCaveWidth == info.mCaveWidth);
+  CHECK(loaded.mCaveHeight == info.mCaveHeight);
+  CHECK(loaded.mSmoothing == info.mSmoothing);
+  CHECK(loaded.mSmoothCorners == info.mSmoothCorners);
+  CHECK(loaded.mSmoothPoints == info.mSmoothPoints);
+  CHECK(loaded.mRemoveDiagonals == info.mRemoveDiagonals);
+  CHECK(Cave::hashInputs(loaded, params) == file.getInputHash());
+  CHECK(sameTiles(file, tileMap));
+
+  Cave::TileMap copy;
+  file.copyTo(copy);
+  CHECK(copy == tileMap);
+
+  CHECK(file.hasRoomLabels());
+  bool labelsMatch = true;
+  for (int cy = 0; cy < info.mCaveHeight; ++cy) {
+    for (int cx = 0; cx < info.mCaveWidth; ++cx) {
+      labelsMatch &=
+          file.getRoomLabel(cx, cy) == connectivity.getRegion(cx, cy);
+    }
+  }
+  CHECK(labelsMatch);
+
+  // Moving hands over the mapping
+  Cave::CaveFile moved(std::move(file));
+  CHECK(!file.isOpen());
+  CHECK(moved.isOpen() && moved.verify());
+
+  // Without labels
+  CHECK(Cave::saveCaveFile(PATH, tileMap, info, params));
+  CHECK(moved.open(PATH) && !moved.hasRoomLabels() && moved.verify());
+  CHECK(sameTiles(moved, tileMap));
+}
+
+void testWriter(const Cave::CaveInfo& info,
+                const Cave::GenerationParams& params,
+                const Cave::TileMap& tileMap) {
+  {
+    Cave::CaveFileWriter writer;
+    CHECK(writer.open(PATH, info, params));
+    for (const auto& row : tileMap) {
+      writer.addRow(row);
+    }
+    CHECK(writer.finish());
+  }
+  Cave::CaveFile file;
+  CHECK(file.open(PATH) && file.verify());
+  CHECK(file.isOpen() && sameTiles(file, tileMap));
+  CHECK(file.isOpen() &&
+        file.getInputHash() == Cave::hashInputs(info, params));
+  file.close();
+
+  // A row short leaves the old file alone
+  const std::vector<char> before = readFile(PATH);
+  {
+    Cave::CaveFileWriter writer;
+    CHECK(writer.open(PATH, info, params));
+    for (size_t y = 0; y + 1 < tileMap.size(); ++y) {
+      writer.addRow(tileMap[y]);
+    }
+    CHECK(!writer.finish());
+  }
+  CHECK(readFile(PATH) == before);
+}
+
+void testBadInput(const Cave::CaveInfo& info,
+                  const Cave::GenerationParams& params,
+                  const Cave::TileMap& tileMap) {
+  CHECK(!Cave::saveCaveFile(DAMAGED_PATH, Cave::TileMap(), info, params));
+  Cave::TileMap narrow = tileMap;
+  narrow[0].pop_back();
+  CHECK(!Cave::saveCaveFile(DAMAGED_PATH, narrow, info, params));
+  const std::vector<int> tooFew(10, 0);
+  CHECK(!Cave::saveCaveFile(DAMAGED_PATH, tileMap, info, params, &tooFew));
+
+  Cave::CaveFile file;
+  CHECK(!file.open("cave_file_test_missing.cave"));
+  CHECK(!file.isOpen());
+
+  const Cave::CaveConnectivity connectivity(tileMap);
+  CHECK(Cave::saveCaveFile(PATH, tileMap, info, params,
+                           &connectivity.getLabels()));
+  const std::vector<char> good = readFile(PATH);
+  CHECK(file.open(PATH));
+  const Cave::CaveFileHeader header = file.header();
+  file.close();
+
+  // Cut anywhere: empty, inside the header, the tiles or the labels
+  const size_t cuts[] = {0,
+                         sizeof(Cave::CaveFileHeader) / 2,
+                         sizeof(Cave::CaveFileHeader),
+                         (size_t)header.mTilesOffset + 1,
+                         (size_t)header.mRoomsOffset,
+                         good.size() - 1};
+  for (size_t cut : cuts) {
+    writeFile(DAMAGED_PATH,
+              std::vector<char>(good.begin(), good.begin() + cut));
+    CHECK(!file.open(DAMAGED_PATH));
+  }
+
+  // A damaged header is turned away by open
+  auto damage = [&](size_t offset) {
+    std::vector<char> bytes = good;
+    bytes[offset] ^= 0x5a;
+    writeFile(DAMAGED_PATH, bytes);
+  };
+  damage(offsetof(Cave::CaveFileHeader, mMagic));
+  CHECK(!file.open(DAMAGED_PATH));
+  damage(offsetof(Cave::CaveFileHeader, mVersion));
+  CHECK(!file.open(DAMAGED_PATH));
+  damage(offsetof(Cave::CaveFileHeader, mByteOrder));
+  CHECK(!file.open(DAMAGED_PATH));
+  damage(offsetof(Cave::CaveFileHeader, mCaveWidth));
+  CHECK(!file.open(DAMAGED_PATH));
+  damage(offsetof(Cave::CaveFileHeader, mRoomsOffset));
+  CHECK(!file.open(DAMAGED_PATH));
+
+  // A damaged body only shows up in verify
+  damage(header.mTilesOffset + header.mTilesBytes / 2);
+  CHECK(file.open(DAMAGED_PATH) && !file.verify());
+  damage(header.mRoomsOffset + 4);
+  CHECK(file.open(DAMAGED_PATH) && !file.verify());
+  file.close();
+
+  std::remove(DAMAGED_PATH);
+}
+
+}  // namespace
+
+int main() {
+  const auto& presets = Presets::all();
+  for (bool smoothing : {false, true}) {
+    const Cave::CaveInfo info = Presets::makeInfo(61, 37, smoothing);
+    const Cave::GenerationParams params = Presets::makeParams(presets[1], 7);
+    Cave::CaveInfo generateInfo = info;
+    Cave::Cave cave(generateInfo, params);
+    const Cave::TileMap tileMap = cave.generate();
+
+    testRoundTrip(info, params, tileMap);
+    testWriter(info, params, tileMap);
+    testBadInput(info, params, tileMap);
+  }
+  std::remove(PATH);
+  return Check::result("cave_file_test");
+}
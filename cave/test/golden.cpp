@@ -0,0 +1,207 @@
+//
+// cave_golden: determinism regression check.
+//
+//   cave_golden <fingerprints.txt> [--record]
+//
+// Generates a corpus of (CaveInfo, GenerationParams, seed) cases covering
+// every README preset and smoothing option and checks that
+// - running the parallel stages on a thread pool gives the same map, at
+//   every stage, as running them inline
+// - the fingerprint after every stage matches the one recorded in the file
+//
+// A case with no recorded fingerprint fails too, so a corpus that has grown
+// (or a file that's gone missing) can't pass by checking nothing.
+//
+// --record rewrites the file from the current build. Only do that from a
+// build whose output is known to be right; the point of the file is that
+// optimisations must not change it.
+//
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Executor.h"
+#include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+struct Mode {
+  const char* name;
+  bool smoothing;
+  bool smoothCorners;
+  bool smoothPoints;
+  bool removeDiagonals;
+  bool perlin;
+};
+
+const Mode MODES[] = {
+    {"raw", false, false, false, false, false},
+    {"smooth", true, true, true, false, false},
+    {"smooth_nocorners", true, false, true, false, false},
+    {"diagonals", false, false, false, true, false},
+    {"perlin", true, true, true, false, true},
+};
+
+struct Size {
+  int width;
+  int height;
+};
+
+const Size SIZES[] = {{48, 48}, {96, 40}};
+const int SEEDS[] = {1, 424242};
+
+struct Case {
+  std::string key;
+  Cave::CaveInfo info;
+  Cave::GenerationParams params;
+};
+
+std::vector<Case> makeCorpus() {
+  std::vector<Case> corpus;
+  for (const auto& preset : Presets::all()) {
+    for (const auto& size : SIZES) {
+      for (int seed : SEEDS) {
+        for (const auto& mode : MODES) {
+          Case c;
+          std::ostringstream key;
+          key << preset.name << " " << size.width << " " << size.height << " "
+              << seed << " " << mode.name;
+          c.key = key.str();
+          c.info = Presets::makeInfo(size.width, size.height, mode.smoothing);
+          c.info.mSmoothCorners = mode.smoothCorners;
+          c.info.mSmoothPoints = mode.smoothPoints;
+          c.info.mRemoveDiagonals = mode.removeDiagonals;
+          c.params = Presets::makeParams(preset, seed);
+          c.params.mPerlin = mode.perlin;
+          corpus.push_back(c);
+        }
+      }
+    }
+  }
+  return corpus;
+}
+
+std::vector<Cave::GenerationStats::StageFingerprint> run(const Case& c,
+                                                         Cave::Executor& ex) {
+  Cave::CaveInfo info = c.info;
+  Cave::Cave cave(info, c.params);
+  cave.setExecutor(&ex);
+  Cave::GenerationStats stats;
+  stats.mRecordFingerprints = true;
+  cave.generate(&stats);
+  return stats.mFingerprints;
+}
+
+std::string toHex(uint64_t value) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+  return buf;
+}
+
+// "<key> <stage hex>..." per line, # for comments
+std::map<std::string, std::vector<std::string>> loadGolden(
+    const std::string& path) {
+  std::map<std::string, std::vector<std::string>> golden;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string preset, width, height, seed, mode;
+    fields >> preset >> width >> height >> seed >> mode;
+    std::string key =
+        preset + " " + width + " " + height + " " + seed + " " + mode;
+    std::string hex;
+    while (fields >> hex) {
+      golden[key].push_back(hex);
+    }
+  }
+  return golden;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <fingerprints.txt> [--record]"
+              << std::endl;
+    return 2;
+  }
+  const std::string path = argv[1];
+  const bool record = (argc > 2) && (std::string(argv[2]) == "--record");
+
+  Cave::InlineExecutor inlineExecutor;
+  Cave::WorkStealingExecutor pool(3);
+  auto golden = loadGolden(path);
+  auto corpus = makeCorpus();
+
+  int failures = 0;
+  int unrecorded = 0;
+  std::ostringstream recorded;
+  for (const auto& c : corpus) {
+    auto serial = run(c, inlineExecutor);
+    auto parallel = run(c, pool);
+
+    std::vector<std::string> hexes;
+    for (size_t s = 0; s < serial.size(); ++s) {
+      hexes.push_back(toHex(serial[s].mFingerprint));
+      if (serial[s].mFingerprint != parallel[s].mFingerprint) {
+        std::cerr << "FAIL " << c.key << ": parallel run differs after "
+                  << serial[s].mStage << std::endl;
+        ++failures;
+        break;
+      }
+    }
+
+    recorded << c.key;
+    for (const auto& hex : hexes) {
+      recorded << " " << hex;
+    }
+    recorded << "\n";
+
+    auto it = golden.find(c.key);
+    if (it == golden.end()) {
+      ++unrecorded;
+      continue;
+    }
+    for (size_t s = 0; s < hexes.size(); ++s) {
+      if (s >= it->second.size() || hexes[s] != it->second[s]) {
+        std::cerr << "FAIL " << c.key << ": changed after " << serial[s].mStage
+                  << " (got " << hexes[s] << ")" << std::endl;
+        ++failures;
+        break;
+      }
+    }
+  }
+
+  if (record) {
+    std::ofstream out(path);
+    out << "# Fingerprints after each stage: initialise runCellularAutomata\n"
+        << "# fixUp joinRooms smooth. Regenerate, from a build against the\n"
+        << "# Libs CMakeLists.txt fetches, with: cave_golden <file> --record\n"
+        << "# preset width height seed mode fingerprints...\n"
+        << recorded.str();
+    std::cerr << "Recorded " << corpus.size() << " cases to " << path
+              << std::endl;
+  }
+
+  std::cerr << corpus.size() << " cases, " << failures << " failed, "
+            << unrecorded << " with no recorded fingerprint" << std::endl;
+  if (unrecorded && !record) {
+    std::cerr << "FAIL: run with --record to add them" << std::endl;
+    return 1;
+  }
+  return failures ? 1 : 0;
+}
@@ -40,7 +40,8 @@ int main() {
 
   Cave::Cave cave(info, params);
   // Generate the cave
-  Cave::TileMap tileMap = cave.generate();
+  Cave::GenerationStats stats;
+  Cave::TileMap tileMap = cave.generate(&stats);
 
   // Print the tile map to the console
   for (int y = 0; y < tileMap.size(); ++y) {
@@ -50,5 +51,12 @@ int main() {
     std::cout << std::endl;
   }
 
+  std::cout << "Generated in " << stats.mTotal.mMillis << "ms"
+            << " rooms: " << stats.mRooms
+            << " tunnels: " << stats.mMSTEdges
+            << " fixUp passes: " << stats.mFixUpIterations
+            << " peak scratch: " << stats.mPeakScratchBytes << " bytes"
+            << std::endl;
+
   return 0;
 }
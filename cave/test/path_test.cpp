@@ -0,0 +1,199 @@
+//
+// cave_path_test: PathGraph paths between random cells against a breadth
+// first search of the map: found if and only if there is one, made of
+// floor a step at a time, and no shorter than the shortest. Also the
+// waypoints refined into the same path, and update() after edits giving
+// the same answers as building again.
+//
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "PathGraph.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+// Shortest path length by breadth first search, -1 if there's none
+int shortestPath(const Cave::TileMap& tileMap, Cave::Vector2i from,
+                 Cave::Vector2i to) {
+  const int width = (int)tileMap[0].size() - 2;
+  const int height = (int)tileMap.size() - 2;
+  auto isFloor = [&](int cx, int cy) {
+    return cx >= 0 && cy >= 0 && cx < width && cy < height &&
+           Cave::Cave::isEmpty(tileMap, cx, cy);
+  };
+  if (!isFloor(from.x, from.y) || !isFloor(to.x, to.y)) {
+    return -1;
+  }
+  std::vector<int> dist((size_t)width * height, -1);
+  std::vector<Cave::Vector2i> queue = {from};
+  dist[(size_t)from.y * width + from.x] = 0;
+  const Cave::Vector2i dirs[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+  for (size_t next = 0; next < queue.size(); ++next) {
+    const Cave::Vector2i cell = queue[next];
+    const int d = dist[(size_t)cell.y * width + cell.x];
+    if (cell == to) {
+      return d;
+    }
+    for (const Cave::Vector2i& dir : dirs) {
+      const int nx = cell.x + dir.x;
+      const int ny = cell.y + dir.y;
+      if (isFloor(nx, ny) && dist[(size_t)ny * width + nx] < 0) {
+        dist[(size_t)ny * width + nx] = d + 1;
+        queue.push_back({nx, ny});
+      }
+    }
+  }
+  return -1;
+}
+
+// A path of the given length from from to to, a step at a time on floor
+bool validPath(const Cave::TileMap& tileMap,
+               const std::vector<Cave::Vector2i>& path, Cave::Vector2i from,
+               Cave::Vector2i to, int length) {
+  if ((int)path.size() != length + 1 || !(path.front() == from) ||
+      !(path.back() == to)) {
+    return false;
+  }
+  for (size_t i = 0; i < path.size(); ++i) {
+    if (!Cave::Cave::isEmpty(tileMap, path[i].x, path[i].y)) {
+      return false;
+    }
+    if (i > 0 && std::abs(path[i].x - path[i - 1].x) +
+                         std::abs(path[i].y - path[i - 1].y) !=
+                     1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Totals {
+  long shortest = 0;
+  long found = 0;
+};
+
+// Random pairs of cells, mostly floor so most have a path
+void testPaths(Cave::PathGraph& graph, const Cave::TileMap& tileMap,
+               std::mt19937& rng, Totals& totals) {
+  const int width = graph.getWidth();
+  const int height = graph.getHeight();
+  std::uniform_int_distribution<int> anyX(0, width - 1);
+  std::uniform_int_distribution<int> anyY(0, height - 1);
+  auto anyCell = [&]() {
+    Cave::Vector2i cell = {anyX(rng), anyY(rng)};
+    for (int tries = 0;
+         tries < 10 && !Cave::Cave::isEmpty(tileMap, cell.x, cell.y);
+         ++tries) {
+      cell = {anyX(rng), anyY(rng)};
+    }
+    return cell;
+  };
+  bool reachable = true;
+  bool valid = true;
+  bool notShorter = true;
+  bool waypointsMatch = true;
+  for (int i = 0; i < 80; ++i) {
+    const Cave::Vector2i from = anyCell();
+    const Cave::Vector2i to = (i % 10 == 0) ? from : anyCell();
+    std::vector<Cave::Vector2i> path;
+    const int length = graph.findPath(from, to, &path);
+    const int shortest = shortestPath(tileMap, from, to);
+    reachable &= (length < 0) == (shortest < 0);
+    if (length < 0 || shortest < 0) {
+      continue;
+    }
+    valid &= validPath(tileMap, path, from, to, length);
+    notShorter &= length >= shortest;
+    totals.shortest += shortest;
+    totals.found += length;
+
+    // The waypoints, refined leg by leg, are the same length
+    std::vector<Cave::Vector2i> waypoints;
+    waypointsMatch &= graph.findWaypoints(from, to, waypoints) == length;
+    std::vector<Cave::Vector2i> refined = {from};
+    for (size_t w = 1; w < waypoints.size(); ++w) {
+      waypointsMatch &= graph.refine(waypoints[w - 1], waypoints[w], refined);
+    }
+    waypointsMatch &= validPath(tileMap, refined, from, to, length);
+  }
+  CHECK(reachable);
+  CHECK(valid);
+  CHECK(notShorter);
+  CHECK(waypointsMatch);
+}
+
+// Edit the map, keep the graph up to date, and compare with a new one
+void testUpdate(Cave::Cave& cave, Cave::PathGraph& graph,
+                Cave::TileMap& tileMap, std::mt19937& rng, Totals& totals) {
+  const int width = graph.getWidth();
+  const int height = graph.getHeight();
+  std::uniform_int_distribution<int> anyX(-1, width - 1);
+  std::uniform_int_distribution<int> anyY(-1, height - 1);
+  std::uniform_int_distribution<int> anySize(1, 4);
+  for (int i = 0; i < 30; ++i) {
+    const Cave::Rect2i region = {anyX(rng), anyY(rng), anySize(rng),
+                                 anySize(rng)};
+    graph.update(tileMap, cave.editCells(tileMap, region,
+                                         (i % 2) ? Cave::FLOOR : Cave::WALL));
+  }
+
+  Cave::PathGraph built(graph.getClusterSize());
+  built.build(tileMap);
+  CHECK(graph.numNodes() == built.numNodes());
+  bool floorMatches = true;
+  for (int cy = 0; cy < height; ++cy) {
+    for (int cx = 0; cx < width; ++cx) {
+      floorMatches &= graph.isFloor(cx, cy) == built.isFloor(cx, cy);
+    }
+  }
+  CHECK(floorMatches);
+
+  std::uniform_int_distribution<int> anyCellX(0, width - 1);
+  std::uniform_int_distribution<int> anyCellY(0, height - 1);
+  bool sameLengths = true;
+  for (int i = 0; i < 80; ++i) {
+    const Cave::Vector2i from = {anyCellX(rng), anyCellY(rng)};
+    const Cave::Vector2i to = {anyCellX(rng), anyCellY(rng)};
+    sameLengths &= graph.findPath(from, to) == built.findPath(from, to);
+  }
+  CHECK(sameLengths);
+  testPaths(graph, tileMap, rng, totals);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(48);
+  Totals totals;
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    for (int clusterSize : {5, Cave::PathGraph::DEFAULT_CLUSTER_SIZE}) {
+      // Not a whole number of clusters either way
+      Cave::CaveInfo info = Presets::makeInfo(123, 77, p % 2 == 0);
+      Cave::Cave cave(info, Presets::makeParams(presets[p], 9 + (int)p));
+      Cave::PathGraph graph(clusterSize);
+      cave.setPathGraph(&graph);
+      Cave::TileMap tileMap = cave.generate();
+      CHECK(graph.getWidth() == 123 && graph.getHeight() == 77);
+      testPaths(graph, tileMap, rng, totals);
+      testUpdate(cave, graph, tileMap, rng, totals);
+    }
+  }
+  // Off the map
+  Cave::PathGraph graph;
+  graph.build(Cave::TileMap(10, std::vector<int>(12, Cave::FLOOR)));
+  CHECK(graph.findPath({-1, 0}, {3, 3}) < 0);
+  CHECK(graph.findPath({0, 0}, {10, 3}) < 0);
+  CHECK(graph.findPath({0, 0}, {9, 7}) == 16);
+
+  // Through the entrances, paths stay close to the shortest overall
+  CHECK(totals.found * 10 < totals.shortest * 11);
+  return Check::result("cave_path_test");
+}
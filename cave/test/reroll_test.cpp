@@ -0,0 +1,144 @@
+//
+// cave_reroll_test: Cave::rerollRegion leaves everything further than a
+// smoothing pattern's reach from the region as it was, says which cells
+// changed, keeps the floor in one piece, and gives the same cells every
+// time for the same map, region and params.
+//
+#include <random>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveConnectivity.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+// How far from the cells it reads a smoothing pattern can change a cell
+const int SMOOTH_REACH = 3;
+
+bool inside(const Cave::Rect2i& rect, int cx, int cy) {
+  return cx >= rect.x && cx < rect.x + rect.w && cy >= rect.y &&
+         cy < rect.y + rect.h;
+}
+
+// Every cell (cave coords) where the maps differ, row by row
+std::vector<Cave::Vector2i> differences(const Cave::TileMap& a,
+                                        const Cave::TileMap& b) {
+  std::vector<Cave::Vector2i> cells;
+  for (int cy = 0; cy + 2 < (int)a.size(); ++cy) {
+    for (int cx = 0; cx + 2 < (int)a[0].size(); ++cx) {
+      if (Cave::Cave::getTile(a, cx, cy) != Cave::Cave::getTile(b, cx, cy)) {
+        cells.push_back({cx, cy});
+      }
+    }
+  }
+  return cells;
+}
+
+bool sameCells(const std::vector<Cave::Vector2i>& a,
+               const std::vector<Cave::Vector2i>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!(a[i] == b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The floor that's still floor after is all in one region. Unsmoothed
+// maps only, as smoothing can pinch a tunnel shut corner to corner.
+bool floorJoined(const Cave::TileMap& before, const Cave::TileMap& after) {
+  const Cave::CaveConnectivity connectivity(after);
+  int region = -1;
+  for (int cy = 0; cy < connectivity.getHeight(); ++cy) {
+    for (int cx = 0; cx < connectivity.getWidth(); ++cx) {
+      if (!Cave::Cave::isEmpty(before, cx, cy) ||
+          !connectivity.isFloor(cx, cy)) {
+        continue;
+      }
+      if (region < 0) {
+        region = connectivity.getRegion(cx, cy);
+      } else if (connectivity.getRegion(cx, cy) != region) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void testRerolls(const Cave::CaveInfo& info,
+                 const Cave::GenerationParams& params, std::mt19937& rng) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  const Cave::TileMap base = cave.generate();
+  const bool wasJoined = Cave::CaveConnectivity(base).numRegions() <= 1;
+
+  std::uniform_int_distribution<int> anyX(-4, info.mCaveWidth - 1);
+  std::uniform_int_distribution<int> anyY(-4, info.mCaveHeight - 1);
+  std::uniform_int_distribution<int> anySize(1, 30);
+  bool unchangedOutside = true;
+  bool changedListed = true;
+  bool joined = true;
+  bool repeatable = true;
+  for (int i = 0; i < 12; ++i) {
+    const Cave::Rect2i region = {anyX(rng), anyY(rng), anySize(rng),
+                                 anySize(rng)};
+    Cave::GenerationParams other = params;
+    other.seed = params.seed + 1 + i;
+    if (i % 3 == 2) {
+      other.mWallChance += 0.05f;
+    }
+
+    Cave::TileMap tileMap = base;
+    const std::vector<Cave::Vector2i> changed =
+        cave.rerollRegion(tileMap, region, other);
+    const Cave::Rect2i reach = {region.x - SMOOTH_REACH,
+                                region.y - SMOOTH_REACH,
+                                region.w + 2 * SMOOTH_REACH,
+                                region.h + 2 * SMOOTH_REACH};
+    const std::vector<Cave::Vector2i> cells = differences(base, tileMap);
+    for (const Cave::Vector2i& cell : cells) {
+      unchangedOutside &= inside(reach, cell.x, cell.y);
+    }
+    changedListed &= sameCells(changed, cells);
+    if (!info.mSmoothing && wasJoined) {
+      joined &= floorJoined(base, tileMap);
+      joined &= Cave::CaveConnectivity(tileMap).numRegions() <= 1;
+    }
+
+    // Again, from this cave and a new one
+    Cave::TileMap again = base;
+    repeatable &= sameCells(cave.rerollRegion(again, region, other), changed);
+    Cave::CaveInfo freshInfo = info;
+    Cave::Cave fresh(freshInfo, params);
+    Cave::TileMap freshMap = base;
+    fresh.rerollRegion(freshMap, region, other);
+    repeatable &= again == tileMap && freshMap == tileMap;
+  }
+  CHECK(unchangedOutside);
+  CHECK(changedListed);
+  CHECK(joined);
+  CHECK(repeatable);
+}
+
+}  // namespace
+
+int main() {
+  std::mt19937 rng(42);
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 17 + (int)p);
+    for (bool smoothing : {false, true}) {
+      testRerolls(Presets::makeInfo(90, 70, smoothing), params, rng);
+    }
+  }
+  return Check::result("cave_reroll_test");
+}
@@ -0,0 +1,167 @@
+//
+// cave_roomgraph_test: RoomGraph's hops, distances, farthest rooms and
+// rooms within some hops against a walk of the tree from every room, on
+// generate()'s rooms and on random forests (several components, long
+// chains, rooms on their own).
+//
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "Presets.h"
+#include "RoomGraph.h"
+#include "TileTypes.h"
+
+namespace {
+
+bool near(float a, float b) {
+  return std::fabs(a - b) <= 1e-3f * std::max(1.0f, std::fabs(b));
+}
+
+// Compare every query from room against a walk of the tunnels from it
+void checkFrom(const Cave::RoomGraph& graph, int room, bool& ok) {
+  const int numRooms = graph.numRooms();
+  std::vector<std::vector<std::pair<int, float>>> links(numRooms);
+  for (const auto& tunnel : graph.getTunnels()) {
+    links[tunnel.mRoom1].push_back({tunnel.mRoom2, tunnel.mDistance});
+    links[tunnel.mRoom2].push_back({tunnel.mRoom1, tunnel.mDistance});
+  }
+  std::vector<int> hops(numRooms, -1);
+  std::vector<float> dist(numRooms, -1);
+  std::vector<int> stack = {room};
+  hops[room] = 0;
+  dist[room] = 0;
+  while (!stack.empty()) {
+    const int from = stack.back();
+    stack.pop_back();
+    for (const auto& link : links[from]) {
+      if (hops[link.first] < 0) {
+        hops[link.first] = hops[from] + 1;
+        dist[link.first] = dist[from] + link.second;
+        stack.push_back(link.first);
+      }
+    }
+  }
+
+  float farthest = 0;
+  int mostHops = 0;
+  for (int other = 0; other < numRooms; ++other) {
+    ok &= graph.connected(room, other) == (hops[other] >= 0);
+    ok &= graph.getHops(room, other) == hops[other];
+    ok &= near(graph.getDistance(room, other), dist[other]);
+    farthest = std::max(farthest, dist[other]);
+    mostHops = std::max(mostHops, hops[other]);
+  }
+  // Ties can go either way, so compare how far
+  const int far = graph.getFarthestRoom(room);
+  ok &= hops[far] >= 0 && near(dist[far], farthest);
+  const int farByHops = graph.getFarthestRoom(room, true);
+  ok &= hops[farByHops] == mostHops;
+
+  std::vector<int> within;
+  for (int limit : {0, 1, 2, 5, mostHops}) {
+    graph.getRoomsWithin(room, limit, within);
+    int expected = 0;
+    for (int other = 0; other < numRooms; ++other) {
+      expected += hops[other] >= 0 && hops[other] <= limit;
+    }
+    ok &= (int)within.size() == expected && !within.empty() &&
+          within[0] == room;
+    for (size_t i = 0; i < within.size(); ++i) {
+      ok &= hops[within[i]] >= 0 && hops[within[i]] <= limit;
+      ok &= i == 0 || hops[within[i - 1]] <= hops[within[i]];
+    }
+  }
+}
+
+void checkAll(const Cave::RoomGraph& graph, int maxRooms) {
+  bool ok = true;
+  for (int room = 0; room < std::min(graph.numRooms(), maxRooms); ++room) {
+    checkFrom(graph, room, ok);
+  }
+  CHECK(ok);
+}
+
+void testGenerated(const Cave::CaveInfo& info,
+                   const Cave::GenerationParams& params) {
+  Cave::CaveInfo generateInfo = info;
+  Cave::Cave cave(generateInfo, params);
+  Cave::RoomGraph graph;
+  cave.setRoomGraph(&graph);
+  Cave::GenerationStats stats;
+  cave.generate(&stats);
+  CHECK(graph.numRooms() == stats.mRooms);
+  // joinRooms joins them all
+  CHECK((int)graph.getTunnels().size() == std::max(0, graph.numRooms() - 1));
+  bool tunnelsListed = true;
+  for (int room = 0; room < graph.numRooms(); ++room) {
+    for (int tunnel : graph.getTunnelsOf(room)) {
+      tunnelsListed &= graph.getTunnels()[tunnel].mRoom1 == room ||
+                       graph.getTunnels()[tunnel].mRoom2 == room;
+    }
+  }
+  CHECK(tunnelsListed);
+  checkAll(graph, 150);
+}
+
+// A random forest: each room joins an earlier one, or starts a new tree.
+// chain joins each to the one before.
+void testForest(int numRooms, int treeChance, bool chain,
+                std::mt19937& rng) {
+  std::vector<Cave::RoomGraph::Room> rooms(numRooms);
+  std::uniform_int_distribution<int> anyPos(0, 200);
+  for (auto& room : rooms) {
+    room.mArea = 1 + (int)(rng() % 50);
+    room.mCentreX = (float)anyPos(rng) + 0.5f;
+    room.mCentreY = (float)anyPos(rng) + 0.25f;
+  }
+  std::vector<Cave::RoomGraph::Tunnel> tunnels;
+  for (int room = 1; room < numRooms; ++room) {
+    if ((int)(rng() % 100) < treeChance) {
+      continue;
+    }
+    Cave::RoomGraph::Tunnel tunnel;
+    // Either way round
+    const int other = chain ? room - 1 : (int)(rng() % room);
+    tunnel.mRoom1 = (rng() & 1) ? room : other;
+    tunnel.mRoom2 = tunnel.mRoom1 == room ? other : room;
+    tunnel.mFrom = {anyPos(rng), anyPos(rng)};
+    tunnel.mTo = {anyPos(rng), anyPos(rng)};
+    tunnel.mLength = (int)(rng() % 20);
+    tunnels.push_back(tunnel);
+  }
+  std::shuffle(tunnels.begin(), tunnels.end(), rng);
+  Cave::RoomGraph graph;
+  graph.build(rooms, tunnels);
+  CHECK(graph.numRooms() == numRooms);
+  checkAll(graph, 200);
+}
+
+}  // namespace
+
+int main() {
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 31 + (int)p);
+    testGenerated(Presets::makeInfo(120, 90, true), params);
+    testGenerated(Presets::makeInfo(7, 5, false), params);
+  }
+
+  std::mt19937 rng(49);
+  for (int numRooms : {1, 2, 3, 17, 64, 65, 300}) {
+    testForest(numRooms, 0, false, rng);
+    testForest(numRooms, 10, false, rng);
+    testForest(numRooms, 0, true, rng);
+  }
+  // Rooms with no tunnels at all
+  testForest(40, 100, false, rng);
+  return Check::result("cave_roomgraph_test");
+}
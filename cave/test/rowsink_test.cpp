@@ -0,0 +1,116 @@
+//
+// cave_rowsink_test: the row sink gets every row once, from the top down,
+// and the rows are generate()'s map (and generateToFile's file), with one
+// worker or several.
+//
+#include <cstdio>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveFile.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+const char* PATH = "cave_rowsink_test.cave";
+
+// What the sink was given, in order
+struct Rows {
+  std::vector<int> cys;
+  std::vector<std::vector<int>> tiles;
+
+  Cave::RowSink sink(int width) {
+    return [this, width](int cy, const int* row) {
+      cys.push_back(cy);
+      tiles.emplace_back(row, row + width);
+    };
+  }
+
+  // Each row once, in order, the same as the map's without the border
+  bool match(const Cave::TileMap& tileMap) const {
+    const int height = (int)tileMap.size() - 2;
+    if ((int)cys.size() != height) {
+      return false;
+    }
+    for (int cy = 0; cy < height; ++cy) {
+      const std::vector<int>& row = tileMap[cy + 1];
+      if (cys[cy] != cy ||
+          tiles[cy] != std::vector<int>(row.begin() + 1, row.end() - 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+void testGenerate(const Cave::CaveInfo& info,
+                  const Cave::GenerationParams& params, int maxWorkers) {
+  Cave::CaveInfo plainInfo = info;
+  Cave::Cave plain(plainInfo, params);
+  plain.setExecutor(nullptr, maxWorkers);
+  const Cave::TileMap expected = plain.generate();
+
+  Rows rows;
+  Cave::CaveInfo sinkInfo = info;
+  Cave::Cave cave(sinkInfo, params);
+  cave.setExecutor(nullptr, maxWorkers);
+  cave.setRowSink(rows.sink(info.mCaveWidth));
+  const Cave::TileMap tileMap = cave.generate();
+  CHECK(tileMap == expected);
+  CHECK(rows.match(tileMap));
+
+  // Again with the same cave, and the sink taken away
+  rows = Rows();
+  CHECK(cave.generate() == expected);
+  CHECK(rows.match(expected));
+  cave.setRowSink(Cave::RowSink());
+  rows = Rows();
+  CHECK(cave.generate() == expected);
+  CHECK(rows.cys.empty());
+}
+
+void testGenerateToFile(const Cave::CaveInfo& info,
+                        const Cave::GenerationParams& params) {
+  Rows rows;
+  Cave::CaveInfo fileInfo = info;
+  Cave::Cave cave(fileInfo, params);
+  cave.setRowSink(rows.sink(info.mCaveWidth));
+  // Small enough for several bands of rows
+  CHECK(cave.generateToFile(PATH, 200 * 1000));
+  Cave::CaveFile file;
+  CHECK(file.open(PATH));
+  Cave::TileMap written;
+  file.copyTo(written);
+  CHECK(rows.match(written));
+}
+
+}  // namespace
+
+int main() {
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 45 + (int)p);
+    for (bool smoothing : {false, true}) {
+      for (int maxWorkers : {1, 0}) {
+        testGenerate(Presets::makeInfo(83, 61, smoothing), params,
+                     maxWorkers);
+      }
+      // Only a few rows, fewer than the smoother keeps behind
+      testGenerate(Presets::makeInfo(40, 1, smoothing), params, 0);
+      testGenerate(Presets::makeInfo(40, 3, smoothing), params, 0);
+      if (params.mCoarseLevels == 0) {
+        testGenerateToFile(Presets::makeInfo(57, 150, smoothing), params);
+      }
+    }
+  }
+  // A tall map, for more bands of rows than workers
+  testGenerate(Presets::makeInfo(64, 700, true),
+               Presets::makeParams(presets[0], 3), 0);
+  std::remove(PATH);
+  return Check::result("cave_rowsink_test");
+}
@@ -0,0 +1,209 @@
+//
+// cave_tiled_test: exportTiled / importTiled round trips in every format
+// and encoding, and reading zlib layer data. Built with zlib when CMake
+// finds it, to check the exporter's deflate output with zlib itself and the
+// importer against zlib's stored, fixed and dynamic Huffman blocks.
+//
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef CAVE_TEST_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "Presets.h"
+#include "TileTypes.h"
+#include "TiledMap.h"
+
+namespace {
+
+const char* PATH = "cave_tiled_test.map";
+
+const char* BASE64 =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+Cave::TileMap generate(int width, int height, bool smoothing, int seed) {
+  Cave::CaveInfo info = Presets::makeInfo(width, height, smoothing);
+  Cave::Cave cave(info, Presets::makeParams(Presets::all()[0], seed));
+  return cave.generate();
+}
+
+// The layer data Tiled should see: little endian gids
+std::vector<uint8_t> gidBytes(const Cave::TileMap& tileMap) {
+  std::vector<uint8_t> bytes;
+  for (const auto& row : tileMap) {
+    for (int tile : row) {
+      const uint32_t gid = (uint32_t)Cave::Cave::getAtlasIndex(tile) + 1;
+      for (int i = 0; i < 4; ++i) {
+        bytes.push_back((uint8_t)(gid >> (8 * i)));
+      }
+    }
+  }
+  return bytes;
+}
+
+// Tiles sharing an atlas index come back as the first of them
+bool sameAtlasTiles(const Cave::TileMap& a, const Cave::TileMap& b) {
+  return gidBytes(a) == gidBytes(b);
+}
+
+std::string encodeBase64(const std::vector<uint8_t>& bytes) {
+  std::string text;
+  for (size_t i = 0; i < bytes.size(); i += 3) {
+    const size_t left = bytes.size() - i;
+    const uint32_t group = (bytes[i] << 16) |
+                           ((left > 1 ? bytes[i + 1] : 0) << 8) |
+                           (left > 2 ? bytes[i + 2] : 0);
+    text += BASE64[(group >> 18) & 63];
+    text += BASE64[(group >> 12) & 63];
+    text += left > 1 ? BASE64[(group >> 6) & 63] : '=';
+    text += left > 2 ? BASE64[group & 63] : '=';
+  }
+  return text;
+}
+
+std::vector<uint8_t> decodeBase64(const std::string& text) {
+  std::vector<uint8_t> bytes;
+  uint32_t bits = 0;
+  int numBits = 0;
+  for (char c : text) {
+    const char* found = c ? std::strchr(BASE64, c) : nullptr;
+    if (!found) {
+      continue;
+    }
+    bits = (bits << 6) | (uint32_t)(found - BASE64);
+    numBits += 6;
+    if (numBits >= 8) {
+      numBits -= 8;
+      bytes.push_back((uint8_t)(bits >> numBits));
+    }
+  }
+  return bytes;
+}
+
+// The base64 between "data":" and the closing quote
+std::string jsonData(const std::string& json) {
+  const size_t begin = json.find("\"data\":\"") + 8;
+  return json.substr(begin, json.find('"', begin) - begin);
+}
+
+// A JSON map with the given layer data, as Tiled would save it
+void writeJsonMap(const Cave::TileMap& tileMap, const std::string& data,
+                  const std::string& compression) {
+  const size_t width = tileMap[0].size();
+  const size_t height = tileMap.size();
+  std::ofstream out(PATH, std::ios::binary | std::ios::trunc);
+  out << "{ \"height\":" << height << ", \"infinite\":false,\n"
+      << " \"layers\":[ { \"compression\":\"" << compression << "\",\n"
+      << "  \"data\":\"" << data << "\",\n"
+      << "  \"encoding\":\"base64\", \"height\":" << height
+      << ", \"name\":\"cave\", \"type\":\"tilelayer\", \"width\":" << width
+      << " } ],\n"
+      << " \"width\":" << width << " }\n";
+}
+
+void testRoundTrips(const Cave::TileMap& tileMap) {
+  for (auto format : {Cave::TiledOptions::JSON, Cave::TiledOptions::TMX}) {
+    for (auto encoding :
+         {Cave::TiledOptions::CSV, Cave::TiledOptions::BASE64_ZLIB}) {
+      Cave::TiledOptions options;
+      options.mFormat = format;
+      options.mEncoding = encoding;
+      CHECK(Cave::exportTiled(PATH, tileMap, options));
+      Cave::TileMap imported;
+      CHECK(Cave::importTiled(PATH, imported));
+      CHECK(sameAtlasTiles(imported, tileMap));
+    }
+  }
+
+  // Uncompressed base64
+  writeJsonMap(tileMap, encodeBase64(gidBytes(tileMap)), "");
+  Cave::TileMap imported;
+  CHECK(Cave::importTiled(PATH, imported));
+  CHECK(sameAtlasTiles(imported, tileMap));
+}
+
+void testBadZlib(const Cave::TileMap& tileMap) {
+  std::ostringstream out;
+  CHECK(Cave::exportTiled(out, tileMap));
+  const std::vector<uint8_t> good = decodeBase64(jsonData(out.str()));
+  Cave::TileMap imported;
+
+  // Damage anywhere: the header, the codes, the checksum
+  for (size_t at : {(size_t)0, (size_t)1, good.size() / 3, good.size() / 2,
+                    good.size() - 1}) {
+    std::vector<uint8_t> bad = good;
+    bad[at] ^= 0x24;
+    writeJsonMap(tileMap, encodeBase64(bad), "zlib");
+    CHECK(!Cave::importTiled(PATH, imported));
+  }
+  // Cut short
+  for (size_t size : {(size_t)1, (size_t)6, good.size() / 2,
+                      good.size() - 4, good.size() - 1}) {
+    const std::vector<uint8_t> cut(good.begin(), good.begin() + size);
+    writeJsonMap(tileMap, encodeBase64(cut), "zlib");
+    CHECK(!Cave::importTiled(PATH, imported));
+  }
+  // Other compression
+  writeJsonMap(tileMap, encodeBase64(good), "zstd");
+  CHECK(!Cave::importTiled(PATH, imported));
+}
+
+#ifdef CAVE_TEST_HAVE_ZLIB
+void testWithZlib(const Cave::TileMap& tileMap) {
+  const std::vector<uint8_t> expected = gidBytes(tileMap);
+
+  // zlib reads what the exporter writes
+  std::ostringstream out;
+  CHECK(Cave::exportTiled(out, tileMap));
+  const std::vector<uint8_t> compressed = decodeBase64(jsonData(out.str()));
+  std::vector<uint8_t> inflated(expected.size() + 1);
+  uLongf inflatedSize = (uLongf)inflated.size();
+  CHECK(uncompress(inflated.data(), &inflatedSize, compressed.data(),
+                   (uLong)compressed.size()) == Z_OK);
+  inflated.resize(inflatedSize);
+  CHECK(inflated == expected);
+
+  // and the importer reads what zlib writes: stored blocks at level 0,
+  // Huffman codes of its own choosing at higher levels
+  for (int level : {0, 1, 6, 9}) {
+    std::vector<uint8_t> deflated(compressBound((uLong)expected.size()));
+    uLongf deflatedSize = (uLongf)deflated.size();
+    CHECK(compress2(deflated.data(), &deflatedSize, expected.data(),
+                    (uLong)expected.size(), level) == Z_OK);
+    deflated.resize(deflatedSize);
+    writeJsonMap(tileMap, encodeBase64(deflated), "zlib");
+    Cave::TileMap imported;
+    CHECK(Cave::importTiled(PATH, imported));
+    CHECK(sameAtlasTiles(imported, tileMap));
+  }
+}
+#endif
+
+}  // namespace
+
+int main() {
+  const Cave::TileMap maps[] = {
+      generate(50, 30, false, 5),
+      generate(50, 30, true, 5),
+      // Rows over 32K of gids, past deflate's furthest match
+      generate(8200, 6, true, 9),
+  };
+  for (const auto& tileMap : maps) {
+    testRoundTrips(tileMap);
+    testBadZlib(tileMap);
+#ifdef CAVE_TEST_HAVE_ZLIB
+    testWithZlib(tileMap);
+#endif
+  }
+  std::remove(PATH);
+  return Check::result("cave_tiled_test");
+}
@@ -0,0 +1,101 @@
+//
+// cave_tofile_test: generateToFile on maps many bands tall. The floor in
+// the file is all connected, the first band and bands with no floor above
+// them included, and the scratch kept stays within the memory budget
+// however tall the map is.
+//
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveConnectivity.h"
+#include "CaveFile.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "GenerationStats.h"
+#include "Presets.h"
+#include "TileTypes.h"
+
+namespace {
+
+const char* PATH = "cave_tofile_test.cave";
+
+// Bands 40 rows tall at 150 wide
+const size_t BUDGET = 600 * 1000;
+
+struct Written {
+  bool ok = false;
+  Cave::TileMap tileMap;
+  Cave::GenerationStats stats;
+};
+
+Written generateToFile(const Cave::CaveInfo& info,
+                       const Cave::GenerationParams& params, size_t budget) {
+  Written written;
+  Cave::CaveInfo fileInfo = info;
+  Cave::Cave cave(fileInfo, params);
+  written.ok = cave.generateToFile(PATH, budget, &written.stats);
+  Cave::CaveFile file;
+  written.ok &= file.open(PATH);
+  file.copyTo(written.tileMap);
+  return written;
+}
+
+bool hasFloor(const Cave::TileMap& tileMap) {
+  for (const auto& row : tileMap) {
+    for (int tile : row) {
+      if (Cave::Cave::isEmpty(tile)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Unsmoothed, as smoothing can pinch a tunnel shut corner to corner
+void testConnected(const Cave::GenerationParams& params, int width,
+                   size_t budget) {
+  const Written written =
+      generateToFile(Presets::makeInfo(width, 500, false), params, budget);
+  CHECK(written.ok);
+  const Cave::CaveConnectivity connectivity(written.tileMap);
+  CHECK(connectivity.numRegions() == (hasFloor(written.tileMap) ? 1 : 0));
+}
+
+// The same band height however tall the map, so the same scratch
+void testBudget(const Cave::GenerationParams& params) {
+  const Written shorter =
+      generateToFile(Presets::makeInfo(150, 300, true), params, BUDGET);
+  const Written taller =
+      generateToFile(Presets::makeInfo(150, 1200, true), params, BUDGET);
+  CHECK(shorter.ok && taller.ok);
+  CHECK(taller.stats.mPeakScratchBytes > 0);
+  CHECK(taller.stats.mPeakScratchBytes <= BUDGET);
+  CHECK(taller.stats.mPeakScratchBytes <=
+        shorter.stats.mPeakScratchBytes * 11 / 10);
+}
+
+}  // namespace
+
+int main() {
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    for (int seed = 1; seed <= 3; ++seed) {
+      const Cave::GenerationParams params =
+          Presets::makeParams(presets[p], seed + 46 * (int)p);
+      if (params.mCoarseLevels > 0) {
+        continue;  // Not supported
+      }
+      testConnected(params, 150, BUDGET);
+      // Narrow, with the smallest bands
+      testConnected(params, 37, 60 * 1000);
+      if (seed == 1) {
+        testBudget(params);
+      }
+    }
+  }
+  std::remove(PATH);
+  return Check::result("cave_tofile_test");
+}
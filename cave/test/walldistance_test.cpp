@@ -0,0 +1,123 @@
+//
+// cave_walldistance_test: WallDistance against a search of every wall for
+// the nearest one, set back as smoothing cuts it, on the presets with and
+// without smoothing. EUCLIDEAN must match it and CHAMFER stay between it
+// and the chamfer's worst case over it.
+//
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Cave.h"
+#include "CaveInfo.h"
+#include "Check.h"
+#include "GenerationParams.h"
+#include "Presets.h"
+#include "TileTypes.h"
+#include "WallDistance.h"
+
+namespace {
+
+// Steps of 1 and sqrt(2) over a straight line, at worst 22.5 degrees off
+// an axis
+const double CHAMFER_OVER = std::sqrt(4 - 2 * std::sqrt(2.0));
+
+struct Nearest {
+  double distance;  // To the nearest wall's centre
+  // distance plus the set back, of the nearest walls (there can be a tie)
+  double fewest;
+  double most;
+  // The least of distance plus set back over all walls
+  double setBack;
+};
+
+// Map coords, border included
+Nearest findNearest(const Cave::TileMap& tileMap,
+                    const std::vector<Cave::Vector2i>& walls, int x, int y) {
+  Nearest nearest = {1e9, 1e9, 0, 1e9};
+  for (const Cave::Vector2i& wall : walls) {
+    const double dx = wall.x - x;
+    const double dy = wall.y - y;
+    const double distance = std::sqrt(dx * dx + dy * dy);
+    const double setBack =
+        Cave::WallDistance::getSetBack(tileMap[wall.y][wall.x]);
+    nearest.setBack = std::min(nearest.setBack, distance + setBack);
+    if (distance < nearest.distance - 1e-9) {
+      nearest.distance = distance;
+      nearest.fewest = nearest.most = distance + setBack;
+    } else if (distance < nearest.distance + 1e-9) {
+      nearest.fewest = std::min(nearest.fewest, distance + setBack);
+      nearest.most = std::max(nearest.most, distance + setBack);
+    }
+  }
+  return nearest;
+}
+
+// Floor with a wall border
+Cave::TileMap openMap(int width, int height) {
+  Cave::TileMap tileMap(height + 2, std::vector<int>(width + 2, Cave::WALL));
+  for (int cy = 0; cy < height; ++cy) {
+    for (int cx = 0; cx < width; ++cx) {
+      Cave::Cave::setCell(tileMap, cx, cy, Cave::FLOOR);
+    }
+  }
+  return tileMap;
+}
+
+void testMap(const Cave::TileMap& tileMap) {
+  std::vector<Cave::Vector2i> walls;
+  for (int y = 0; y < (int)tileMap.size(); ++y) {
+    for (int x = 0; x < (int)tileMap[y].size(); ++x) {
+      if (!Cave::Cave::isEmpty(tileMap[y][x])) {
+        walls.push_back({x, y});
+      }
+    }
+  }
+  Cave::WallDistance euclidean(Cave::WallDistance::EUCLIDEAN);
+  euclidean.build(tileMap);
+  Cave::WallDistance oneWorker(Cave::WallDistance::EUCLIDEAN);
+  oneWorker.build(tileMap, nullptr, 1);
+  Cave::WallDistance chamfer(Cave::WallDistance::CHAMFER);
+  chamfer.build(tileMap);
+  CHECK(euclidean.getWidth() == (int)tileMap[0].size() - 2);
+  CHECK(euclidean.getHeight() == (int)tileMap.size() - 2);
+
+  const float eps = 1e-3f;
+  bool exact = true;
+  bool sameWorkers = true;
+  bool chamferBounded = true;
+  for (int cy = 0; cy < euclidean.getHeight(); ++cy) {
+    for (int cx = 0; cx < euclidean.getWidth(); ++cx) {
+      const Nearest nearest = findNearest(tileMap, walls, cx + 1, cy + 1);
+      const float got = euclidean.get(cx, cy);
+      exact &= got >= nearest.fewest - eps && got <= nearest.most + eps;
+      sameWorkers &= oneWorker.get(cx, cy) == got;
+      const float chamfered = chamfer.get(cx, cy);
+      chamferBounded &= chamfered >= nearest.setBack - eps &&
+                        chamfered <= nearest.most * CHAMFER_OVER + eps;
+    }
+  }
+  CHECK(exact);
+  CHECK(sameWorkers);
+  CHECK(chamferBounded);
+}
+
+}  // namespace
+
+int main() {
+  const auto& presets = Presets::all();
+  for (size_t p = 0; p < presets.size(); ++p) {
+    const Cave::GenerationParams params =
+        Presets::makeParams(presets[p], 47 + (int)p);
+    for (bool smoothing : {false, true}) {
+      Cave::CaveInfo info = Presets::makeInfo(61, 43, smoothing);
+      Cave::Cave cave(info, params);
+      testMap(cave.generate());
+    }
+  }
+  // Open floor, and a single row and column
+  testMap(openMap(38, 28));
+  testMap(openMap(18, 1));
+  testMap(openMap(1, 18));
+  return Check::result("cave_walldistance_test");
+}